@@ -0,0 +1,1093 @@
+/*
+ * bench.c
+ * Copyright (C) 2016 DerShokus <lily.coder@gmail.com>
+ *
+ * Distributed under terms of the MIT license.
+ *
+ * Usage: bench [name...]
+ * Runs all benchmarks or only the named ones.
+ */
+
+#include <trie.h>
+#include <trie_ac.h>
+#include <trie_burst.h>
+#include <trie_shm.h>
+#include <trie_wal.h>
+#include <dirent.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#define TRIE_INT_NAME trie_ip4
+#define TRIE_INT_TYPE uint32_t
+#define TRIE_INT_STRIDE 8
+#include <trie_int.h>
+
+static double now(void)
+{
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static uint64_t rng_state = 0x9E3779B97F4A7C15ull;
+
+static uint64_t rng(void)
+{
+        // xorshift64*
+        rng_state ^= rng_state >> 12;
+        rng_state ^= rng_state << 25;
+        rng_state ^= rng_state >> 27;
+        return rng_state * 0x2545F4914F6CDD1Dull;
+}
+
+// Random rank in [0, n) with the probability ~1/rank (Zipf-like).
+static size_t zipf(size_t n)
+{
+        const double u = (double)(rng() >> 11) / (double)(1ull << 53);
+        return (size_t)exp(u * log((double)n)) - 1;
+}
+
+// Random lowercase word of [min, max] letters with a terminator.
+// Returns the key size (including the terminator).
+static size_t random_word(uint8_t *buf, size_t min, size_t max)
+{
+        const size_t size = min + rng() % (max - min + 1);
+        for (size_t i = 0; i < size; ++i)
+                buf[i] = (uint8_t)('a' + rng() % 26);
+        buf[size] = '\0';
+        return size + 1;
+}
+
+// +--------------------------------------------------------------------------+
+// | Aho-Corasick                                                             |
+// +--------------------------------------------------------------------------+
+
+#define AC_KEYWORDS 100000
+#define AC_VOCABULARY 20000
+#define AC_CORPUS (256u << 20)
+#define AC_CHUNK (1u << 20)
+
+static bool ac_count(void *ctx, uint64_t end, size_t size, void *data)
+{
+        (void)end;
+        (void)size;
+        (void)data;
+        ++*(size_t *)ctx;
+        return true;
+}
+
+static void bench_ac(void)
+{
+        struct trie *obj = trie_new(NULL, NULL);
+        static uint8_t keywords[AC_KEYWORDS][16];
+        for (size_t i = 0; i < AC_KEYWORDS; ++i) {
+                const size_t size = random_word(keywords[i], 4, 12);
+                void *old;
+                trie_insert(obj, keywords[i], size, (void *)(i + 1), &old);
+        }
+
+        double start       = now();
+        struct trie_ac *ac = trie_ac_new(obj);
+        printf("ac: compile %d keywords: %.3f s\n", AC_KEYWORDS,
+               now() - start);
+
+        // text of a vocabulary with Zipf-like frequencies, every 64th word
+        // is a keyword
+        static uint8_t vocabulary[AC_VOCABULARY][16];
+        for (size_t i = 0; i < AC_VOCABULARY; ++i)
+                random_word(vocabulary[i], 2, 10);
+        uint8_t *corpus = malloc(AC_CORPUS);
+        size_t size     = 0;
+        while (size + 16 < AC_CORPUS) {
+                const uint8_t *word;
+                if (rng() % 64 == 0) {
+                        word = keywords[rng() % AC_KEYWORDS];
+                } else {
+                        word = vocabulary[zipf(AC_VOCABULARY)];
+                }
+                const size_t len = strlen((const char *)word);
+                memcpy(&corpus[size], word, len);
+                size += len;
+                corpus[size++] = ' ';
+        }
+
+        struct trie_ac_scanner *scanner = trie_ac_scanner_new(ac);
+        size_t matches                  = 0;
+        start                           = now();
+        for (size_t i = 0; i < size; i += AC_CHUNK) {
+                const size_t chunk = size - i < AC_CHUNK ? size - i : AC_CHUNK;
+                trie_ac_feed(scanner, &corpus[i], chunk, ac_count, &matches);
+        }
+        const double elapsed = now() - start;
+        printf("ac: scan %zu MB: %.3f s, %.2f GB/s, %zu matches\n",
+               size >> 20, elapsed, (double)size / elapsed / 1e9, matches);
+
+        trie_ac_scanner_delete(&scanner);
+        trie_ac_delete(&ac);
+        free(corpus);
+        trie_delete(&obj);
+}
+
+// +--------------------------------------------------------------------------+
+// | Top-k                                                                    |
+// +--------------------------------------------------------------------------+
+
+#define TOPK_KEYS 1000000
+#define TOPK_QUERIES 10000
+
+static void bench_topk(void)
+{
+        struct trie *obj = trie_new(NULL, NULL);
+        uint8_t word[32];
+        for (size_t i = 0; i < TOPK_KEYS; ++i) {
+                const size_t size = random_word(word, 3, 10);
+                void *old;
+                trie_insert_scored(obj, word, size, (void *)i,
+                                   (uint32_t)rng(), &old);
+        }
+
+        struct trie_node *out[100];
+        for (size_t k = 1; k <= 100; k *= 10) {
+                for (size_t len = 0; len <= 2; ++len) {
+                        size_t found = 0;
+                        double start = now();
+                        for (size_t q = 0; q < TOPK_QUERIES; ++q) {
+                                random_word(word, len, len);
+                                found += trie_topk(obj, word, len, k, out);
+                        }
+                        const double elapsed = now() - start;
+                        printf("topk: k=%zu prefix=%zu: %.2f us/query, "
+                               "%zu found\n",
+                               k, len, elapsed / TOPK_QUERIES * 1e6, found);
+                }
+        }
+
+        // the old way: iterate over all keys and keep the best one
+        double start = now();
+        uint32_t best = 0;
+        for (struct trie_node *i = trie_begin(obj); i; i = trie_next(i)) {
+                uint32_t score;
+                trie_score(i, &score);
+                if (score > best)
+                        best = score;
+        }
+        printf("topk: full iteration: %.2f us, best %u\n",
+               (now() - start) * 1e6, best);
+
+        trie_delete(&obj);
+}
+
+// +--------------------------------------------------------------------------+
+// | Root index                                                               |
+// +--------------------------------------------------------------------------+
+
+#define INDEX_KEYS 500000
+
+static void bench_index(void)
+{
+        // keys with a random leading byte and a lowercase tail
+        static uint8_t keys[INDEX_KEYS][16];
+        for (size_t i = 0; i < INDEX_KEYS; ++i) {
+                keys[i][0] = (uint8_t)(rng() % 255 + 1);
+                random_word(&keys[i][1], 3, 10);
+        }
+
+        for (unsigned int depth = 0; depth <= 2; ++depth) {
+                struct trie *obj = trie_new(NULL, NULL);
+                trie_root_index(obj, depth);
+
+                double start = now();
+                for (size_t i = 0; i < INDEX_KEYS; ++i) {
+                        void *old;
+                        trie_insert(obj, keys[i],
+                                    strlen((const char *)keys[i]) + 1,
+                                    (void *)i, &old);
+                }
+                const double insert = now() - start;
+
+                start = now();
+                for (size_t i = 0; i < INDEX_KEYS; ++i) {
+                        void *data;
+                        trie_at(obj, keys[i], strlen((const char *)keys[i]) + 1,
+                                &data);
+                }
+                const double hit = now() - start;
+
+                start = now();
+                for (size_t i = 0; i < INDEX_KEYS; ++i) {
+                        void *data;
+                        // the same keys without the terminator
+                        trie_at(obj, keys[i], strlen((const char *)keys[i]),
+                                &data);
+                }
+                const double miss = now() - start;
+
+                start = now();
+                for (size_t i = 0; i < INDEX_KEYS; i += 2) {
+                        void *data;
+                        trie_remove(obj, keys[i],
+                                    strlen((const char *)keys[i]) + 1, &data);
+                }
+                const double remove = now() - start;
+
+                printf("index: depth %u: insert %.3f us, hit %.3f us, "
+                       "miss %.3f us, remove %.3f us\n",
+                       depth, insert / INDEX_KEYS * 1e6, hit / INDEX_KEYS * 1e6,
+                       miss / INDEX_KEYS * 1e6,
+                       remove / (INDEX_KEYS / 2) * 1e6);
+                trie_delete(&obj);
+        }
+}
+
+// +--------------------------------------------------------------------------+
+// | Rank and select                                                          |
+// +--------------------------------------------------------------------------+
+
+#define SELECT_KEYS 1000000
+#define SELECT_QUERIES 100000
+
+static void bench_select(void)
+{
+        struct trie *obj = trie_new(NULL, NULL);
+        uint8_t word[32];
+        for (size_t i = 0; i < SELECT_KEYS; ++i) {
+                const size_t size = random_word(word, 3, 10);
+                void *old;
+                trie_insert(obj, word, size, (void *)i, &old);
+        }
+        const size_t total = trie_count_prefix(obj, NULL, 0);
+
+        double start = now();
+        for (size_t q = 0; q < SELECT_QUERIES; ++q) {
+                struct trie_node *node = trie_select(obj, rng() % total);
+                size_t rank;
+                const size_t size = trie_key(node, word, sizeof(word));
+                trie_rank(obj, word, size, &rank);
+        }
+        printf("select: %zu keys: %.2f us/select+rank\n", total,
+               (now() - start) / SELECT_QUERIES * 1e6);
+
+        // the old way: skip the offset with trie_next
+        start = now();
+        size_t skipped = 0;
+        for (struct trie_node *i = trie_begin(obj); i && skipped < total / 2;
+             i = trie_next(i))
+                ++skipped;
+        printf("select: skip %zu keys with trie_next: %.2f us\n", skipped,
+               (now() - start) * 1e6);
+
+        trie_delete(&obj);
+}
+
+// +--------------------------------------------------------------------------+
+// | File loading                                                             |
+// +--------------------------------------------------------------------------+
+
+#define LOAD_LINES 500000
+
+// the old way: getline and a terminated copy (see tests/highload.c)
+static void load_getline(const char *path)
+{
+        struct trie *obj = trie_new(NULL, NULL);
+        double start     = now();
+        FILE *file       = fopen(path, "r");
+        char *line       = NULL;
+        size_t cap       = 0;
+        ssize_t len;
+        for (size_t i = 0; (len = getline(&line, &cap, file)) != -1; ++i) {
+                line[len - 1] = '\0';
+                void *old;
+                trie_insert(obj, (uint8_t *)line, (size_t)len, (void *)i,
+                            &old);
+        }
+        free(line);
+        fclose(file);
+        printf("load: getline: %.3f s, %zu keys\n", now() - start,
+               trie_count_prefix(obj, NULL, 0));
+}
+
+static void load_file(const char *path)
+{
+        struct trie *obj = trie_new(NULL, NULL);
+        double start     = now();
+        trie_load_file(obj, path, '\n',
+                       TRIE_LOAD_TERMINATED | TRIE_LOAD_LINE_NUMBERS, NULL);
+        printf("load: trie_load_file: %.3f s, %zu keys\n", now() - start,
+               trie_count_prefix(obj, NULL, 0));
+}
+
+static void bench_load(void)
+{
+        char path[] = "/tmp/trie_bench_XXXXXX";
+        const int fd = mkstemp(path);
+        FILE *file   = fdopen(fd, "w");
+        uint8_t word[32];
+        for (size_t i = 0; i < LOAD_LINES; ++i) {
+                const size_t size = random_word(word, 3, 14);
+                word[size - 1]    = '\n';
+                fwrite(word, 1, size, file);
+        }
+        fclose(file);
+
+        // every way starts with a fresh heap
+        void (*loaders[])(const char *) = {load_getline, load_file};
+        for (size_t i = 0; i < sizeof(loaders) / sizeof(loaders[0]); ++i) {
+                fflush(stdout);
+                const pid_t pid = fork();
+                if (pid == 0) {
+                        loaders[i](path);
+                        exit(0);
+                }
+                waitpid(pid, NULL, 0);
+        }
+
+        unlink(path);
+}
+
+// +--------------------------------------------------------------------------+
+// | Teardown                                                                 |
+// +--------------------------------------------------------------------------+
+
+#define TEARDOWN_KEYS 1000000
+
+static struct trie *teardown_fill(struct trie *obj)
+{
+        rng_state = 0x9E3779B97F4A7C15ull;
+        uint8_t word[32];
+        for (size_t i = 0; i < TEARDOWN_KEYS; ++i) {
+                const size_t size = random_word(word, 3, 10);
+                void *old;
+                trie_insert(obj, word, size, (void *)i, &old);
+        }
+        return obj;
+}
+
+static void bench_teardown(void)
+{
+        // the old way: trie_next_delete over all keys
+        struct trie *obj = teardown_fill(trie_new(NULL, NULL));
+        double start     = now();
+        for (struct trie_node *i = trie_begin(obj); i;
+             i                   = trie_next_delete(obj, i)) {
+        }
+        printf("teardown: trie_next_delete: %.3f s\n", now() - start);
+        trie_delete(&obj);
+
+        obj   = teardown_fill(trie_new(NULL, NULL));
+        start = now();
+        trie_delete(&obj);
+        printf("teardown: trie_delete: %.3f s\n", now() - start);
+
+        start = now();
+        obj   = teardown_fill(trie_new(NULL, NULL));
+        printf("teardown: fill: %.3f s\n", now() - start);
+        start = now();
+        trie_clear(obj);
+        printf("teardown: trie_clear: %.3f s\n", now() - start);
+        start = now();
+        teardown_fill(obj);
+        printf("teardown: refill after trie_clear: %.3f s\n", now() - start);
+        trie_delete(&obj);
+}
+
+// +--------------------------------------------------------------------------+
+// | Prefix removing                                                          |
+// +--------------------------------------------------------------------------+
+
+#define PREFIX_KEYS 1000000
+
+static void bench_prefix(void)
+{
+        static uint8_t keys[PREFIX_KEYS][16];
+        static size_t sizes[PREFIX_KEYS];
+        struct trie *old_way = trie_new(NULL, NULL);
+        struct trie *obj     = trie_new(NULL, NULL);
+        for (size_t i = 0; i < PREFIX_KEYS; ++i) {
+                sizes[i] = random_word(keys[i], 3, 10);
+                void *old;
+                trie_insert(old_way, keys[i], sizes[i], (void *)i, &old);
+                trie_insert(obj, keys[i], sizes[i], (void *)i, &old);
+        }
+
+        // the old way: remove every key with the prefix
+        double start = now();
+        for (size_t i = 0; i < PREFIX_KEYS; ++i) {
+                void *data;
+                if (keys[i][0] < 'c')
+                        trie_remove(old_way, keys[i], sizes[i], &data);
+        }
+        printf("prefix: trie_remove: %.3f s\n", now() - start);
+
+        start = now();
+        size_t removed = 0;
+        for (uint8_t c = 'a'; c < 'c'; ++c)
+                removed += trie_remove_prefix(obj, &c, 1, NULL, NULL, 0);
+        printf("prefix: trie_remove_prefix: %.3f s, %zu keys\n",
+               now() - start, removed);
+
+        start = now();
+        for (uint8_t c = 'c'; c < 'e'; ++c)
+                trie_remove_prefix(obj, &c, 1, NULL, NULL,
+                                   TRIE_REMOVE_DEFERRED);
+        printf("prefix: trie_remove_prefix, deferred: %.3f s\n",
+               now() - start);
+
+        trie_delete(&old_way);
+        trie_delete(&obj);
+}
+
+// +--------------------------------------------------------------------------+
+// | Compaction                                                               |
+// +--------------------------------------------------------------------------+
+
+#define COMPACT_KEYS 500000
+
+static double compact_lookups(struct trie *obj, uint8_t (*keys)[16],
+                              const size_t *sizes)
+{
+        double start = now();
+        for (size_t i = 0; i < COMPACT_KEYS; ++i) {
+                void *data;
+                trie_at(obj, keys[i], sizes[i], &data);
+        }
+        return (now() - start) / COMPACT_KEYS * 1e9;
+}
+
+static void bench_compact(void)
+{
+        static uint8_t keys[COMPACT_KEYS][16];
+        static size_t sizes[COMPACT_KEYS];
+        struct trie *obj = trie_new(NULL, NULL);
+        for (size_t i = 0; i < COMPACT_KEYS; ++i) {
+                sizes[i] = random_word(keys[i], 3, 10);
+                void *old;
+                trie_insert(obj, keys[i], sizes[i], (void *)i, &old);
+        }
+        // churn: nodes of later keys are spread over the heap
+        for (size_t n = 0; n < 2 * COMPACT_KEYS; ++n) {
+                const size_t i = rng() % COMPACT_KEYS;
+                void *data;
+                if (!trie_remove(obj, keys[i], sizes[i], &data))
+                        trie_insert(obj, keys[i], sizes[i], (void *)i, &data);
+        }
+        printf("compact: lookup before: %.0f ns\n",
+               compact_lookups(obj, keys, sizes));
+
+        double start = now();
+        trie_compact(obj, 0);
+        printf("compact: trie_compact: %.3f s\n", now() - start);
+        printf("compact: lookup after: %.0f ns\n",
+               compact_lookups(obj, keys, sizes));
+
+        start = now();
+        trie_compact(obj, TRIE_COMPACT_HUGEPAGES);
+        printf("compact: trie_compact with huge pages: %.3f s\n",
+               now() - start);
+        printf("compact: lookup after: %.0f ns\n",
+               compact_lookups(obj, keys, sizes));
+        trie_delete(&obj);
+}
+
+// +--------------------------------------------------------------------------+
+// | Write-ahead log                                                          |
+// +--------------------------------------------------------------------------+
+
+#define WAL_KEYS 200000
+
+static void wal_clean(const char *dir)
+{
+        DIR *dirp = opendir(dir);
+        for (struct dirent *i = readdir(dirp); i; i = readdir(dirp)) {
+                char path[512];
+                snprintf(path, sizeof(path), "%s/%s", dir, i->d_name);
+                unlink(path);
+        }
+        closedir(dirp);
+}
+
+static double wal_fill(struct trie *obj)
+{
+        rng_state    = 0x9E3779B97F4A7C15ull;
+        double start = now();
+        uint8_t word[32];
+        for (size_t i = 0; i < WAL_KEYS; ++i) {
+                const size_t size = random_word(word, 3, 10);
+                void *old;
+                trie_insert(obj, word, size, (void *)i, &old);
+        }
+        return now() - start;
+}
+
+static void bench_wal(void)
+{
+        char dir[] = "/tmp/trie_bench_XXXXXX";
+        mkdtemp(dir);
+
+        struct trie *obj = trie_new(NULL, NULL);
+        printf("wal: %d inserts without a log: %.3f s\n", WAL_KEYS,
+               wal_fill(obj));
+        trie_delete(&obj);
+
+        const size_t groups[] = {16, 128, 1024};
+        for (size_t i = 0; i < sizeof(groups) / sizeof(groups[0]); ++i) {
+                const struct trie_wal_config config = {groups[i], 1000};
+                obj = trie_recover(dir, &config, NULL, NULL);
+                printf("wal: %d inserts, groups of %zu: %.3f s\n", WAL_KEYS,
+                       groups[i], wal_fill(obj));
+                trie_delete(&obj);
+                wal_clean(dir);
+        }
+
+        obj = trie_recover(dir, NULL, NULL, NULL);
+        wal_fill(obj);
+        double start = now();
+        trie_checkpoint(obj);
+        printf("wal: checkpoint started: %.3f s\n", now() - start);
+        trie_checkpoint_wait(obj);
+        printf("wal: checkpoint written: %.3f s\n", now() - start);
+        trie_delete(&obj);
+
+        start = now();
+        obj   = trie_recover(dir, NULL, NULL, NULL);
+        printf("wal: recover from the checkpoint: %.3f s, %zu keys\n",
+               now() - start, trie_count_prefix(obj, NULL, 0));
+        trie_delete(&obj);
+        wal_clean(dir);
+
+        obj = trie_recover(dir, NULL, NULL, NULL);
+        wal_fill(obj);
+        trie_delete(&obj);
+        start = now();
+        obj   = trie_recover(dir, NULL, NULL, NULL);
+        printf("wal: recover from the log: %.3f s, %zu keys\n",
+               now() - start, trie_count_prefix(obj, NULL, 0));
+        trie_delete(&obj);
+        wal_clean(dir);
+        rmdir(dir);
+}
+
+// +--------------------------------------------------------------------------+
+// | Integer keys                                                             |
+// +--------------------------------------------------------------------------+
+
+#define INT_KEYS 500000
+#define INT_ROUTES 500000
+
+static void bench_int(void)
+{
+        static uint32_t keys[INT_KEYS];
+        struct trie *obj     = trie_new(NULL, NULL);
+        struct trie_ip4 *ip4 = trie_ip4_new(NULL, NULL);
+        for (size_t i = 0; i < INT_KEYS; ++i) {
+                keys[i] = (uint32_t)rng();
+                void *old;
+                trie_insert(obj, (const uint8_t *)&keys[i], 4, (void *)i,
+                            &old);
+                trie_ip4_insert(ip4, keys[i], 32, (void *)i, &old);
+        }
+
+        trie_root_index(obj, 2);
+        double start = now();
+        size_t sum   = 0;
+        for (size_t i = 0; i < INT_KEYS; ++i) {
+                void *data = NULL;
+                trie_at(obj, (const uint8_t *)&keys[i], 4, &data);
+                sum += (size_t)data;
+        }
+        printf("int: trie_at of 4-byte keys (indexed): %.0f ns\n",
+               (now() - start) / INT_KEYS * 1e9);
+        start = now();
+        for (size_t i = 0; i < INT_KEYS; ++i) {
+                void *data = NULL;
+                trie_ip4_at(ip4, keys[i], 32, &data);
+                sum -= (size_t)data;
+        }
+        printf("int: trie_ip4_at: %.0f ns (%zu)\n",
+               (now() - start) / INT_KEYS * 1e9, sum);
+        trie_delete(&obj);
+        trie_ip4_delete(&ip4);
+
+        // routes mostly of /16../24 like a routing table
+        ip4 = trie_ip4_new(NULL, NULL);
+        for (size_t i = 0; i < INT_ROUTES; ++i) {
+                const unsigned int length = 16 + (unsigned int)(rng() % 9);
+                void *old;
+                trie_ip4_insert(ip4, (uint32_t)rng(), length, (void *)i,
+                                &old);
+        }
+        start          = now();
+        size_t matched = 0;
+        for (size_t i = 0; i < INT_KEYS; ++i) {
+                void *data;
+                matched += trie_ip4_lookup(ip4, (uint32_t)rng(), &data, NULL);
+        }
+        printf("int: trie_ip4_lookup of %zu routes: %.0f ns, %zu matched\n",
+               trie_ip4_size(ip4), (now() - start) / INT_KEYS * 1e9,
+               matched);
+        trie_ip4_delete(&ip4);
+}
+
+// +--------------------------------------------------------------------------+
+// | Set operations                                                           |
+// +--------------------------------------------------------------------------+
+
+#define SET_KEYS 500000
+#define SET_DELTA 100000
+
+static struct trie *set_fill(size_t keys, uint64_t seed)
+{
+        struct trie *obj = trie_new(NULL, NULL);
+        rng_state        = seed;
+        uint8_t word[32];
+        for (size_t i = 0; i < keys; ++i) {
+                const size_t size = random_word(word, 3, 8);
+                void *old;
+                trie_insert(obj, word, size, (void *)i, &old);
+        }
+        return obj;
+}
+
+static void bench_set(void)
+{
+        // the delta shares half of its keys with the main trie
+        struct trie *obj   = set_fill(SET_KEYS, 1);
+        struct trie *delta = set_fill(SET_DELTA, 1);
+        struct trie *other = set_fill(SET_DELTA, 2);
+        trie_merge(delta, other, NULL, NULL);
+        trie_delete(&other);
+
+        double start = now();
+        uint8_t key[32];
+        for (struct trie_node *i = trie_begin(delta); i; i = trie_next(i)) {
+                void *data, *old;
+                trie_data(i, &data);
+                trie_insert(obj, key, trie_key(i, key, sizeof(key)), data,
+                            &old);
+        }
+        printf("set: merge by trie_next + trie_insert: %.3f s\n",
+               now() - start);
+        trie_delete(&obj);
+
+        obj   = set_fill(SET_KEYS, 1);
+        start = now();
+        trie_merge(obj, delta, NULL, NULL);
+        printf("set: trie_merge: %.3f s, %zu keys\n", now() - start,
+               trie_count_prefix(obj, NULL, 0));
+
+        delta = set_fill(SET_DELTA, 2);
+        start = now();
+        size_t count = 0;
+        for (struct trie_node *i = trie_begin(delta); i; i = trie_next(i)) {
+                void *data;
+                count += trie_at(obj, key, trie_key(i, key, sizeof(key)),
+                                 &data);
+        }
+        printf("set: intersect by trie_next + trie_at: %.3f s, %zu keys\n",
+               now() - start, count);
+        start = now();
+        trie_intersect(delta, obj, NULL, NULL);
+        printf("set: trie_intersect: %.3f s, %zu keys\n", now() - start,
+               trie_count_prefix(delta, NULL, 0));
+        trie_delete(&delta);
+        trie_delete(&obj);
+}
+
+// +--------------------------------------------------------------------------+
+// | Burst trie                                                               |
+// +--------------------------------------------------------------------------+
+
+#define BURST_KEYS 500000
+
+static size_t burst_bytes;
+
+// Counts allocated bytes, the size is kept before a block.
+static void *burst_allocator(size_t size)
+{
+        size_t *block = malloc(sizeof(size_t) + size);
+        if (block == NULL)
+                return NULL;
+        burst_bytes += size;
+        *block = size;
+        return block + 1;
+}
+
+static void burst_deallocator(void *ptr)
+{
+        size_t *block = (size_t *)ptr - 1;
+        burst_bytes -= *block;
+        free(block);
+}
+
+// URL-like keys: a few hosts and paths of random words.
+static size_t burst_url(uint8_t *buf)
+{
+        static const char *hosts[] = {"http://www.example.com/",
+                                      "https://news.example.org/",
+                                      "https://shop.example.net/"};
+        size_t size = (size_t)sprintf((char *)buf, "%s", hosts[rng() % 3]);
+        size += random_word(&buf[size], 3, 8) - 1;
+        buf[size++] = '/';
+        size += random_word(&buf[size], 4, 12) - 1;
+        size += (size_t)sprintf((char *)&buf[size], "?id=%u",
+                                (unsigned int)(rng() % 100000));
+        return size + 1;
+}
+
+static void bench_burst(void)
+{
+        static uint8_t keys[BURST_KEYS][64];
+        static size_t sizes[BURST_KEYS];
+        for (size_t i = 0; i < BURST_KEYS; ++i)
+                sizes[i] = burst_url(keys[i]);
+
+        burst_bytes      = 0;
+        double start     = now();
+        struct trie *obj = trie_new(burst_allocator, burst_deallocator);
+        for (size_t i = 0; i < BURST_KEYS; ++i) {
+                void *old;
+                trie_insert(obj, keys[i], sizes[i], (void *)i, &old);
+        }
+        printf("burst: trie: insert %.3f s, %.1f MB\n", now() - start,
+               (double)burst_bytes / (1 << 20));
+        start = now();
+        for (size_t i = 0; i < BURST_KEYS; ++i) {
+                void *data;
+                trie_at(obj, keys[i], sizes[i], &data);
+        }
+        printf("burst: trie: lookup %.0f ns\n",
+               (now() - start) / BURST_KEYS * 1e9);
+        trie_delete(&obj);
+
+        const size_t limits[] = {16, 64, 256};
+        for (size_t n = 0; n < sizeof(limits) / sizeof(limits[0]); ++n) {
+                burst_bytes = 0;
+                start       = now();
+                struct trie_burst *burst = trie_burst_new(
+                    burst_allocator, burst_deallocator, limits[n]);
+                for (size_t i = 0; i < BURST_KEYS; ++i) {
+                        void *old;
+                        trie_burst_insert(burst, keys[i], sizes[i],
+                                          (void *)i, &old);
+                }
+                printf("burst: buckets of %zu: insert %.3f s, %.1f MB\n",
+                       limits[n], now() - start,
+                       (double)burst_bytes / (1 << 20));
+                start = now();
+                for (size_t i = 0; i < BURST_KEYS; ++i) {
+                        void *data;
+                        trie_burst_at(burst, keys[i], sizes[i], &data);
+                }
+                printf("burst: buckets of %zu: lookup %.0f ns\n", limits[n],
+                       (now() - start) / BURST_KEYS * 1e9);
+                trie_burst_delete(&burst);
+        }
+}
+
+// +--------------------------------------------------------------------------+
+// | Batch writes                                                             |
+// +--------------------------------------------------------------------------+
+
+#define BATCH_KEYS 500000
+#define BATCH_SIZE 10000
+#define BATCH_ROUNDS 100
+
+// Batches of URL keys, a third of changes removes keys.
+static void batch_fill(struct trie_write *writes, uint8_t (*keys)[64])
+{
+        for (size_t i = 0; i < BATCH_SIZE; ++i) {
+                writes[i].key      = keys[i];
+                writes[i].key_size = burst_url(keys[i]);
+                writes[i].remove   = rng() % 3 == 0;
+                writes[i].data     = (void *)i;
+        }
+}
+
+static void bench_batch(void)
+{
+        static uint8_t keys[BATCH_SIZE][64];
+        static struct trie_write writes[BATCH_SIZE];
+        uint8_t key[64];
+
+        for (size_t n = 0; n < 2; ++n) {
+                struct trie *obj = trie_new(NULL, NULL);
+                rng_state        = 1;
+                for (size_t i = 0; i < BATCH_KEYS; ++i) {
+                        void *old;
+                        trie_insert(obj, key, burst_url(key), (void *)i,
+                                    &old);
+                }
+                trie_root_index(obj, 2);
+
+                double elapsed = 0;
+                for (size_t round = 0; round < BATCH_ROUNDS; ++round) {
+                        batch_fill(writes, keys);
+                        const double start = now();
+                        if (n == 1) {
+                                trie_write_batch(obj, writes, BATCH_SIZE);
+                                elapsed += now() - start;
+                                continue;
+                        }
+                        for (size_t i = 0; i < BATCH_SIZE; ++i) {
+                                struct trie_write *write = &writes[i];
+                                if (write->remove)
+                                        trie_remove(obj, write->key,
+                                                    write->key_size,
+                                                    &write->data);
+                                else
+                                        trie_insert(obj, write->key,
+                                                    write->key_size,
+                                                    write->data,
+                                                    &write->data);
+                        }
+                        elapsed += now() - start;
+                }
+                printf("batch: %s: %.0f ns per change, %zu keys\n",
+                       n == 0 ? "trie_insert + trie_remove"
+                              : "trie_write_batch",
+                       elapsed / (BATCH_ROUNDS * BATCH_SIZE) * 1e9,
+                       trie_count_prefix(obj, NULL, 0));
+                trie_delete(&obj);
+        }
+}
+
+// +--------------------------------------------------------------------------+
+// | Bounded trie                                                             |
+// +--------------------------------------------------------------------------+
+
+#define CACHE_KEYS 1000000
+#define CACHE_OPS 5000000
+
+// A cache of path-like keys: a miss stores the key, ranks of keys are
+// Zipf-like, some keys are hot.
+static void bench_capacity(void)
+{
+        const size_t capacities[] = {0, CACHE_KEYS / 10, CACHE_KEYS / 100};
+        for (size_t n = 0; n < sizeof(capacities) / sizeof(capacities[0]);
+             ++n) {
+                struct trie *obj = trie_new(NULL, NULL);
+                trie_set_capacity(obj, capacities[n], 0, NULL, NULL);
+                rng_state    = 1;
+                size_t hits  = 0;
+                double start = now();
+                for (size_t i = 0; i < CACHE_OPS; ++i) {
+                        const size_t id = zipf(CACHE_KEYS) * 7919 % CACHE_KEYS;
+                        uint8_t key[32];
+                        size_t size = (size_t)sprintf((char *)key, "/%zu/%zu",
+                                                      id % 1000, id);
+                        ++size;
+                        void *data;
+                        if (trie_at(obj, key, size, &data))
+                                ++hits;
+                        else
+                                trie_insert(obj, key, size, (void *)id, &data);
+                }
+                printf("capacity: %zu keys: %.0f ns per op, %.1f%% hits, "
+                       "%zu keys\n",
+                       capacities[n], (now() - start) / CACHE_OPS * 1e9,
+                       100.0 * (double)hits / CACHE_OPS,
+                       trie_count_prefix(obj, NULL, 0));
+                trie_delete(&obj);
+        }
+}
+
+// +--------------------------------------------------------------------------+
+// | Shared memory trie                                                       |
+// +--------------------------------------------------------------------------+
+
+#define SHM_KEYS 500000
+#define SHM_REGION ((size_t)512 << 20)
+#define SHM_WORKERS 8
+
+static void bench_shm(void)
+{
+        static uint8_t keys[SHM_KEYS][64];
+        static size_t sizes[SHM_KEYS];
+        rng_state = 1;
+        for (size_t i = 0; i < SHM_KEYS; ++i)
+                sizes[i] = burst_url(keys[i]);
+
+        burst_bytes      = 0;
+        struct trie *obj = trie_new(burst_allocator, burst_deallocator);
+        for (size_t i = 0; i < SHM_KEYS; ++i) {
+                void *old;
+                trie_insert(obj, keys[i], sizes[i], (void *)i, &old);
+        }
+        double start = now();
+        for (size_t i = 0; i < SHM_KEYS; ++i) {
+                void *data;
+                trie_at(obj, keys[i], sizes[i], &data);
+        }
+        printf("shm: trie: lookup %.0f ns, %.1f MB per worker, %.1f MB for "
+               "%d workers\n",
+               (now() - start) / SHM_KEYS * 1e9,
+               (double)burst_bytes / (1 << 20),
+               (double)burst_bytes * SHM_WORKERS / (1 << 20), SHM_WORKERS);
+        trie_delete(&obj);
+
+        void *region = mmap(NULL, SHM_REGION, PROT_READ | PROT_WRITE,
+                            MAP_SHARED | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        if (region == MAP_FAILED)
+                return;
+        struct trie_shm *shm = trie_shm_create(region, SHM_REGION);
+        for (size_t i = 0; i < SHM_KEYS; ++i) {
+                uint64_t old;
+                trie_shm_insert(shm, keys[i], sizes[i], i, &old);
+        }
+        start = now();
+        for (size_t i = 0; i < SHM_KEYS; ++i) {
+                uint64_t value;
+                trie_shm_at(shm, keys[i], sizes[i], &value);
+        }
+        printf("shm: trie_shm: lookup %.0f ns, %.1f MB for all workers\n",
+               (now() - start) / SHM_KEYS * 1e9,
+               (double)trie_shm_used(shm) / (1 << 20));
+        trie_shm_detach(&shm);
+        munmap(region, SHM_REGION);
+}
+
+// +--------------------------------------------------------------------------+
+// | Lazy removal                                                             |
+// +--------------------------------------------------------------------------+
+
+#define LAZY_KEYS 500000
+
+static void bench_lazy(void)
+{
+        static uint8_t keys[LAZY_KEYS][64];
+        static size_t sizes[LAZY_KEYS];
+        rng_state = 1;
+        for (size_t i = 0; i < LAZY_KEYS; ++i)
+                sizes[i] = burst_url(keys[i]);
+
+        // eager, lazy with purges at the end and lazy with amortized purges
+        // (more steps keep fewer tombstones)
+        const char *names[]  = {"eager", "lazy", "lazy, 2 steps",
+                               "lazy, 8 steps"};
+        const size_t steps[] = {0, 0, 2, 8};
+        for (size_t n = 0; n < 4; ++n) {
+                struct trie *obj = trie_new(NULL, NULL);
+                trie_set_lazy(obj, n > 0, steps[n]);
+                for (size_t i = 0; i < LAZY_KEYS; ++i) {
+                        void *old;
+                        trie_insert(obj, keys[i], sizes[i], (void *)i, &old);
+                }
+                // three removes per insert
+                rng_state    = 2;
+                double start = now();
+                for (size_t i = 0; i < LAZY_KEYS; ++i) {
+                        const size_t id = rng() % LAZY_KEYS;
+                        void *old;
+                        if (i % 4 == 0)
+                                trie_insert(obj, keys[id], sizes[id],
+                                            (void *)id, &old);
+                        else
+                                trie_remove(obj, keys[id], sizes[id], &old);
+                }
+                const double ops = now() - start;
+                const size_t dead = trie_tombstones(obj);
+                start             = now();
+                trie_purge(obj, 0);
+                printf("lazy: %s: %.0f ns per op, %zu tombstones, purge "
+                       "%.1f ms\n",
+                       names[n], ops / LAZY_KEYS * 1e9, dead,
+                       (now() - start) * 1e3);
+                trie_delete(&obj);
+        }
+}
+
+// +--------------------------------------------------------------------------+
+// | Filter                                                                   |
+// +--------------------------------------------------------------------------+
+
+#define FILTER_KEYS 500000
+
+static void bench_filter(void)
+{
+        // half of keys are stored, others are misses
+        static uint8_t keys[2 * FILTER_KEYS][64];
+        static size_t sizes[2 * FILTER_KEYS];
+        rng_state = 1;
+        for (size_t i = 0; i < 2 * FILTER_KEYS; ++i)
+                sizes[i] = burst_url(keys[i]);
+
+        for (size_t n = 0; n < 2; ++n) {
+                burst_bytes      = 0;
+                struct trie *obj = trie_new(burst_allocator, burst_deallocator);
+                for (size_t i = 0; i < FILTER_KEYS; ++i) {
+                        void *old;
+                        trie_insert(obj, keys[i], sizes[i], (void *)i, &old);
+                }
+                const size_t nodes = burst_bytes;
+                if (n)
+                        trie_set_filter(obj, FILTER_KEYS);
+
+                size_t found = 0;
+                double start = now();
+                for (size_t i = FILTER_KEYS; i < 2 * FILTER_KEYS; ++i) {
+                        void *data;
+                        found += trie_at(obj, keys[i], sizes[i], &data);
+                }
+                const double miss = (now() - start) / FILTER_KEYS * 1e9;
+                start             = now();
+                for (size_t i = 0; i < FILTER_KEYS; ++i) {
+                        void *data;
+                        trie_at(obj, keys[i], sizes[i], &data);
+                }
+                printf("filter: %s: miss %.0f ns, hit %.0f ns, %zu misses "
+                       "found, %.1f MB of nodes + %.1f MB\n",
+                       n ? "filter" : "no filter", miss,
+                       (now() - start) / FILTER_KEYS * 1e9, found,
+                       (double)nodes / (1 << 20),
+                       (double)(burst_bytes - nodes) / (1 << 20));
+                trie_delete(&obj);
+        }
+}
+
+// +--------------------------------------------------------------------------+
+// | Main                                                                     |
+// +--------------------------------------------------------------------------+
+
+struct bench {
+        const char *name;
+        void (*run)(void);
+};
+
+static const struct bench benches[] = {
+    {"ac", bench_ac},
+    {"topk", bench_topk},
+    {"select", bench_select},
+    {"load", bench_load},
+    {"index", bench_index},
+    {"teardown", bench_teardown},
+    {"prefix", bench_prefix},
+    {"compact", bench_compact},
+    {"wal", bench_wal},
+    {"int", bench_int},
+    {"set", bench_set},
+    {"burst", bench_burst},
+    {"batch", bench_batch},
+    {"capacity", bench_capacity},
+    {"shm", bench_shm},
+    {"lazy", bench_lazy},
+    {"filter", bench_filter},
+    {NULL, NULL},
+};
+
+int main(int argc, char *argv[])
+{
+        for (const struct bench *i = benches; i->name; ++i) {
+                bool selected = argc < 2;
+                for (int arg = 1; arg < argc; ++arg) {
+                        if (strcmp(argv[arg], i->name) == 0)
+                                selected = true;
+                }
+                if (selected)
+                        i->run();
+        }
+        return 0;
+}
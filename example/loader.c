@@ -0,0 +1,73 @@
+/*
+ * loader.c
+ * Copyright (C) 2016 dershokus <lily.coder@gmail.com>
+ *
+ * Distributed under terms of the MIT license.
+ *
+ * Usage: loader [-d delimiter] [-t] [-n | -v] file [key...]
+ * Loads a file into a trie and looks keys up.
+ */
+
+#include <trie.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+int main(int argc, char *argv[])
+{
+    uint8_t delimiter  = '\n';
+    unsigned int flags = 0;
+    int opt;
+    while ((opt = getopt(argc, argv, "d:tnv")) != -1) {
+        switch (opt) {
+        case 'd': delimiter = (uint8_t)optarg[0]; break;
+        case 't': flags |= TRIE_LOAD_TERMINATED; break;
+        case 'n': flags |= TRIE_LOAD_LINE_NUMBERS; break;
+        case 'v': flags |= TRIE_LOAD_VALUES; break;
+        default:
+            fprintf(stderr,
+                    "Usage: %s [-d delimiter] [-t] [-n | -v] file [key...]\n",
+                    argv[0]);
+            return 1;
+        }
+    }
+    if (optind >= argc) {
+        fprintf(stderr, "%s: a file is expected\n", argv[0]);
+        return 1;
+    }
+
+    struct trie *trie = trie_new(NULL, NULL);
+    struct timespec begin, end;
+    clock_gettime(CLOCK_MONOTONIC, &begin);
+    size_t lines;
+    if (!trie_load_file(trie, argv[optind], delimiter, flags, &lines)) {
+        fprintf(stderr, "%s: failed to load '%s' at line %zu\n", argv[0],
+                argv[optind], lines + 1);
+        trie_delete(&trie);
+        return 1;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    printf("%zu keys loaded in %.3f s\n", trie_count_prefix(trie, NULL, 0),
+           (double)(end.tv_sec - begin.tv_sec) +
+               (double)(end.tv_nsec - begin.tv_nsec) / 1e9);
+
+    for (int i = optind + 1; i < argc; ++i) {
+        size_t size  = strlen(argv[i]);
+        uint8_t *key = malloc(size + 1);
+        memcpy(key, argv[i], size);
+        key[size] = delimiter;
+        if (flags & TRIE_LOAD_TERMINATED)
+            ++size;
+
+        void *value;
+        if (trie_at(trie, key, size, &value))
+            printf("%s: %zu\n", argv[i], (size_t)value);
+        else
+            printf("%s: not found\n", argv[i]);
+        free(key);
+    }
+
+    trie_delete(&trie);
+    return 0;
+}
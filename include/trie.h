@@ -32,30 +32,140 @@ typedef void *(*trie_allocator_t)(size_t);
  */
 typedef void (*trie_deallocator_t)(void *);
 
+/*
+ * Destructor of values (see trie_set_destructor).
+ */
+typedef void (*trie_destructor_t)(void *);
+
+/*
+ * Callback which takes removed values (see trie_remove_prefix).
+ */
+typedef void (*trie_value_callback_t)(void *ctx, void *data);
+
+/*
+ * Resolver of a key which both tries have (see trie_merge, trie_intersect).
+ * Takes the value of dst and the value of src, returns the value of dst.
+ */
+typedef void *(*trie_resolve_t)(void *ctx, void *data, void *other);
+
 /*
  * Create a new trie object.
  * Returns a trie object or null if the operation failed.
  * If an allocator is NULL - trie uses malloc.
  * If a deallocator is NULL - trie uses free.
+ * A new trie has the root index of depth 1 (see trie_root_index).
  */
 struct trie *trie_new(trie_allocator_t allocator,
                       trie_deallocator_t deallocator);
+
+/*
+ * Set the depth of the root index: tables which map the first byte (256
+ * entries) or the first two bytes (65536 more entries) of a key straight to
+ * its node, so lookups skip the widest sibling chains.
+ * Depth 0 disables the index. Iteration order doesn't depend on the index.
+ *
+ * Returns true if the operation completed successfully.
+ */
+bool trie_root_index(struct trie *trie, unsigned int depth);
+
 /*
  * Delete an object and all data which contained there.
  * Pointer to an object sets to NULL.
+ * Nodes are freed in one pass, values are given to the destructor.
  */
 void trie_delete(struct trie **trie);
 
+/*
+ * Remove all keys from a trie. Values are given to the destructor.
+ * Memory of nodes is kept and reused by following insertions, it is freed
+ * by trie_delete.
+ */
+void trie_clear(struct trie *trie);
+
+/*
+ * Set a destructor which is called for every value by trie_delete and
+ * trie_clear. Removed values are returned to the caller instead.
+ * NULL (the default) keeps values untouched.
+ */
+void trie_set_destructor(struct trie *trie, trie_destructor_t destructor);
+
+/*
+ * Lazy removal: trie_remove and trie_next_delete only mark a key as removed
+ * (a tombstone) and lower counts of its path, nodes aren't restructured.
+ * Tombstones are pruned by trie_purge, by the next steps keys after every
+ * trie_remove if steps isn't 0, and on the way of insertions, evictions,
+ * set operations and trie_compact. Tombstones stay when lazy removal is
+ * turned off.
+ * A step visits a key, live ones too: a few steps are cheaper than eager
+ * removal, more steps keep fewer tombstones.
+ */
+void trie_set_lazy(struct trie *trie, bool lazy, size_t steps);
+
+/*
+ * Prune tombstones of the next steps keys (0 - all keys). A purge goes on
+ * from the place where the previous one stopped, so bounded steps may be
+ * spread over operations or over time (a trie isn't thread-safe, the caller
+ * locks it).
+ *
+ * Returns the number of tombstones left.
+ */
+size_t trie_purge(struct trie *trie, size_t steps);
+
+/*
+ * Returns the number of tombstones of removed keys (see trie_set_lazy).
+ */
+size_t trie_tombstones(struct trie *trie);
+
+/*
+ * Keep a filter of keys (a counting Bloom filter) sized for the number of
+ * keys, 0 - no filter. trie_at and removals of trie_write_batch check it
+ * first: most keys which aren't in a trie are missed without nodes. Keys
+ * are counted by changes, so removals keep the filter accurate; a trie with
+ * more keys than the filter is sized for misses less often, set the filter
+ * again then. A filter takes 5 bytes for a key.
+ *
+ * A filter which can't be counted again (trie_clear, set operations) because
+ * memory allocation failed is turned off: it never hides a stored key.
+ *
+ * Returns false if memory allocation failed (the previous filter stays).
+ */
+bool trie_set_filter(struct trie *trie, size_t keys);
+
+/*
+ * Bound a trie by the number of keys and by bytes of its nodes (values
+ * aren't counted), 0 - no limit. Zero limits make a trie unbounded again.
+ * When an insertion gets over the budget cold keys are evicted (CLOCK): a hit
+ * of trie_at marks a key, the clock hand walks keys in the order of trie_next
+ * and evicts the first key without the mark clearing marks on the way.
+ * The key which is inserted isn't evicted. Evicted values are given to the
+ * callback or, if it's NULL, to the destructor.
+ * trie_write_batch and trie_merge evict keys when they are done.
+ */
+void trie_set_capacity(struct trie *trie, size_t keys, size_t bytes,
+                       trie_value_callback_t evict, void *ctx);
+
 /*
  * Insert new data into the trie.
  * Previous data (associated with the key) will be returned by old parameter and
  * will be replaced by data parameter.
+ * A key can't be a prefix of another key, terminate keys (e.g. by '\0') to
+ * store such ones.
  *
  * Returns true if the operation completed successfully.
  */
 bool trie_insert(struct trie *root, const uint8_t *key, const size_t key_size,
                  void *data, void **old);
 
+/*
+ * Insert new data with a score (see trie_topk).
+ * trie_insert keeps the score of a key, a new key has zero score.
+ *
+ * Returns true if the operation completed successfully.
+ */
+bool trie_insert_scored(struct trie *root, const uint8_t *key,
+                        const size_t key_size, void *data, uint32_t score,
+                        void **old);
+
 /*
  * Get a value associated with the key.
  * A value returns by data parameter.
@@ -67,7 +177,7 @@ bool trie_at(struct trie *root, const uint8_t *key, const size_t key_size,
              void **data);
 
 /*
- * Remove subtree for the key.
+ * Remove the key.
  * The old value returns by data parameter.
  *
  * Returns true if the operation completed successfully.
@@ -75,6 +185,52 @@ bool trie_at(struct trie *root, const uint8_t *key, const size_t key_size,
 bool trie_remove(struct trie *obj, const uint8_t *key, const size_t key_size,
                  void **data);
 
+/*
+ * Flags of trie_remove_prefix.
+ */
+enum trie_remove_flags {
+        // Nodes are freed (and values are given to the callback) by
+        // a detached thread, so the deallocator and the callback have to be
+        // thread-safe. If the thread can't be started they are freed at once.
+        TRIE_REMOVE_DEFERRED = 1 << 0,
+};
+
+/*
+ * Remove all keys which start with the prefix (an empty prefix removes all
+ * keys). The subtree is unlinked at once, then its nodes are freed in one
+ * pass. Every removed value is given to the callback, or to the destructor
+ * if the callback is NULL.
+ *
+ * Returns the number of removed keys.
+ */
+size_t trie_remove_prefix(struct trie *trie, const uint8_t *prefix,
+                          const size_t prefix_size,
+                          trie_value_callback_t callback, void *ctx,
+                          unsigned int flags);
+
+/*
+ * A change of trie_write_batch.
+ */
+struct trie_write {
+        const uint8_t *key;
+        size_t key_size;
+        void *data;  // a new value, then the previous or the removed one
+        bool remove; // the key is removed rather than inserted
+        bool done;   // the change is applied
+};
+
+/*
+ * Apply a batch of insertions and removals. Changes are sorted by keys
+ * (changes of the same key keep their order), so the path of a key is found
+ * from the common prefix with the previous one and nodes of shared prefixes
+ * update their counts once per batch. New keys are inserted in the order of
+ * keys. A change reports its result by done and data fields.
+ *
+ * Returns the number of applied changes.
+ */
+size_t trie_write_batch(struct trie *trie, struct trie_write *writes,
+                        size_t size);
+
 /*
  * Returns the first node with data from a trie.
  * If a trie is empty - returns NULL.
@@ -92,6 +248,59 @@ struct trie_node *trie_next(struct trie_node *node);
  */
 struct trie_node *trie_next_delete(struct trie *obj, struct trie_node *node);
 
+/*
+ * Flags of trie_compact.
+ */
+enum trie_compact_flags {
+        // Ask for transparent huge pages for the new region.
+        TRIE_COMPACT_HUGEPAGES = 1 << 0,
+};
+
+/*
+ * Move all nodes into one new region in the depth-first order where siblings
+ * are adjacent, so a lookup touches fewer cache lines and pages.
+ * Nodes which are removed later are reused by insertions, the region is
+ * freed by the next compaction or trie_delete. Nodes got before (trie_begin,
+ * trie_select...) are invalid after it.
+ *
+ * Returns true if the operation completed successfully.
+ */
+bool trie_compact(struct trie *trie, unsigned int flags);
+
+/*
+ * Move all keys of src into dst. Both tries are walked together once and
+ * subtrees which dst doesn't have are spliced without copying (nodes of
+ * a compacted src or of a trie with another deallocator are copied).
+ * A key of both tries gets the value returned by the resolver or, if it's
+ * NULL, the value of src (the value of dst is given to the destructor) and
+ * the higher score. Keys of src which are prefixes of keys of dst or vice
+ * versa can't be stored, they stay in src.
+ * Tries with a write-ahead log aren't supported.
+ *
+ * Returns true if the operation completed successfully. After a failure
+ * both tries are valid, some keys are moved.
+ */
+bool trie_merge(struct trie *dst, struct trie *src, trie_resolve_t resolve,
+                void *ctx);
+
+/*
+ * Keep only keys of dst which src has too. A key gets the value returned by
+ * the resolver if it isn't NULL. Removed values are given to the destructor,
+ * src isn't changed.
+ *
+ * Returns true if the operation completed successfully.
+ */
+bool trie_intersect(struct trie *dst, struct trie *src,
+                    trie_resolve_t resolve, void *ctx);
+
+/*
+ * Remove keys of dst which src has. Removed values are given to the
+ * destructor, src isn't changed.
+ *
+ * Returns true if the operation completed successfully.
+ */
+bool trie_subtract(struct trie *dst, struct trie *src);
+
 /*
  * Get data of a node.
  *
@@ -99,6 +308,132 @@ struct trie_node *trie_next_delete(struct trie *obj, struct trie_node *node);
  */
 bool trie_data(struct trie_node *node, void **data);
 
+/*
+ * Get a score of a node.
+ *
+ * Returns true if the operation completed successfully.
+ */
+bool trie_score(struct trie_node *node, uint32_t *score);
+
+/*
+ * Get a key of a node.
+ * The key is written only if the buffer is large enough.
+ *
+ * Returns the size of the key.
+ */
+size_t trie_key(struct trie_node *node, uint8_t *key, size_t size);
+
+/*
+ * Get the number of keys which start with the prefix.
+ * An empty prefix gives the size of a trie.
+ */
+size_t trie_count_prefix(struct trie *trie, const uint8_t *prefix,
+                         const size_t prefix_size);
+
+/*
+ * Get the position of a key in the order of trie_begin/trie_next.
+ * The order isn't lexicographic: siblings keep the order of insertion.
+ *
+ * Returns true if a trie contains the key.
+ */
+bool trie_rank(struct trie *trie, const uint8_t *key, const size_t key_size,
+               size_t *rank);
+
+/*
+ * Get a node by its position in the order of trie_begin/trie_next.
+ * Use it with trie_next for pagination.
+ *
+ * Returns NULL if the rank is out of range.
+ */
+struct trie_node *trie_select(struct trie *trie, size_t rank);
+
+/*
+ * Find up to k keys with the highest scores which start with the prefix.
+ * Nodes are written to out in the descending order of scores.
+ * Every node keeps the max score of its subtree, so the search visits only
+ * subtrees which can get into the result.
+ *
+ * Returns the number of found nodes.
+ */
+size_t trie_topk(struct trie *trie, const uint8_t *prefix,
+                 const size_t prefix_size, size_t k, struct trie_node **out);
+
 bool trie_export_dot(struct trie *obj, const char *file);
 
+/*
+ * Levels of heat counters, deeper levels are counted by the last one.
+ */
+#define TRIE_HEAT_LEVELS 16
+
+/*
+ * Heat of a level: visits of sampled lookups and sibling hops which they
+ * made on the level. hops / visits is the mean length of a chain search.
+ */
+struct trie_heat_level {
+        uint64_t visits;
+        uint64_t hops;
+};
+
+/*
+ * Count every sample-th lookup of a trie (of all operations): visits of
+ * nodes and sibling hops by levels and visits of every node, 0 - stop
+ * counting. Counters are reset. A thread counts lookups and levels in its
+ * own slot, slots are merged when they are read. Visits of a node are one
+ * atomic counter in the node (a slot can't follow nodes which removals
+ * move), so threads which sample the same nodes share their cache lines:
+ * a larger sample keeps that cost down.
+ * Heat is counted by the trie_heat library (built with TRIE_HEAT), the trie
+ * library has no counters and no cost.
+ *
+ * Returns false if memory allocation failed or heat isn't counted by the
+ * library.
+ */
+bool trie_set_heat(struct trie *trie, uint32_t sample);
+
+/*
+ * Get heat of up to size levels (see TRIE_HEAT_LEVELS).
+ *
+ * Returns the number of sampled lookups.
+ */
+uint64_t trie_heat(struct trie *trie, struct trie_heat_level *levels,
+                   size_t size);
+
+/*
+ * Export the hottest paths in the DOT format: the paths to the nodes where
+ * most sampled lookups stop. Nodes have their visits and are colored by
+ * heat, the graph label has visits and hops of levels.
+ *
+ * Returns false if heat isn't counted or the file can't be written.
+ */
+bool trie_export_heat(struct trie *obj, const char *file, size_t paths);
+
+/*
+ * Flags of trie_load_file.
+ */
+enum trie_load_flags {
+        // A key keeps the byte which follows it (the delimiter) as
+        // a terminator, so keys can be prefixes of each other.
+        TRIE_LOAD_TERMINATED = 1 << 0,
+        // A value is the number of a line (from zero).
+        TRIE_LOAD_LINE_NUMBERS = 1 << 1,
+        // A line is "key\tvalue" where value is a decimal number.
+        TRIE_LOAD_VALUES = 1 << 2,
+};
+
+/*
+ * Insert every line of a file (lines end with the delimiter).
+ * The file is mapped into memory and keys are inserted straight from it,
+ * so it has to be a regular file (a pipe or a device fails).
+ * Empty lines are skipped. Without value flags values are NULL.
+ * A load stops at the first line which fails (e.g. a bad value, a value
+ * which doesn't fit in a pointer, or a key which is a prefix of another one
+ * without TRIE_LOAD_TERMINATED), lines before it stay inserted. The number
+ * of lines which were loaded returns by lines parameter (if it isn't NULL),
+ * so on a failure it's the number of the failed line (from zero).
+ *
+ * Returns true if the operation completed successfully.
+ */
+bool trie_load_file(struct trie *trie, const char *path, uint8_t delimiter,
+                    unsigned int flags, size_t *lines);
+
 #endif /* !TRIE_H */
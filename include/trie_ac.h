@@ -0,0 +1,73 @@
+/*
+ * trie_ac.h
+ * Copyright (C) 2016 DerShokus <lily.coder@gmail.com>
+ *
+ * Distributed under terms of the MIT license.
+ */
+
+#ifndef TRIE_AC_H
+#define TRIE_AC_H
+
+#include "trie.h"
+
+/*
+ * Aho-Corasick automaton compiled from a trie. All fields are hidden.
+ */
+struct trie_ac;
+
+/*
+ * Streaming state of a scan over an automaton.
+ */
+struct trie_ac_scanner;
+
+/*
+ * Called for every match. The match ends at the stream offset end (exclusive)
+ * and is size bytes long, data is the value of the matched key.
+ *
+ * Return false to stop the scan.
+ */
+typedef bool (*trie_ac_callback_t)(void *ctx, uint64_t end, size_t size,
+                                   void *data);
+
+/*
+ * Compile an automaton from all keys of a trie.
+ * A trailing '\0' of a key isn't a part of the pattern, so keys inserted with
+ * their terminator (strlen + 1) match the plain text.
+ * The automaton is a snapshot: later changes of the trie aren't visible.
+ *
+ * Returns an automaton or NULL if the operation failed.
+ */
+struct trie_ac *trie_ac_new(struct trie *trie);
+
+/*
+ * Delete an automaton. Pointer to an object sets to NULL.
+ * Scanners must be deleted before.
+ */
+void trie_ac_delete(struct trie_ac **ac);
+
+/*
+ * Create a scanner positioned at the beginning of a stream.
+ * Returns a scanner or NULL if the operation failed.
+ */
+struct trie_ac_scanner *trie_ac_scanner_new(const struct trie_ac *ac);
+
+/*
+ * Delete a scanner. Pointer to an object sets to NULL.
+ */
+void trie_ac_scanner_delete(struct trie_ac_scanner **scanner);
+
+/*
+ * Start a new stream.
+ */
+void trie_ac_scanner_reset(struct trie_ac_scanner *scanner);
+
+/*
+ * Feed the next chunk of a stream. Matches which cross chunk boundaries are
+ * reported by the call which sees their last byte.
+ *
+ * Returns false if the callback stopped the scan.
+ */
+bool trie_ac_feed(struct trie_ac_scanner *scanner, const uint8_t *buf,
+                  size_t size, trie_ac_callback_t callback, void *ctx);
+
+#endif /* !TRIE_AC_H */
@@ -0,0 +1,90 @@
+/*
+ * trie_burst.h
+ * Copyright (C) 2016 DerShokus <lily.coder@gmail.com>
+ *
+ * Distributed under terms of the MIT license.
+ */
+
+#ifndef TRIE_BURST_H
+#define TRIE_BURST_H
+
+#include "trie.h"
+
+/*
+ * Burst trie. The first bytes of keys go through nodes, the rest of a key
+ * (its suffix) is stored in a leaf bucket: a contiguous array of suffixes and
+ * values sorted by suffixes. A bucket which grows past the limit bursts: its
+ * suffixes are distributed by their first bytes to buckets of a new node.
+ * So deep tails of unique keys take a few bytes of a bucket instead of
+ * a node per byte. Keys may be prefixes of each other. All fields are hidden.
+ */
+struct trie_burst;
+
+/*
+ * Called for every key of a walk (see trie_burst_walk). The key is valid
+ * until the callback returns.
+ *
+ * Return false to stop the walk.
+ */
+typedef bool (*trie_burst_callback_t)(void *ctx, const uint8_t *key,
+                                      size_t key_size, void *data);
+
+/*
+ * Create a new burst trie. A bucket bursts when it has more keys than the
+ * limit, if it's 0 - 64 keys.
+ * If an allocator is NULL - trie uses malloc.
+ * If a deallocator is NULL - trie uses free.
+ *
+ * Returns a trie object or NULL if the operation failed.
+ */
+struct trie_burst *trie_burst_new(trie_allocator_t allocator,
+                                  trie_deallocator_t deallocator,
+                                  size_t burst);
+
+/*
+ * Delete an object. Pointer to an object sets to NULL.
+ */
+void trie_burst_delete(struct trie_burst **obj);
+
+/*
+ * Insert new data. Previous data of the key returns by old parameter.
+ *
+ * Returns true if the operation completed successfully.
+ */
+bool trie_burst_insert(struct trie_burst *obj, const uint8_t *key,
+                       const size_t key_size, void *data, void **old);
+
+/*
+ * Get a value associated with the key.
+ * A value returns by data parameter.
+ *
+ * Returns true if a trie contains the key.
+ */
+bool trie_burst_at(const struct trie_burst *obj, const uint8_t *key,
+                   const size_t key_size, void **data);
+
+/*
+ * Remove the key.
+ * The old value returns by data parameter.
+ *
+ * Returns true if a trie contained the key.
+ */
+bool trie_burst_remove(struct trie_burst *obj, const uint8_t *key,
+                       const size_t key_size, void **data);
+
+/*
+ * Returns the number of keys in a trie.
+ */
+size_t trie_burst_size(const struct trie_burst *obj);
+
+/*
+ * Call the callback for every key which starts with the prefix (an empty
+ * prefix walks all keys) in the lexicographic order.
+ *
+ * Returns false if the callback stopped the walk or the operation failed.
+ */
+bool trie_burst_walk(const struct trie_burst *obj, const uint8_t *prefix,
+                     const size_t prefix_size,
+                     trie_burst_callback_t callback, void *ctx);
+
+#endif /* !TRIE_BURST_H */
@@ -0,0 +1,477 @@
+/*
+ * trie_int.h
+ * Copyright (C) 2016 DerShokus <lily.coder@gmail.com>
+ *
+ * Distributed under terms of the MIT license.
+ */
+
+/*
+ * Trie of fixed-width integer keys and prefixes of them (e.g. CIDR routes).
+ * The header is a template: define a name, a key type and a stride, then
+ * include it. It may be included many times with different parameters.
+ *
+ *     #define TRIE_INT_NAME trie_ip4
+ *     #define TRIE_INT_TYPE uint32_t
+ *     #define TRIE_INT_STRIDE 8
+ *     #include <trie_int.h>
+ *
+ * It gives struct trie_ip4 and trie_ip4_new, trie_ip4_delete,
+ * trie_ip4_insert, trie_ip4_remove, trie_ip4_at, trie_ip4_lookup and
+ * trie_ip4_size. The key type is an unsigned integer (unsigned __int128
+ * works too), the stride is 4, 8 or 16 bits and divides its width.
+ *
+ * Every level takes a stride of a key by a direct index into a node of
+ * 2^stride entries, so a lookup takes width / stride steps at most.
+ * A prefix which ends inside a stride is expanded to all entries it covers
+ * (controlled prefix expansion), entries keep the longest prefix.
+ */
+
+#include "trie.h"
+
+#include <stdlib.h>
+
+#ifndef TRIE_INT_H
+#define TRIE_INT_H
+
+#define TRIE_INT_CAT_(a, b) a##b
+#define TRIE_INT_CAT(a, b) TRIE_INT_CAT_(a, b)
+
+#endif /* !TRIE_INT_H */
+
+#if !defined(TRIE_INT_NAME) || !defined(TRIE_INT_TYPE) ||                     \
+    !defined(TRIE_INT_STRIDE)
+#error "define TRIE_INT_NAME, TRIE_INT_TYPE and TRIE_INT_STRIDE"
+#endif
+
+#define TRIE_INT_FN(suffix) TRIE_INT_CAT(TRIE_INT_NAME, suffix)
+#define TRIE_INT_NODE TRIE_INT_FN(_node)
+#define TRIE_INT_ENTRY TRIE_INT_FN(_entry)
+#define TRIE_INT_ROUTE TRIE_INT_FN(_route)
+#define TRIE_INT_BITS ((unsigned int)sizeof(TRIE_INT_TYPE) * 8)
+#define TRIE_INT_FANOUT (1u << TRIE_INT_STRIDE)
+#define TRIE_INT_DEPTH (TRIE_INT_BITS / TRIE_INT_STRIDE)
+
+_Static_assert(TRIE_INT_STRIDE == 4 || TRIE_INT_STRIDE == 8 ||
+                   TRIE_INT_STRIDE == 16,
+               "the stride is 4, 8 or 16 bits");
+_Static_assert(sizeof(TRIE_INT_TYPE) * 8 % TRIE_INT_STRIDE == 0,
+               "the stride divides the key width");
+
+struct TRIE_INT_NODE;
+
+struct TRIE_INT_ENTRY {
+        struct TRIE_INT_NODE *child;
+        void *data;
+        unsigned int length; // of the prefix which gives data plus one
+};
+
+// A prefix which covers a few entries of a node. Prefixes which cover one
+// entry are kept by the entry only.
+struct TRIE_INT_ROUTE {
+        unsigned int first, span, length;
+        void *data;
+};
+
+struct TRIE_INT_NODE {
+        struct TRIE_INT_ENTRY entries[TRIE_INT_FANOUT];
+        struct TRIE_INT_ROUTE *routes;
+        unsigned int routes_size, routes_capacity;
+        unsigned int prefixes; // which end in the node
+        unsigned int children;
+};
+
+/*
+ * Trie object. Fields are private.
+ */
+struct TRIE_INT_NAME {
+        struct TRIE_INT_NODE *root;
+        trie_allocator_t allocator;
+        trie_deallocator_t deallocator;
+        void *default_data; // of the zero-length prefix
+        bool has_default;
+        size_t size;
+};
+
+static inline unsigned int TRIE_INT_FN(_chunk)(TRIE_INT_TYPE key,
+                                               unsigned int level)
+{
+        return (unsigned int)(key >> (TRIE_INT_BITS -
+                                      (level + 1) * TRIE_INT_STRIDE)) &
+               (TRIE_INT_FANOUT - 1);
+}
+
+// Entries of a prefix in the node of its last stride.
+static inline unsigned int TRIE_INT_FN(_place)(TRIE_INT_TYPE key,
+                                               unsigned int length,
+                                               unsigned int *level,
+                                               unsigned int *span)
+{
+        *level               = (length - 1) / TRIE_INT_STRIDE;
+        const unsigned int r = length - *level * TRIE_INT_STRIDE;
+        *span                = 1u << (TRIE_INT_STRIDE - r);
+        return TRIE_INT_FN(_chunk)(key, *level) & ~(*span - 1);
+}
+
+static inline struct TRIE_INT_NODE *
+TRIE_INT_FN(_node_new)(struct TRIE_INT_NAME *obj)
+{
+        struct TRIE_INT_NODE *node = obj->allocator(sizeof(*node));
+        if (node)
+                memset(node, 0, sizeof(*node));
+        return node;
+}
+
+// Set the longest prefix of the node which covers the entry.
+static inline void TRIE_INT_FN(_rescan)(struct TRIE_INT_NODE *node,
+                                        unsigned int i)
+{
+        struct TRIE_INT_ENTRY *entry = &node->entries[i];
+        entry->data                  = NULL;
+        entry->length                = 0;
+        for (unsigned int j = 0; j < node->routes_size; ++j) {
+                const struct TRIE_INT_ROUTE *route = &node->routes[j];
+                if (i - route->first < route->span &&
+                    route->length + 1 > entry->length) {
+                        entry->data   = route->data;
+                        entry->length = route->length + 1;
+                }
+        }
+}
+
+static inline struct TRIE_INT_ROUTE *
+TRIE_INT_FN(_find_route)(const struct TRIE_INT_NODE *node, unsigned int first,
+                         unsigned int length)
+{
+        for (unsigned int j = 0; j < node->routes_size; ++j) {
+                if (node->routes[j].first == first &&
+                    node->routes[j].length == length)
+                        return &node->routes[j];
+        }
+        return NULL;
+}
+
+// Whether a prefix is in the node. A longer prefix may override some entries
+// of an expanded one, so those are looked for in the routes.
+static inline bool TRIE_INT_FN(_has)(const struct TRIE_INT_NODE *node,
+                                     unsigned int first, unsigned int span,
+                                     unsigned int length)
+{
+        if (span == 1)
+                return node->entries[first].length == length + 1;
+        return TRIE_INT_FN(_find_route)(node, first, length) != NULL;
+}
+
+// Free empty nodes of a path from the level up.
+static inline void TRIE_INT_FN(_prune)(struct TRIE_INT_NAME *obj,
+                                       struct TRIE_INT_NODE **path,
+                                       TRIE_INT_TYPE key, unsigned int level)
+{
+        for (;;) {
+                struct TRIE_INT_NODE *node = path[level];
+                if (node->prefixes || node->children)
+                        return;
+                if (node->routes)
+                        obj->deallocator(node->routes);
+                obj->deallocator(node);
+                if (level == 0) {
+                        obj->root = NULL;
+                        return;
+                }
+                --level;
+                path[level]->entries[TRIE_INT_FN(_chunk)(key, level)].child =
+                    NULL;
+                --path[level]->children;
+        }
+}
+
+static inline void TRIE_INT_FN(_node_delete)(struct TRIE_INT_NAME *obj,
+                                             struct TRIE_INT_NODE *node)
+{
+        // the depth is bounded by the key width
+        for (unsigned int i = 0; node->children && i < TRIE_INT_FANOUT; ++i) {
+                if (node->entries[i].child)
+                        TRIE_INT_FN(_node_delete)(obj, node->entries[i].child);
+        }
+        if (node->routes)
+                obj->deallocator(node->routes);
+        obj->deallocator(node);
+}
+
+/*
+ * Create a new trie object.
+ * If an allocator is NULL - trie uses malloc.
+ * If a deallocator is NULL - trie uses free.
+ *
+ * Returns a trie object or null if the operation failed.
+ */
+static inline struct TRIE_INT_NAME *
+TRIE_INT_FN(_new)(trie_allocator_t allocator, trie_deallocator_t deallocator)
+{
+        if (allocator == NULL)
+                allocator = malloc;
+        if (deallocator == NULL)
+                deallocator = free;
+        struct TRIE_INT_NAME *obj = allocator(sizeof(*obj));
+        if (obj) {
+                memset(obj, 0, sizeof(*obj));
+                obj->allocator   = allocator;
+                obj->deallocator = deallocator;
+        }
+        return obj;
+}
+
+/*
+ * Delete an object. Pointer to an object sets to NULL.
+ */
+static inline void TRIE_INT_FN(_delete)(struct TRIE_INT_NAME **obj)
+{
+        if (obj == NULL || *obj == NULL)
+                return;
+        if ((*obj)->root)
+                TRIE_INT_FN(_node_delete)(*obj, (*obj)->root);
+        (*obj)->deallocator(*obj);
+        *obj = NULL;
+}
+
+/*
+ * Insert a prefix: the first length bits of a key (the rest bits are
+ * ignored). A length of the key width gives an exact key, zero gives the
+ * default route. Previous data of the prefix returns by old parameter.
+ *
+ * Returns true if the operation completed successfully.
+ */
+static inline bool TRIE_INT_FN(_insert)(struct TRIE_INT_NAME *obj,
+                                        TRIE_INT_TYPE key, unsigned int length,
+                                        void *data, void **old)
+{
+        if (old)
+                *old = NULL;
+        if (obj == NULL || length > TRIE_INT_BITS)
+                return false;
+        if (length == 0) {
+                if (old && obj->has_default)
+                        *old = obj->default_data;
+                obj->size += !obj->has_default;
+                obj->default_data = data;
+                obj->has_default  = true;
+                return true;
+        }
+
+        unsigned int level, span;
+        const unsigned int first = TRIE_INT_FN(_place)(key, length, &level,
+                                                       &span);
+        if (obj->root == NULL)
+                obj->root = TRIE_INT_FN(_node_new)(obj);
+        if (obj->root == NULL)
+                return false;
+        struct TRIE_INT_NODE *path[TRIE_INT_DEPTH];
+        path[0] = obj->root;
+        for (unsigned int i = 0; i < level; ++i) {
+                struct TRIE_INT_ENTRY *entry =
+                    &path[i]->entries[TRIE_INT_FN(_chunk)(key, i)];
+                if (entry->child == NULL) {
+                        entry->child = TRIE_INT_FN(_node_new)(obj);
+                        if (entry->child == NULL) {
+                                TRIE_INT_FN(_prune)(obj, path, key, i);
+                                return false;
+                        }
+                        ++path[i]->children;
+                }
+                path[i + 1] = entry->child;
+        }
+
+        struct TRIE_INT_NODE *node   = path[level];
+        struct TRIE_INT_ENTRY *entry = &node->entries[first];
+
+        const bool exists = TRIE_INT_FN(_has)(node, first, span, length);
+        if (span == 1) {
+                // the longest prefix of the node, nothing overrides it
+                if (exists && old)
+                        *old = entry->data;
+                entry->data   = data;
+                entry->length = length + 1;
+        } else if (exists) {
+                struct TRIE_INT_ROUTE *route =
+                    TRIE_INT_FN(_find_route)(node, first, length);
+                if (old)
+                        *old = route->data;
+                route->data = data;
+                for (unsigned int i = first; i < first + span; ++i) {
+                        if (node->entries[i].length == length + 1)
+                                node->entries[i].data = data;
+                }
+        } else {
+                if (node->routes_size == node->routes_capacity) {
+                        const unsigned int capacity =
+                            node->routes_capacity ? 2 * node->routes_capacity
+                                                  : 4;
+                        struct TRIE_INT_ROUTE *routes =
+                            obj->allocator(capacity * sizeof(*routes));
+                        if (routes == NULL) {
+                                TRIE_INT_FN(_prune)(obj, path, key, level);
+                                return false;
+                        }
+                        if (node->routes) {
+                                memcpy(routes, node->routes,
+                                       node->routes_size * sizeof(*routes));
+                                obj->deallocator(node->routes);
+                        }
+                        node->routes          = routes;
+                        node->routes_capacity = capacity;
+                }
+                const struct TRIE_INT_ROUTE route = {first, span, length,
+                                                     data};
+                node->routes[node->routes_size++] = route;
+                for (unsigned int i = first; i < first + span; ++i) {
+                        if (node->entries[i].length < length + 1) {
+                                node->entries[i].data   = data;
+                                node->entries[i].length = length + 1;
+                        }
+                }
+        }
+        if (!exists) {
+                ++node->prefixes;
+                ++obj->size;
+        }
+        return true;
+}
+
+/*
+ * Remove a prefix (see _insert). Its data returns by data parameter.
+ *
+ * Returns true if a trie contains the prefix.
+ */
+static inline bool TRIE_INT_FN(_remove)(struct TRIE_INT_NAME *obj,
+                                        TRIE_INT_TYPE key, unsigned int length,
+                                        void **data)
+{
+        if (obj == NULL || length > TRIE_INT_BITS)
+                return false;
+        if (length == 0) {
+                if (!obj->has_default)
+                        return false;
+                if (data)
+                        *data = obj->default_data;
+                obj->has_default = false;
+                --obj->size;
+                return true;
+        }
+
+        unsigned int level, span;
+        const unsigned int first = TRIE_INT_FN(_place)(key, length, &level,
+                                                       &span);
+        struct TRIE_INT_NODE *path[TRIE_INT_DEPTH], *node = obj->root;
+        for (unsigned int i = 0; i < level && node; ++i) {
+                path[i] = node;
+                node    = node->entries[TRIE_INT_FN(_chunk)(key, i)].child;
+        }
+        if (node == NULL || !TRIE_INT_FN(_has)(node, first, span, length))
+                return false;
+        path[level] = node;
+
+        if (span == 1) {
+                if (data)
+                        *data = node->entries[first].data;
+                TRIE_INT_FN(_rescan)(node, first);
+        } else {
+                struct TRIE_INT_ROUTE *route =
+                    TRIE_INT_FN(_find_route)(node, first, length);
+                if (data)
+                        *data = route->data;
+                *route = node->routes[--node->routes_size];
+                for (unsigned int i = first; i < first + span; ++i) {
+                        if (node->entries[i].length == length + 1)
+                                TRIE_INT_FN(_rescan)(node, i);
+                }
+        }
+        --node->prefixes;
+        --obj->size;
+        TRIE_INT_FN(_prune)(obj, path, key, level);
+        return true;
+}
+
+/*
+ * Get data of a prefix (see _insert), it must be inserted with the same
+ * length.
+ *
+ * Returns true if a trie contains the prefix.
+ */
+static inline bool TRIE_INT_FN(_at)(const struct TRIE_INT_NAME *obj,
+                                    TRIE_INT_TYPE key, unsigned int length,
+                                    void **data)
+{
+        if (obj == NULL || length > TRIE_INT_BITS)
+                return false;
+        if (length == 0) {
+                if (obj->has_default && data)
+                        *data = obj->default_data;
+                return obj->has_default;
+        }
+
+        unsigned int level, span;
+        const unsigned int first = TRIE_INT_FN(_place)(key, length, &level,
+                                                       &span);
+        const struct TRIE_INT_NODE *node = obj->root;
+        for (unsigned int i = 0; i < level && node; ++i)
+                node = node->entries[TRIE_INT_FN(_chunk)(key, i)].child;
+        if (node == NULL || !TRIE_INT_FN(_has)(node, first, span, length))
+                return false;
+        if (data)
+                *data = span == 1 ? node->entries[first].data
+                                  : TRIE_INT_FN(_find_route)(node, first,
+                                                             length)->data;
+        return true;
+}
+
+/*
+ * Find the longest prefix of a trie which matches a key.
+ * Its data returns by data parameter, its length - by length (if not NULL).
+ *
+ * Returns true if some prefix matches.
+ */
+static inline bool TRIE_INT_FN(_lookup)(const struct TRIE_INT_NAME *obj,
+                                        TRIE_INT_TYPE key, void **data,
+                                        unsigned int *length)
+{
+        if (obj == NULL)
+                return false;
+        const struct TRIE_INT_NODE *node = obj->root;
+        void *best                       = obj->default_data;
+        unsigned int best_length         = obj->has_default;
+        for (unsigned int i = 0; i < TRIE_INT_DEPTH && node; ++i) {
+                const struct TRIE_INT_ENTRY *entry =
+                    &node->entries[TRIE_INT_FN(_chunk)(key, i)];
+                // deeper entries have longer prefixes
+                if (entry->length) {
+                        best        = entry->data;
+                        best_length = entry->length;
+                }
+                node = entry->child;
+        }
+        if (best_length == 0)
+                return false;
+        if (data)
+                *data = best;
+        if (length)
+                *length = best_length - 1;
+        return true;
+}
+
+/*
+ * Returns the number of prefixes in a trie.
+ */
+static inline size_t TRIE_INT_FN(_size)(const struct TRIE_INT_NAME *obj)
+{
+        return obj ? obj->size : 0;
+}
+
+#undef TRIE_INT_FN
+#undef TRIE_INT_NODE
+#undef TRIE_INT_ENTRY
+#undef TRIE_INT_ROUTE
+#undef TRIE_INT_BITS
+#undef TRIE_INT_FANOUT
+#undef TRIE_INT_DEPTH
+#undef TRIE_INT_NAME
+#undef TRIE_INT_TYPE
+#undef TRIE_INT_STRIDE
@@ -0,0 +1,92 @@
+/*
+ * trie_shm.h
+ * Copyright (C) 2016 DerShokus <lily.coder@gmail.com>
+ *
+ * Distributed under terms of the MIT license.
+ */
+
+#ifndef TRIE_SHM_H
+#define TRIE_SHM_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Trie in a shared memory region (e.g. a MAP_SHARED mapping of memfd_create
+ * or shm_open). All state lives in the region: nodes refer to each other by
+ * offsets, so processes may map the region at different addresses, and
+ * nodes are allocated from the region itself. Values are integers (e.g.
+ * offsets of records in a shared region), pointers mean nothing in other
+ * processes.
+ *
+ * Writers of all processes are serialized by a process-shared mutex, readers
+ * don't take it: they retry a lookup which overlapped a change (seqlock), so
+ * a reader never blocks a writer. A writer which dies holding the mutex
+ * blocks other writers. Keys can't be prefixes of each other (see
+ * trie_insert).
+ */
+struct trie_shm;
+
+/*
+ * Create a new trie in a region. The region must be aligned to 8 bytes,
+ * its contents are lost. The region isn't copied, it must live while the
+ * trie is used.
+ *
+ * Returns a handle of this process or NULL if the region is too small or
+ * the operation failed.
+ */
+struct trie_shm *trie_shm_create(void *region, size_t size);
+
+/*
+ * Attach to a trie which was created in a region by another process (or
+ * another mapping of the region).
+ *
+ * Returns a handle of this process or NULL if the region has no trie.
+ */
+struct trie_shm *trie_shm_attach(void *region, size_t size);
+
+/*
+ * Free a handle, the trie stays in the region. Pointer to a handle sets to
+ * NULL.
+ */
+void trie_shm_detach(struct trie_shm **obj);
+
+/*
+ * Insert a new value. Previous value of the key returns by old parameter.
+ *
+ * Returns true if the operation completed successfully, false if the region
+ * is full or the key and a stored key are prefixes of each other.
+ */
+bool trie_shm_insert(struct trie_shm *obj, const uint8_t *key,
+                     const size_t key_size, uint64_t value, uint64_t *old);
+
+/*
+ * Get a value associated with the key.
+ * A value returns by value parameter.
+ *
+ * Returns true if a trie contains the key.
+ */
+bool trie_shm_at(const struct trie_shm *obj, const uint8_t *key,
+                 const size_t key_size, uint64_t *value);
+
+/*
+ * Remove the key, its nodes go back to the region.
+ * The old value returns by value parameter.
+ *
+ * Returns true if a trie contained the key.
+ */
+bool trie_shm_remove(struct trie_shm *obj, const uint8_t *key,
+                     const size_t key_size, uint64_t *value);
+
+/*
+ * Returns the number of keys in a trie.
+ */
+size_t trie_shm_size(const struct trie_shm *obj);
+
+/*
+ * Returns bytes of the region which are in use.
+ */
+size_t trie_shm_used(const struct trie_shm *obj);
+
+#endif /* !TRIE_SHM_H */
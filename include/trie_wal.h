@@ -0,0 +1,74 @@
+/*
+ * trie_wal.h
+ * Copyright (C) 2016 DerShokus <lily.coder@gmail.com>
+ *
+ * Distributed under terms of the MIT license.
+ */
+
+#ifndef TRIE_WAL_H
+#define TRIE_WAL_H
+
+#include "trie.h"
+
+/*
+ * Durability of a trie: every change (trie_insert, trie_insert_scored,
+ * trie_remove, trie_next_delete, trie_remove_prefix, trie_clear) gets its
+ * record in a write-ahead log before it's applied: a change which can't be
+ * logged is refused. Inserts are logged once they are stored, a failed
+ * insert isn't logged. Checkpoints write a full image.
+ *
+ * A directory keeps the image ("checkpoint") and logs ("log.<sequence>").
+ * Values are stored as integers (their bits), so they survive a restart only
+ * if they are numbers rather than pointers.
+ */
+
+/*
+ * Group commit settings. Records are written and synced with one fsync when
+ * a group is full or the first record of a group is older than group_msec
+ * (checked by the next change, see trie_wal_sync).
+ * A crash loses at most the last group, so does a failed write (it's
+ * reported by trie_wal_sync).
+ */
+struct trie_wal_config {
+        size_t group_records;
+        unsigned int group_msec;
+};
+
+/*
+ * Open a durable trie: load the last checkpoint of a directory, replay logs
+ * which follow it and continue logging to the directory. A missing directory
+ * is created, so the first call gives an empty trie.
+ * A torn record at the end of a log (a crash while writing) ends the log.
+ * If a config is NULL - 128 records or 10 ms per group.
+ *
+ * Returns a trie object or NULL if the operation failed.
+ */
+struct trie *trie_recover(const char *dir, const struct trie_wal_config *config,
+                          trie_allocator_t allocator,
+                          trie_deallocator_t deallocator);
+
+/*
+ * Write and sync all logged changes.
+ * After a failure of the log a trie refuses changes.
+ *
+ * Returns true if the operation completed successfully.
+ */
+bool trie_wal_sync(struct trie *trie);
+
+/*
+ * Start a checkpoint: a forked process writes the image of the current state
+ * while the trie keeps changing, logs which the image covers are removed
+ * when it's done. A running checkpoint is waited for.
+ *
+ * Returns true if the operation started successfully.
+ */
+bool trie_checkpoint(struct trie *trie);
+
+/*
+ * Wait for a running checkpoint.
+ *
+ * Returns true if there is no checkpoint or it completed successfully.
+ */
+bool trie_checkpoint_wait(struct trie *trie);
+
+#endif /* !TRIE_WAL_H */
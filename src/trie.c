@@ -6,45 +6,55 @@
  */
 
 #include "trie.h"
+#include "trie_internal.h"
 
 #include <assert.h>
+#include <pthread.h>
+#include <sys/mman.h>
 #include <stdlib.h>
 #include <strings.h>
 #include <stdio.h>
 
-struct trie_node {
-        uint8_t symbol;
-
-        struct trie_node *negative; // negative or parent node
-        bool parent;
-
-        bool data_flag;
-        union {
-                struct trie_node *positive;
-                void *data;
-        };
-};
-
-struct trie {
-        struct trie_node *root;
-        trie_allocator_t allocator;
-        trie_deallocator_t deallocator;
-};
-
-static inline struct trie_node *trie_node_new(const struct trie *obj,
+static inline struct trie_node *trie_node_new(struct trie *obj,
                                               uint8_t symbol)
 {
         assert(obj != NULL);
         assert(obj->allocator != NULL);
 
-        struct trie_node *node = obj->allocator(sizeof(struct trie_node));
-        memset(node, 0, sizeof(*node));
+        struct trie_node *node = obj->free_nodes;
+        if (node) {
+                // reused nodes are cold, fetch the next one ahead
+                obj->free_nodes = node->negative;
+                __builtin_prefetch(obj->free_nodes, 1);
+        } else {
+                node = obj->allocator(sizeof(struct trie_node));
+        }
         if (node) {
+                memset(node, 0, sizeof(*node));
                 node->symbol = symbol;
+                ++obj->nodes;
         }
         return node;
 }
 
+static inline bool trie_arena_has(const struct trie_node *arena, size_t size,
+                                  const struct trie_node *node)
+{
+        return (uintptr_t)node - (uintptr_t)arena < size * sizeof(*node);
+}
+
+// Nodes of the arena can't be freed one by one, they are reused.
+static inline void trie_node_free(struct trie *obj, struct trie_node *node)
+{
+        --obj->nodes;
+        if (trie_arena_has(obj->arena, obj->arena_size, node)) {
+                node->negative  = obj->free_nodes;
+                obj->free_nodes = node;
+        } else {
+                obj->deallocator(node);
+        }
+}
+
 static inline void trie_node_set_parent(struct trie_node *node,
                                         struct trie_node *parent)
 {
@@ -54,12 +64,6 @@ static inline void trie_node_set_parent(struct trie_node *node,
         node->negative = parent;
 }
 
-static inline struct trie_node *trie_node_get_parent(struct trie_node *node)
-{
-        assert(node != NULL);
-        return node->parent ? node->negative : NULL;
-}
-
 static inline void trie_node_set_negative(struct trie_node *node,
                                           struct trie_node *negative)
 {
@@ -69,20 +73,6 @@ static inline void trie_node_set_negative(struct trie_node *node,
         node->negative = negative;
 }
 
-static inline struct trie_node *trie_node_get_negative(struct trie_node *node)
-{
-        assert(node != NULL);
-
-        return node->parent ? NULL : node->negative;
-}
-
-static inline struct trie_node *trie_node_get_positive(struct trie_node *node)
-{
-        assert(node != NULL);
-
-        return node->data_flag ? NULL : node->positive;
-}
-
 static inline void trie_node_set_positive(struct trie_node *node,
                                           struct trie_node *positive)
 {
@@ -130,17 +120,6 @@ static inline void trie_node_set_chain_parent(struct trie_node *node,
         trie_node_set_parent(node, parent);
 }
 
-static inline struct trie_node *
-trie_node_get_chain_parent(struct trie_node *node)
-{
-        assert(node != NULL);
-
-        while (trie_node_get_negative(node)) {
-                node = trie_node_get_negative(node);
-        }
-        return trie_node_get_parent(node);
-}
-
 struct find_res {
         const size_t sz;
         struct trie_node *last;
@@ -161,7 +140,7 @@ trie_find(struct trie_node *root, const uint8_t *key, const size_t key_size)
         for (i = 0; i <= (key_size - 1) && node;) {
                 prev = node;
                 if (node->symbol == key[i]) {
-                        node = node->positive;
+                        node = trie_node_get_positive(node);
                         ++i;
                 } else {
                         if (node->parent)
@@ -174,7 +153,63 @@ trie_find(struct trie_node *root, const uint8_t *key, const size_t key_size)
         return res;
 }
 
-static inline struct trie_node *trie_new_chain(const struct trie *obj,
+// Continue a search below a node which matches key[depth - 1].
+static inline struct find_res trie_find_below(struct trie_node *node,
+                                              const size_t depth,
+                                              const uint8_t *key,
+                                              const size_t key_size)
+{
+        struct trie_node *child = trie_node_get_positive(node);
+        if (depth == key_size || child == NULL) {
+                struct find_res res = {
+                    .sz = depth, .last = child, .prev = node};
+                return res;
+        }
+
+        struct find_res below =
+            trie_find(child, &key[depth], key_size - depth);
+        struct find_res res = {
+            .sz = depth + below.sz, .last = below.last, .prev = below.prev};
+        return res;
+}
+
+// Search with the root index. If the first symbol isn't in the trie, the
+// result is empty (prev is NULL): callers that attach new nodes to the root
+// chain must use trie_find.
+static inline struct find_res trie_lookup(const struct trie *obj,
+                                          const uint8_t *key,
+                                          const size_t key_size)
+{
+#ifdef TRIE_HEAT
+        if (obj->heat)
+                trie_heat_count(obj, key, key_size);
+#endif
+        if (obj->index == NULL || key == NULL || key_size == 0)
+                return trie_find(obj->root, key, key_size);
+
+        if (obj->index2 && key_size >= 2) {
+                struct trie_node *node = obj->index2[key[0] << 8 | key[1]];
+                if (node)
+                        return trie_find_below(node, 2, key, key_size);
+        }
+        struct trie_node *node = obj->index[key[0]];
+        if (node)
+                return trie_find_below(node, 1, key, key_size);
+
+        struct find_res res = {.sz = 0, .last = NULL, .prev = NULL};
+        return res;
+}
+
+static inline void trie_index_set(struct trie *obj, const uint8_t *key,
+                                  size_t depth, struct trie_node *node)
+{
+        if (depth == 1 && obj->index)
+                obj->index[key[0]] = node;
+        else if (depth == 2 && obj->index2)
+                obj->index2[key[0] << 8 | key[1]] = node;
+}
+
+static inline struct trie_node *trie_new_chain(struct trie *obj,
                                                const uint8_t *str,
                                                const size_t size,
                                                struct trie_node **last)
@@ -191,11 +226,11 @@ static inline struct trie_node *trie_new_chain(const struct trie *obj,
         bool need_free = false;
         for (size_t i = 1; i < size; ++i) {
                 node->positive = trie_node_new(obj, str[i]);
-                trie_node_set_parent(node->positive, node);
                 if (!node->positive) {
                         need_free = true;
                         break;
                 }
+                trie_node_set_parent(node->positive, node);
                 node = node->positive;
         }
 
@@ -203,8 +238,9 @@ static inline struct trie_node *trie_new_chain(const struct trie *obj,
                 while (res) {
                         struct trie_node *item = res;
                         res                    = res->positive;
-                        obj->deallocator(item);
+                        trie_node_free(obj, item);
                 }
+                return NULL;
         }
 
         if (last) {
@@ -214,31 +250,6 @@ static inline struct trie_node *trie_new_chain(const struct trie *obj,
         return res;
 }
 
-static inline struct trie_node *begin(struct trie_node *node)
-{
-        assert(node != NULL);
-
-        for (struct trie_node *positive = trie_node_get_positive(node);
-             positive; positive         = trie_node_get_positive(positive))
-                node = positive;
-        return node;
-}
-
-static inline struct trie_node *trie_node_delete_up(struct trie *obj,
-                                          struct trie_node *node)
-{
-        assert(obj != NULL);
-        assert(node != NULL);
-
-        struct trie_node *delete = NULL;
-        do {
-                delete = node;
-                node   = trie_node_get_parent(node);
-                obj->deallocator(delete);
-        } while (node && trie_node_get_negative(node) == NULL);
-        return node;
-}
-
 static inline struct trie_node *trie_node_delete_right(struct trie *obj,
                                              struct trie_node *node)
 {
@@ -249,8 +260,10 @@ static inline struct trie_node *trie_node_delete_right(struct trie *obj,
         struct trie_node *delete = trie_node_get_negative(node);
         if (delete == NULL)
                 return node;
+        if (obj->purge_node == delete)
+                obj->purge_node = node;
         memcpy(node, delete, sizeof(*node));
-        obj->deallocator(delete);
+        trie_node_free(obj, delete);
         delete = trie_node_get_positive(node);
         if (delete)
                 trie_node_set_chain_parent(delete, node);
@@ -268,7 +281,7 @@ static inline struct trie_node *trie_node_delete_end(struct trie *obj,
         if (!prev) {
                 // only one value in the trie?
                 if (node == obj->root) {
-                        obj->deallocator(obj->root);
+                        trie_node_free(obj, obj->root);
                         obj->root = NULL;
                         return NULL;
                 }
@@ -278,7 +291,7 @@ static inline struct trie_node *trie_node_delete_end(struct trie *obj,
                 // |
                 // x <- this node whill be deleted
                 if (trie_node_get_positive(prev) == node) {
-                        obj->deallocator(node);
+                        trie_node_free(obj, node);
                         trie_node_set_positive(prev, NULL);
                         return prev;
                 }
@@ -300,113 +313,447 @@ static inline struct trie_node *trie_node_delete_end(struct trie *obj,
                 prev = trie_node_get_negative(prev);
         }
         trie_node_set_parent(prev, trie_node_get_parent(node));
-        obj->deallocator(node);
+        trie_node_free(obj, node);
         return prev;
 }
 
-// +--------------------------------------------------------------------------+
-// | Public functions                                                         |
-// +--------------------------------------------------------------------------+
+// raise max scores of ancestors up to the score
+static inline void trie_node_raise(struct trie_node *node, uint32_t score)
+{
+        for (; node && node->score < score;
+             node = trie_node_get_chain_parent(node))
+                node->score = score;
+}
 
-struct trie *trie_new(trie_allocator_t allocator,
-                      trie_deallocator_t deallocator)
+// recalculate max scores from the node up to the root
+static inline void trie_node_rescore(struct trie_node *node)
 {
-        struct trie *trie;
-        // create a structure
-        if (allocator) {
-                trie = allocator(sizeof(struct trie));
-        } else {
-                trie = calloc(1, sizeof(struct trie));
+        while (node) {
+                uint32_t score = 0;
+                for (struct trie_node *i = trie_node_get_positive(node); i;
+                     i                   = trie_node_get_negative(i)) {
+                        if (i->score > score)
+                                score = i->score;
+                }
+                if (score == node->score)
+                        break;
+                node->score = score;
+                node        = trie_node_get_chain_parent(node);
         }
-        if (trie) {
-                trie->allocator   = allocator ? allocator : malloc;
-                trie->deallocator = deallocator ? deallocator : free;
+}
+
+static inline void trie_node_set_score(struct trie_node *node, uint32_t score)
+{
+        assert(node != NULL);
+        assert(node->data_flag);
+
+        const uint32_t prev = node->score;
+        node->score         = score;
+        if (score > prev)
+                trie_node_raise(trie_node_get_chain_parent(node), score);
+        else if (score < prev)
+                trie_node_rescore(trie_node_get_chain_parent(node));
+}
+
+static inline void trie_node_count(struct trie_node *node, int32_t diff)
+{
+        for (; node; node = trie_node_get_chain_parent(node))
+                node->count += (uint32_t)diff;
+}
+
+#define TRIE_FILTER_WORDS 8 // words of a block
+#define TRIE_FILTER_HASHES 4
+#define TRIE_FILTER_COUNTERS 10 // counters for a key
+
+static uint64_t trie_filter_hash(const uint8_t *key, size_t key_size)
+{
+        uint64_t hash = 0x9e3779b97f4a7c15ull ^ key_size;
+        size_t i      = 0;
+        for (; i + sizeof(uint64_t) <= key_size; i += sizeof(uint64_t)) {
+                uint64_t word;
+                memcpy(&word, &key[i], sizeof(word));
+                hash = (hash ^ word) * 0xff51afd7ed558ccdull;
+                hash ^= hash >> 29;
         }
+        for (; i < key_size; ++i)
+                hash = (hash ^ key[i]) * 0x100000001b3ull;
+        hash ^= hash >> 33;
+        hash *= 0xc4ceb9fe1a85ec53ull;
+        return hash ^ hash >> 33;
+}
 
-        return trie;
+// Counters of a key are in one block: the high half of the hash chooses the
+// block, 7-bit pieces of the low half choose counters.
+static inline uint64_t *trie_filter_block(const struct trie *obj,
+                                          uint64_t hash)
+{
+        return &obj->filter[(hash >> 32) % obj->filter_blocks *
+                            TRIE_FILTER_WORDS];
 }
 
-void trie_delete(struct trie **trie)
+// Returns false if the key isn't in a trie, true if it may be there.
+static bool trie_filter_has(const struct trie *obj, const uint8_t *key,
+                            size_t key_size)
 {
-        if (!trie || !(*trie))
+        const uint64_t hash   = trie_filter_hash(key, key_size);
+        const uint64_t *block = trie_filter_block(obj, hash);
+        for (unsigned int i = 0; i < TRIE_FILTER_HASHES; ++i) {
+                const unsigned int pos = (unsigned int)(hash >> 7 * i) & 127;
+                if ((block[pos >> 4] >> (pos & 15) * 4 & 15) == 0)
+                        return false;
+        }
+        return true;
+}
+
+// Count a new key (delta 1) or a removed one (-1). A full counter isn't
+// changed anymore, keys which are gone may look present by it.
+static void trie_filter_count(struct trie *obj, const uint8_t *key,
+                              size_t key_size, int delta)
+{
+        if (obj->filter == NULL)
                 return;
-        for (struct trie_node *node = trie_begin(*trie); node;
-             node                   = trie_next_delete(*trie, node)) {
+        const uint64_t hash = trie_filter_hash(key, key_size);
+        uint64_t *block     = trie_filter_block(obj, hash);
+        for (unsigned int i = 0; i < TRIE_FILTER_HASHES; ++i) {
+                const unsigned int pos   = (unsigned int)(hash >> 7 * i) & 127;
+                const unsigned int shift = (pos & 15) * 4;
+                const uint64_t counter   = block[pos >> 4] >> shift & 15;
+                if (counter == 15 || (delta < 0 && counter == 0))
+                        continue;
+                if (delta > 0)
+                        block[pos >> 4] += (uint64_t)1 << shift;
+                else
+                        block[pos >> 4] -= (uint64_t)1 << shift;
         }
-        // Seppuku!
-        (*trie)->deallocator(*trie);
-        *trie = NULL;
 }
 
-bool trie_insert(struct trie *root, const uint8_t *key, const size_t key_size,
-                 void *data, void **old)
+// Count the key of a node. A removed key which stays counted (memory
+// allocation failed) is just a false positive.
+// Returns false if memory allocation failed.
+static bool trie_filter_node(struct trie *obj, struct trie_node *node,
+                             int delta)
 {
-        if (old != NULL)
-                *old = NULL;
+        if (obj->filter == NULL)
+                return true;
+        uint8_t buf[256];
+        const size_t size = trie_key(node, NULL, 0);
+        uint8_t *key      = size <= sizeof(buf) ? buf : obj->allocator(size);
+        if (key == NULL)
+                return false;
+        trie_key(node, key, size);
+        trie_filter_count(obj, key, size, delta);
+        if (key != buf)
+                obj->deallocator(key);
+        return true;
+}
 
-        struct find_res found  = trie_find(root->root, key, key_size);
-        struct trie_node *last = NULL;
-        if (found.sz == 0) {
-                if (found.prev == NULL)
-                        root->root = trie_new_chain(root, key, key_size, &last);
-                else {
-                        struct trie_node *chain =
-                            trie_new_chain(root, key, key_size, &last);
-                        if (!trie_node_attach(found.prev, chain, false)) {
-                                trie_node_delete_up(root, chain);
-                                return false;
-                        }
+// Count all keys of a trie again. A key which isn't counted would be
+// missed, so the filter is turned off if memory allocation failed (its
+// memory stays until trie_set_filter or trie_delete).
+// Returns false if memory allocation failed.
+static bool trie_filter_build(struct trie *obj)
+{
+        if (obj->filter == NULL)
+                return true;
+        memset(obj->filter, 0,
+               obj->filter_blocks * TRIE_FILTER_WORDS * sizeof(uint64_t));
+        for (struct trie_node *i = trie_begin(obj); i; i = trie_next(i)) {
+                if (!trie_filter_node(obj, i, 1)) {
+                        obj->filter = NULL;
+                        return false;
                 }
+        }
+        return true;
+}
 
-        } else if (found.sz == key_size) {
-                last = found.prev;
-        } else {
-                struct trie_node *tail = trie_new_chain(
-                    root, &key[found.sz], key_size - found.sz, &last);
-                trie_node_attach(found.prev, tail,
-                                 key[found.sz] == found.prev->symbol);
+// Returns a node for data of the key, a new one is created if needed.
+// Returns NULL if the operation failed or if the key and a stored key are
+// prefixes of each other: both can't be stored.
+static struct trie_node *trie_leaf(struct trie *obj, const uint8_t *key,
+                                   const size_t key_size, bool *created)
+{
+        *created = false;
+        if (key == NULL || key_size == 0)
+                return NULL;
+
+        // a new symbol of the root chain is attached to its end
+        const bool scan       = obj->index == NULL || !obj->index[key[0]];
+        struct find_res found = scan ? trie_find(obj->root, key, key_size)
+                                     : trie_lookup(obj, key, key_size);
+        if (found.sz == key_size && found.prev->dead) {
+                // a tombstone is a new key
+                found.prev->dead = false;
+                --obj->dead;
+                trie_node_count(found.prev, 1);
+                *created = true;
+        }
+        if (found.sz == key_size)
+                return found.prev->data_flag ? found.prev : NULL;
+        if (found.sz != 0 && found.last == NULL)
+                return NULL;
+
+        struct trie_node *last  = NULL;
+        struct trie_node *chain = trie_new_chain(obj, &key[found.sz],
+                                                 key_size - found.sz, &last);
+        if (chain == NULL)
+                return NULL;
+        // every node of a new chain leads to the only key
+        for (struct trie_node *i = chain; i != last; i = i->positive)
+                i->count = 1;
+        last->count = 1;
+
+        if (found.prev == NULL)
+                obj->root = chain;
+        else
+                trie_node_attach(found.prev, chain, false);
+        trie_node_count(trie_node_get_chain_parent(chain), 1);
+
+        struct trie_node *node = chain;
+        for (size_t depth = found.sz + 1; depth <= 2 && node; ++depth) {
+                trie_index_set(obj, key, depth, node);
+                node = trie_node_get_positive(node);
         }
 
-        memcpy(&old, &last->data, sizeof(last->data));
+        *created = true;
+        return last;
+}
+
+static bool trie_store(struct trie *obj, const uint8_t *key,
+                       const size_t key_size, void *data, void **old,
+                       const uint32_t *score)
+{
+        if (old != NULL)
+                *old = NULL;
+        if (key == NULL || key_size == 0)
+                return false;
+
+        bool created;
+        struct trie_node *last = trie_leaf(obj, key, key_size, &created);
+        if (last == NULL)
+                return false;
+
+        if (created) {
+                ++obj->keys;
+                trie_filter_count(obj, key, key_size, 1);
+        }
+        if (!created && old != NULL)
+                memcpy(old, &last->data, sizeof(last->data));
         memcpy(&last->data, &data, sizeof(last->data));
         last->data_flag = true;
+        if (score)
+                trie_node_set_score(last, *score);
 
         return true;
 }
 
-bool trie_at(struct trie *root, const uint8_t *key, const size_t key_size,
-             void **data)
+// A bounded frontier of the top-k search sorted by (score, depth).
+struct topk_item {
+        struct trie_node *node;
+        uint32_t score;
+        size_t depth;
+};
+
+static inline bool topk_less(const struct topk_item *a,
+                             const struct topk_item *b)
 {
-        struct find_res found = trie_find(root->root, key, key_size);
-        if (found.sz == key_size && found.prev) {
-                memcpy(data, &found.prev->data, sizeof(*data));
+        return a->score < b->score ||
+               (a->score == b->score && a->depth < b->depth);
+}
+
+static void topk_push(struct topk_item *items, size_t *size, size_t capacity,
+                      const struct topk_item *item)
+{
+        if (*size >= capacity) {
+                // every item guarantees a key with its score, so the least
+                // one can't get into the result
+                if (!topk_less(&items[0], item))
+                        return;
+                memmove(&items[0], &items[1], (--*size) * sizeof(items[0]));
+        }
+
+        size_t lo = 0, hi = *size;
+        while (lo < hi) {
+                const size_t mid = (lo + hi) / 2;
+                if (topk_less(&items[mid], item))
+                        lo = mid + 1;
+                else
+                        hi = mid;
+        }
+        memmove(&items[lo + 1], &items[lo], (*size - lo) * sizeof(items[0]));
+        items[lo] = *item;
+        ++*size;
+}
+
+static bool trie_index_build(struct trie *obj, unsigned int depth)
+{
+        if (obj->index)
+                obj->deallocator(obj->index);
+        if (obj->index2)
+                obj->deallocator(obj->index2);
+        obj->index  = NULL;
+        obj->index2 = NULL;
+        if (depth == 0)
                 return true;
+
+        const size_t size = TRIE_INDEX_SIZE * sizeof(*obj->index);
+        obj->index        = obj->allocator(size);
+        if (obj->index == NULL)
+                return false;
+        memset(obj->index, 0, size);
+        if (depth > 1) {
+                const size_t size2 = TRIE_INDEX2_SIZE * sizeof(*obj->index2);
+                obj->index2        = obj->allocator(size2);
+                if (obj->index2 == NULL) {
+                        trie_index_build(obj, 0);
+                        return false;
+                }
+                memset(obj->index2, 0, size2);
         }
 
-        return false;
+        for (struct trie_node *i = obj->root; i;
+             i                   = trie_node_get_negative(i)) {
+                obj->index[i->symbol] = i;
+                if (obj->index2 == NULL)
+                        continue;
+                for (struct trie_node *j = trie_node_get_positive(i); j;
+                     j                   = trie_node_get_negative(j))
+                        obj->index2[i->symbol << 8 | j->symbol] = j;
+        }
+        return true;
 }
 
-bool trie_remove(struct trie *obj, const uint8_t *key, const size_t key_size,
-                 void **data)
+// Rebuild the index of the same depth after nodes are moved.
+static bool trie_index_rebuild(struct trie *obj)
 {
-        struct find_res found = trie_find(obj->root, key, key_size);
-        if (found.sz == key_size && found.prev) {
-                if (trie_data(found.prev, data)) {
-                        trie_next_delete(obj, found.prev);
-                        return true;
+        return trie_index_build(obj, obj->index2 ? 2 : obj->index ? 1 : 0);
+}
+
+// Pre-order step over all nodes, the depth follows the node.
+static struct trie_node *trie_node_walk(struct trie_node *node, size_t *depth)
+{
+        struct trie_node *next = trie_node_get_positive(node);
+        if (next) {
+                ++*depth;
+                return next;
+        }
+        while (node) {
+                next = trie_node_get_negative(node);
+                if (next)
+                        return next;
+                node = trie_node_get_parent(node);
+                --*depth;
+        }
+        return NULL;
+}
+
+// Copy a chain of siblings to the arena from the position.
+// Children stay at old places until their chains are copied.
+// Returns the position after the chain.
+static size_t trie_compact_chain(struct trie_node *arena, size_t pos,
+                                 struct trie_node *node,
+                                 struct trie_node *parent)
+{
+        for (; node; node = trie_node_get_negative(node), ++pos) {
+                arena[pos] = *node;
+                if (trie_node_get_negative(node))
+                        arena[pos].negative = &arena[pos + 1];
+                else
+                        arena[pos].negative = parent;
+        }
+        return pos;
+}
+
+// Nodes of a detached subtree and what to do with them.
+struct trie_release {
+        struct trie_node *root;
+        trie_deallocator_t deallocator;
+        struct trie_node **free_nodes; // kept nodes go there if not NULL
+        bool keep;                     // all nodes, not only the arena
+        const struct trie_node *arena;
+        size_t arena_size;
+        trie_destructor_t destructor;
+        trie_value_callback_t callback; // takes values before destructor
+        void *ctx;
+        size_t *dead; // tombstones of the trie if not NULL
+};
+
+// Free nodes in post-order (O(n) without a stack): a node is left when its
+// children are gone, the last sibling leads back to the parent. The last
+// sibling of the root chain must have no parent.
+// Returns the number of released nodes.
+static size_t trie_release(const struct trie_release *release)
+{
+        size_t count           = 0;
+        struct trie_node *node = release->root;
+        while (node) {
+                struct trie_node *child = trie_node_get_positive(node);
+                if (child) {
+                        trie_node_set_positive(node, NULL);
+                        node = child;
+                        continue;
                 }
+                // values of tombstones are returned by removals
+                const bool data = node->data_flag && !node->dead;
+                if (data && release->callback)
+                        release->callback(release->ctx, node->data);
+                else if (data && release->destructor)
+                        release->destructor(node->data);
+                if (node->dead && release->dead)
+                        --*release->dead;
+                struct trie_node *next = node->negative;
+                if (!release->keep &&
+                    !trie_arena_has(release->arena, release->arena_size,
+                                    node)) {
+                        release->deallocator(node);
+                } else if (release->free_nodes) {
+                        node->negative       = *release->free_nodes;
+                        *release->free_nodes = node;
+                }
+                node = next;
+                ++count;
         }
-        return false;
+        return count;
 }
 
-struct trie_node *trie_begin(struct trie *trie)
+static void *trie_release_thread(void *arg)
 {
-        if (trie == NULL || trie->root == NULL)
-                return NULL;
-        return begin(trie->root);
+        struct trie_release *release = arg;
+        trie_release(release);
+        release->deallocator(release);
+        return NULL;
 }
 
-struct trie_node *trie_next(struct trie_node *node)
+// Free all nodes, values are given to the destructor.
+// Nodes go to the free list if keep.
+static void trie_free_nodes(struct trie *obj, bool keep)
+{
+        const struct trie_release release = {
+            .root        = obj->root,
+            .deallocator = obj->deallocator,
+            .free_nodes  = &obj->free_nodes,
+            .keep        = keep,
+            .arena       = obj->arena,
+            .arena_size  = obj->arena_size,
+            .destructor  = obj->destructor,
+            .dead        = &obj->dead,
+        };
+        obj->nodes -= trie_release(&release);
+        obj->root       = NULL;
+        obj->keys       = 0;
+        obj->hand_size  = 0;
+        obj->purge_node = NULL;
+        obj->purge_size = 0;
+        trie_filter_build(obj);
+
+        if (obj->index)
+                memset(obj->index, 0, TRIE_INDEX_SIZE * sizeof(*obj->index));
+        if (obj->index2)
+                memset(obj->index2, 0,
+                       TRIE_INDEX2_SIZE * sizeof(*obj->index2));
+}
+
+// The next leaf in the order of trie_next, it may be a tombstone.
+static struct trie_node *trie_node_next(struct trie_node *node)
 {
         while (node) {
                 struct trie_node *negative = trie_node_get_negative(node);
@@ -421,39 +768,1432 @@ struct trie_node *trie_next(struct trie_node *node)
         return NULL;
 }
 
-bool trie_data(struct trie_node *node, void **data)
+// Remove a node without children (a key or a detached subtree) which holds
+// count keys. Returns the node with data which follows it, it may be
+// a tombstone (purges check every node).
+static struct trie_node *trie_unlink(struct trie *obj, struct trie_node *node,
+                                     uint32_t count)
 {
-        if (node == NULL || data == NULL || !node->data_flag)
-                return false;
-        memcpy(data, &node->data, sizeof(node->data));
-        return true;
-}
+        // counts go down along the whole path (tombstones aren't counted,
+        // a purge doesn't walk up to the root)
+        for (struct trie_node *i = node; i && count;
+             i                   = trie_node_get_chain_parent(i))
+                i->count -= count;
+        obj->keys -= count;
+        const bool cursor = obj->purge_node == node;
+        // max scores of ancestors go down only if there was a score
+        const bool rescore = node->score != 0;
 
-struct trie_node *trie_next_delete(struct trie *obj, struct trie_node *node)
-{
-        if (obj == NULL || node == NULL)
-                return NULL;
+        // o
+        // |
+        // o <- sole children go away with the node
+        // |
+        // x
+        int child = -1;
+        while (trie_node_get_negative(node) == NULL) {
+                struct trie_node *parent = trie_node_get_parent(node);
+                if (parent == NULL || trie_node_get_positive(parent) != node)
+                        break;
+                child = node->symbol;
+                trie_node_free(obj, node);
+                node = parent;
+        }
+
+        // is an indexed node going away? (a node of the first level takes
+        // the second one with it)
+        uint8_t prefix[2] = {node->symbol, (uint8_t)child};
+        size_t depth      = 0;
+        if (obj->index && obj->index[node->symbol] == node) {
+                depth = 1;
+        } else if (obj->index2) {
+                struct trie_node *parent = trie_node_get_chain_parent(node);
+                if (parent && trie_node_get_chain_parent(parent) == NULL) {
+                        depth     = 2;
+                        prefix[0] = parent->symbol;
+                        prefix[1] = node->symbol;
+                }
+        }
+        if (depth != 0) {
+                trie_index_set(obj, prefix, depth, NULL);
+                if (depth == 1 && child >= 0)
+                        trie_index_set(obj, prefix, 2, NULL);
+        }
 
+        struct trie_node *up, *next;
         if (trie_node_get_negative(node)) {
                 node = trie_node_delete_right(obj, node);
-        } else {
-                struct trie_node *parent = trie_node_get_parent(node);
-                if (parent && trie_node_get_positive(parent) == node) {
-                        node = trie_node_delete_up(obj, node);
-                        if (node) {
-                                node = trie_node_delete_right(obj, node);
-                        }
-                } else {
-                        node = trie_node_delete_end(obj, node);
+                up   = rescore ? trie_node_get_chain_parent(node) : NULL;
+                next = begin(node);
+                // the node has taken the place of its sibling
+                if (depth != 0) {
+                        prefix[depth - 1] = node->symbol;
+                        trie_index_set(obj, prefix, depth, node);
                 }
-        }
-        if (node) {
-                node = begin(node);
-                assert(node->data_flag);
         } else {
-                obj->root = NULL;
+                // the last node of a chain: the next key is after the parent
+                up = trie_node_get_parent(node);
+                trie_node_delete_end(obj, node);
+                next = up ? trie_node_next(up) : NULL;
         }
-        return node;
+        if (rescore)
+                trie_node_rescore(up);
+        // the purge cursor goes on from the next key
+        if (cursor)
+                obj->purge_node = next;
+
+        assert(next == NULL || next->data_flag);
+        return next;
+}
+
+// Count keys of a trie by its root chain.
+static size_t trie_keys_count(struct trie *obj)
+{
+        size_t count = 0;
+        for (struct trie_node *i = obj->root; i; i = trie_node_get_negative(i))
+                count += i->count;
+        return count;
+}
+
+// Count nodes of a trie.
+static size_t trie_nodes_count(struct trie *obj)
+{
+        size_t count = 0, depth = 1;
+        for (struct trie_node *i = obj->root; i; i = trie_node_walk(i, &depth))
+                ++count;
+        return count;
+}
+
+static bool trie_over(struct trie *obj)
+{
+        if (obj->max_keys && obj->keys > obj->max_keys)
+                return true;
+        return obj->max_bytes &&
+               obj->nodes * sizeof(struct trie_node) > obj->max_bytes;
+}
+
+// The node of a cursor: the key of a node is kept instead of the node, nodes
+// are moved by removals. If the key is gone, the cursor goes to a key near its
+// place. The node may be a tombstone.
+static struct trie_node *trie_cursor(struct trie *obj, const uint8_t *key,
+                                     size_t size)
+{
+        struct find_res found = trie_lookup(obj, key, size);
+        if (found.prev)
+                return begin(found.prev);
+        return obj->root ? begin(obj->root) : NULL;
+}
+
+// Keep the key of a node in a cursor, an empty one is the first key.
+static void trie_cursor_save(struct trie *obj, struct trie_node *node,
+                             uint8_t **key, size_t *size, size_t *capacity)
+{
+        *size                 = 0;
+        const size_t key_size = node ? trie_key(node, NULL, 0) : 0;
+        if (key_size > *capacity) {
+                uint8_t *buf = obj->allocator(2 * key_size);
+                if (buf == NULL)
+                        return;
+                if (*key)
+                        obj->deallocator(*key);
+                *key      = buf;
+                *capacity = 2 * key_size;
+        }
+        *size = trie_key(node, *key, *capacity);
+}
+
+// Evict keys of a bounded trie until it fits the budget (CLOCK): the hand
+// walks keys in the order of trie_next, a key with a hit gets a second
+// chance, others are evicted. The key (if any) isn't evicted, it's just
+// inserted.
+static void trie_evict(struct trie *obj, const uint8_t *key, size_t key_size)
+{
+        struct trie_node *keep = NULL;
+        if (key) {
+                struct find_res found = trie_lookup(obj, key, key_size);
+                keep = found.sz == key_size ? found.prev : NULL;
+        }
+
+        struct trie_node *node = trie_cursor(obj, obj->hand, obj->hand_size);
+        while (node && trie_over(obj) &&
+               obj->keys > (keep != NULL)) {
+                if (node->referenced || node == keep) {
+                        node->referenced = false;
+                        node             = trie_next(node);
+                        node             = node ? node : trie_begin(obj);
+                        continue;
+                }
+                if (node->dead) {
+                        // tombstones are pruned on the way
+                        --obj->dead;
+                        node = trie_unlink(obj, node, 0);
+                } else {
+                        if (obj->wal && !trie_wal_log_node(obj, node))
+                                break;
+                        trie_filter_node(obj, node, -1);
+                        void *data = node->data;
+                        node       = trie_unlink(obj, node, 1);
+                        if (obj->evict)
+                                obj->evict(obj->evict_ctx, data);
+                        else if (obj->destructor)
+                                obj->destructor(data);
+                }
+                node = node ? node : trie_begin(obj);
+                // the kept node may be moved to the place of its sibling
+                if (keep) {
+                        struct find_res found =
+                            trie_lookup(obj, key, key_size);
+                        keep = found.prev;
+                }
+        }
+        trie_cursor_save(obj, node, &obj->hand, &obj->hand_size,
+                         &obj->hand_capacity);
+}
+
+// Detach children of the node of the prefix, the node is left without
+// children. Returns the chain of children (it ends by NULL).
+static struct trie_node *trie_detach(struct trie *obj, struct trie_node *node,
+                                     const uint8_t *prefix, size_t prefix_size)
+{
+        struct trie_node *child = trie_node_get_positive(node);
+        if (child == NULL)
+                return NULL;
+        struct trie_node *last = child;
+        for (struct trie_node *i = child; i; i = trie_node_get_negative(i)) {
+                if (prefix_size == 1 && obj->index2)
+                        obj->index2[prefix[0] << 8 | i->symbol] = NULL;
+                last = i;
+        }
+        last->negative = NULL;
+        trie_node_set_positive(node, NULL);
+        return child;
+}
+
+// Mark a key as removed (lazy removal): counts of the path go down, nodes
+// stay until they are purged. Without the key counts go down by parents.
+static void trie_bury(struct trie *obj, struct trie_node *leaf,
+                      const uint8_t *key, size_t key_size)
+{
+        if (key) {
+                struct trie_node *node = obj->root;
+                if (obj->index && obj->index[key[0]])
+                        node = obj->index[key[0]];
+                for (size_t i = 0;; node = trie_node_get_positive(node)) {
+                        while (node->symbol != key[i])
+                                node = trie_node_get_negative(node);
+                        --node->count;
+                        if (++i == key_size)
+                                break;
+                }
+        } else {
+                trie_node_count(leaf, -1);
+        }
+        // max scores of subtrees must be exact for trie_topk
+        if (leaf->score)
+                trie_node_set_score(leaf, 0);
+        leaf->dead = true;
+        ++obj->dead;
+        --obj->keys;
+}
+
+// Prune tombstones which are met in up to steps keys from the purge cursor.
+static void trie_purge_steps(struct trie *obj, size_t steps)
+{
+        struct trie_node *node = obj->purge_node;
+        if (node == NULL && obj->dead)
+                node = trie_cursor(obj, obj->purge, obj->purge_size);
+        obj->purge_node = NULL;
+        obj->purge_size = 0;
+        if (obj->dead == 0)
+                return;
+        for (; node && steps; --steps) {
+                if (node->dead) {
+                        --obj->dead;
+                        node = trie_unlink(obj, node, 0);
+                } else {
+                        node = trie_node_next(node);
+                }
+        }
+        obj->purge_node = node;
+}
+
+// Prune all tombstones.
+static void trie_purge_all(struct trie *obj)
+{
+        obj->purge_node = NULL;
+        obj->purge_size = 0;
+        trie_purge_steps(obj, SIZE_MAX);
+}
+
+// Nodes are about to go away by a subtree: the purge cursor keeps the key
+// of its node instead.
+static void trie_purge_detach(struct trie *obj)
+{
+        if (obj->purge_node == NULL)
+                return;
+        trie_cursor_save(obj, obj->purge_node, &obj->purge, &obj->purge_size,
+                         &obj->purge_capacity);
+        obj->purge_node = NULL;
+}
+
+// Prune tombstones which conflict with a new key: a tombstone which is its
+// prefix or a subtree of tombstones below it.
+// Returns true if there were any.
+static bool trie_unbury(struct trie *obj, const uint8_t *key, size_t key_size)
+{
+        struct find_res found  = trie_lookup(obj, key, key_size);
+        struct trie_node *node = found.prev;
+        if (node == NULL || found.sz == 0)
+                return false;
+        if (found.sz < key_size && found.last == NULL && node->dead) {
+                --obj->dead;
+                trie_unlink(obj, node, 0);
+                return true;
+        }
+        if (found.sz != key_size || node->data_flag || node->count != 0)
+                return false;
+
+        trie_purge_detach(obj);
+        const struct trie_release release = {
+            .root        = trie_detach(obj, node, key, key_size),
+            .deallocator = obj->deallocator,
+            .free_nodes  = &obj->free_nodes,
+            .arena       = obj->arena,
+            .arena_size  = obj->arena_size,
+            .dead        = &obj->dead,
+        };
+        obj->nodes -= trie_release(&release);
+        trie_unlink(obj, node, 0);
+        return true;
+}
+
+static void trie_chain_append(struct trie_node **first,
+                              struct trie_node **last, struct trie_node *node)
+{
+        if (*last)
+                trie_node_set_negative(*last, node);
+        else
+                *first = node;
+        *last = node;
+}
+
+// The last node of a chain leads to the parent, the root chain ends by NULL.
+static void trie_chain_end(struct trie_node *last, struct trie_node *parent)
+{
+        if (last && parent)
+                trie_node_set_parent(last, parent);
+        else if (last)
+                trie_node_set_negative(last, NULL);
+}
+
+// Free a detached node with its subtree. Values are given to the destructor
+// if values.
+static void trie_drop(struct trie *obj, struct trie_node *node, bool values)
+{
+        trie_node_set_negative(node, NULL);
+        const struct trie_release release = {
+            .root        = node,
+            .deallocator = obj->deallocator,
+            .free_nodes  = &obj->free_nodes,
+            .arena       = obj->arena,
+            .arena_size  = obj->arena_size,
+            .destructor  = values ? obj->destructor : NULL,
+            .dead        = &obj->dead,
+        };
+        obj->nodes -= trie_release(&release);
+}
+
+// Copy a detached subtree of another trie, values are shared.
+// Returns the copy or NULL if the operation failed.
+static struct trie_node *trie_clone(struct trie *obj, struct trie_node *node)
+{
+        struct trie_node *root = NULL, *last = NULL;
+        size_t depth = 1, prev = 1;
+        for (struct trie_node *i = node; i; i = trie_node_walk(i, &depth)) {
+                struct trie_node *copy = trie_node_new(obj, i->symbol);
+                if (copy == NULL) {
+                        if (root)
+                                trie_drop(obj, root, false);
+                        return NULL;
+                }
+                copy->count = i->count;
+                copy->score = i->score;
+                if (i->data_flag) {
+                        copy->data_flag = true;
+                        copy->data      = i->data;
+                }
+
+                // the last copied node is the last one of its chain
+                if (root == NULL) {
+                        root = copy;
+                } else if (depth > prev) {
+                        last->positive = copy;
+                        trie_node_set_parent(copy, last);
+                } else {
+                        for (; prev > depth; --prev)
+                                last = trie_node_get_parent(last);
+                        trie_node_set_parent(copy, trie_node_get_parent(last));
+                        trie_node_set_negative(last, copy);
+                }
+                last = copy;
+                prev = depth;
+        }
+        return root;
+}
+
+// Set operations walk two tries together: a frame combines a chain of
+// siblings of dst with the chain of src which has the same prefix.
+enum trie_combine_op {
+        TRIE_COMBINE_MERGE,
+        TRIE_COMBINE_INTERSECT,
+        TRIE_COMBINE_SUBTRACT,
+};
+
+struct trie_combine_frame {
+        struct trie_node *dst, *src; // parents of the chains, NULL at the root
+        struct trie_node *next;      // the next node of the dst chain
+        struct trie_node *src_first;
+        struct trie_node *first, *last; // the new dst chain
+        uint32_t count, score;
+        // nodes of the src chain by symbols until they are matched, tables
+        // are left empty, so frames are reused without clearing
+        struct trie_node *table[256];
+};
+
+struct trie_combine {
+        struct trie *dst, *src;
+        enum trie_combine_op op;
+        trie_resolve_t resolve;
+        void *ctx;
+        bool move;   // nodes of src are spliced, not copied
+        bool failed; // nothing changes after a failure
+        struct trie_combine_frame *frames;
+        size_t top, capacity;
+};
+
+static bool trie_combine_push(struct trie_combine *c, struct trie_node *dst,
+                              struct trie_node *src)
+{
+        if (c->top == c->capacity) {
+                const size_t capacity = c->capacity ? 2 * c->capacity : 16;
+                const size_t size     = capacity * sizeof(*c->frames);
+                struct trie_combine_frame *frames = c->dst->allocator(size);
+                if (frames == NULL)
+                        return false;
+                memset(frames, 0, size);
+                if (c->frames) {
+                        memcpy(frames, c->frames, c->top * sizeof(*frames));
+                        c->dst->deallocator(c->frames);
+                }
+                c->frames   = frames;
+                c->capacity = capacity;
+        }
+
+        struct trie_combine_frame *frame = &c->frames[c->top++];
+        frame->dst       = dst;
+        frame->src       = src;
+        frame->next      = dst ? trie_node_get_positive(dst) : c->dst->root;
+        frame->src_first = src ? trie_node_get_positive(src) : c->src->root;
+        frame->first     = NULL;
+        frame->last      = NULL;
+        frame->count     = 0;
+        frame->score     = 0;
+        for (struct trie_node *i = frame->src_first; i;
+             i                   = trie_node_get_negative(i))
+                frame->table[i->symbol] = i;
+        return true;
+}
+
+static void trie_combine_keep(struct trie_combine_frame *frame,
+                              struct trie_node *node)
+{
+        trie_chain_append(&frame->first, &frame->last, node);
+        frame->count += node->count;
+        if (node->score > frame->score)
+                frame->score = node->score;
+}
+
+// Combine a node of dst with the node of src which has the same symbol (if
+// any) when one of them has no children. A node of src which is merged gets
+// zero count. Returns true if dst keeps the node.
+static bool trie_combine_leaf(struct trie_combine *c, struct trie_node *d,
+                              struct trie_node *s)
+{
+        // otherwise one key is a prefix of another, both can't be stored
+        const bool both = s && d->data_flag && s->data_flag;
+        if (c->failed)
+                return true;
+
+        switch (c->op) {
+        case TRIE_COMBINE_MERGE:
+                if (both) {
+                        void *data = s->data;
+                        if (c->resolve)
+                                data = c->resolve(c->ctx, d->data, s->data);
+                        else if (c->dst->destructor)
+                                c->dst->destructor(d->data);
+                        d->data = data;
+                        if (s->score > d->score)
+                                d->score = s->score;
+                        s->count = 0;
+                }
+                return true;
+        case TRIE_COMBINE_INTERSECT:
+                if (both && c->resolve)
+                        d->data = c->resolve(c->ctx, d->data, s->data);
+                return both;
+        case TRIE_COMBINE_SUBTRACT:
+                return !both;
+        }
+        return true;
+}
+
+// The dst chain of the top frame is walked: the rest of the src chain is
+// moved to dst (merge), new chains are linked to their parents.
+static void trie_combine_pop(struct trie_combine *c)
+{
+        struct trie_combine_frame *frame = &c->frames[c->top - 1];
+        const bool merge                 = c->op == TRIE_COMBINE_MERGE;
+
+        // what src keeps
+        struct trie_node *first = NULL, *last = NULL, *next;
+        uint32_t count = 0, score = 0;
+        for (struct trie_node *s = frame->src_first; s; s = next) {
+                next                     = trie_node_get_negative(s);
+                const bool matched       = frame->table[s->symbol] == NULL;
+                frame->table[s->symbol] = NULL;
+                if (!merge)
+                        continue;
+                if (!matched && !c->failed) {
+                        trie_node_set_negative(s, NULL);
+                        struct trie_node *node =
+                            c->move ? s : trie_clone(c->dst, s);
+                        if (node) {
+                                if (!c->move)
+                                        trie_drop(c->src, s, false);
+                                trie_combine_keep(frame, node);
+                                continue;
+                        }
+                        c->failed = true;
+                } else if (matched && s->count == 0) {
+                        trie_node_free(c->src, s);
+                        continue;
+                }
+                trie_chain_append(&first, &last, s);
+                count += s->count;
+                if (s->score > score)
+                        score = s->score;
+        }
+
+        struct trie_node *d = frame->dst, *s = frame->src;
+        trie_chain_end(frame->last, d);
+        if (d) {
+                trie_node_set_positive(d, frame->first);
+                d->count = frame->count;
+                d->score = frame->score;
+        } else {
+                c->dst->root = frame->first;
+        }
+        if (merge) {
+                trie_chain_end(last, s);
+                if (s) {
+                        trie_node_set_positive(s, first);
+                        s->count = count;
+                        s->score = score;
+                } else {
+                        c->src->root = first;
+                }
+        }
+
+        if (--c->top == 0)
+                return;
+        if (frame->first)
+                trie_combine_keep(&c->frames[c->top - 1], d);
+        else
+                trie_drop(c->dst, d, true);
+}
+
+static bool trie_combine(struct trie *dst, struct trie *src,
+                         enum trie_combine_op op, trie_resolve_t resolve,
+                         void *ctx)
+{
+        if (dst == NULL || src == NULL || dst == src || dst->wal ||
+            (op == TRIE_COMBINE_MERGE && src->wal))
+                return false;
+        // tries are walked by nodes, tombstones would look like keys
+        trie_purge_all(dst);
+        trie_purge_all(src);
+
+        // nodes of the arena can't be freed by dst
+        const bool move =
+            src->arena == NULL && src->deallocator == dst->deallocator;
+        struct trie_combine c = {
+            .dst     = dst,
+            .src     = src,
+            .op      = op,
+            .resolve = resolve,
+            .ctx     = ctx,
+            .move    = move,
+        };
+        if (!trie_combine_push(&c, NULL, NULL))
+                return false;
+        while (c.top) {
+                struct trie_combine_frame *frame = &c.frames[c.top - 1];
+                struct trie_node *d              = frame->next;
+                if (d == NULL) {
+                        trie_combine_pop(&c);
+                        continue;
+                }
+                frame->next = trie_node_get_negative(d);
+
+                struct trie_node *s     = frame->table[d->symbol];
+                frame->table[d->symbol] = NULL;
+                if (s && !d->data_flag && !s->data_flag && !c.failed) {
+                        // the node is kept or dropped when it's popped
+                        if (trie_combine_push(&c, d, s))
+                                continue;
+                        c.failed = true;
+                }
+                if (trie_combine_leaf(&c, d, s))
+                        trie_combine_keep(frame, d);
+                else
+                        trie_drop(dst, d, true);
+        }
+        dst->deallocator(c.frames);
+
+        bool res = trie_index_rebuild(dst) && !c.failed;
+        if (op == TRIE_COMBINE_MERGE)
+                res = trie_index_rebuild(src) && res;
+        // spliced subtrees aren't counted
+        if (op == TRIE_COMBINE_MERGE && move) {
+                dst->nodes = dst->bounded ? trie_nodes_count(dst) : dst->nodes;
+                src->nodes = src->bounded ? trie_nodes_count(src) : src->nodes;
+        }
+        // keys are counted again, it's cheaper than counting changes on
+        // the way
+        dst->keys = trie_keys_count(dst);
+        src->keys = trie_keys_count(src);
+        trie_filter_build(dst);
+        if (op == TRIE_COMBINE_MERGE)
+                trie_filter_build(src);
+        if (dst->bounded)
+                trie_evict(dst, NULL, 0);
+        return res;
+}
+
+// Sort order of a batch: keys, then positions (changes are in one array).
+static int trie_write_compare(const void *a, const void *b)
+{
+        const struct trie_write *x = *(const struct trie_write *const *)a;
+        const struct trie_write *y = *(const struct trie_write *const *)b;
+        const size_t size = x->key_size < y->key_size ? x->key_size
+                                                      : y->key_size;
+        const int res = memcmp(x->key, y->key, size);
+        if (res != 0)
+                return res;
+        if (x->key_size != y->key_size)
+                return x->key_size < y->key_size ? -1 : 1;
+        return (x > y) - (x < y);
+}
+
+// Match a key below path[depth - 1] and fill the path.
+// Returns the depth of the first symbol which isn't in a trie, last is the
+// last node of the chain which hasn't it.
+static size_t trie_batch_descend(struct trie *obj, struct trie_node **path,
+                                 size_t depth, const uint8_t *key,
+                                 size_t key_size, struct trie_node **last)
+{
+        *last = NULL;
+        while (depth < key_size) {
+                struct trie_node *node =
+                    depth ? trie_node_get_positive(path[depth - 1])
+                          : obj->root;
+                if (depth == 0 && obj->index && obj->index[key[0]])
+                        node = obj->index[key[0]];
+                for (*last = NULL; node && node->symbol != key[depth];
+                     node  = trie_node_get_negative(node))
+                        *last = node;
+                if (node == NULL)
+                        break;
+                path[depth++] = node;
+        }
+        return depth;
+}
+
+// Nodes which leave the path (from the depth up to the size) get keys which
+// were added below them, the keys go on to the parent.
+static void trie_batch_flush(struct trie_node **path, uint32_t *pending,
+                             size_t depth, size_t size)
+{
+        while (size-- > depth) {
+                if (pending[size] == 0)
+                        continue;
+                path[size]->count += pending[size];
+                if (size)
+                        pending[size - 1] += pending[size];
+                pending[size] = 0;
+        }
+}
+
+// Insert a key which is matched by the path up to the depth.
+static bool trie_batch_insert(struct trie *obj, struct trie_node **path,
+                              uint32_t *pending, size_t depth,
+                              struct trie_node *last, struct trie_write *write)
+{
+        const uint8_t *key    = write->key;
+        const size_t key_size = write->key_size;
+        // the key can't be a prefix of stored keys and vice versa
+        if (depth == key_size && !path[depth - 1]->data_flag)
+                return false;
+        if (depth < key_size && depth && path[depth - 1]->data_flag)
+                return false;
+        if (obj->wal && !trie_wal_reserve(obj, key_size))
+                return false;
+
+        if (depth == key_size) {
+                struct trie_node *node = path[depth - 1];
+                void *old              = node->data;
+                if (node->dead) {
+                        // a tombstone is a new key
+                        node->dead = false;
+                        --obj->dead;
+                        ++pending[depth - 1];
+                        old = NULL;
+                        ++obj->keys;
+                        trie_filter_count(obj, key, key_size, 1);
+                }
+                node->data             = write->data;
+                write->data            = old;
+                return true;
+        }
+
+        struct trie_node *end;
+        struct trie_node *chain =
+            trie_new_chain(obj, &key[depth], key_size - depth, &end);
+        if (chain == NULL)
+                return false;
+        if (last)
+                trie_node_attach(last, chain, false);
+        else if (depth)
+                trie_node_attach(path[depth - 1], chain, true);
+        else
+                obj->root = chain;
+        // ancestors get the key when they leave the path
+        if (depth)
+                ++pending[depth - 1];
+
+        for (struct trie_node *i = chain; i; i = trie_node_get_positive(i)) {
+                i->count = 1;
+                path[depth] = i;
+                if (depth < 2)
+                        trie_index_set(obj, key, depth + 1, i);
+                ++depth;
+        }
+        end->data_flag = true;
+        end->data      = write->data;
+        write->data    = NULL;
+        ++obj->keys;
+        trie_filter_count(obj, key, key_size, 1);
+        return true;
+}
+
+// Remove a key which is matched by the path.
+// Returns the number of path nodes which stay.
+static size_t trie_batch_remove(struct trie *obj, struct trie_node **path,
+                                uint32_t *pending, struct trie_write *write)
+{
+        const size_t key_size = write->key_size;
+        if (obj->wal && !trie_wal_log(obj, TRIE_WAL_REMOVE, write->key,
+                                      key_size, NULL, 0))
+                return key_size;
+
+        // counts go down along the path, nodes go away from the first one
+        // which is a sole child (see trie_unlink)
+        trie_batch_flush(path, pending, 0, key_size);
+        size_t depth = key_size - 1;
+        while (depth && trie_node_get_negative(path[depth]) == NULL &&
+               trie_node_get_positive(path[depth - 1]) == path[depth])
+                --depth;
+        write->data = path[key_size - 1]->data;
+        write->done = true;
+        trie_filter_count(obj, write->key, key_size, -1);
+        trie_unlink(obj, path[key_size - 1], 1);
+        return depth;
+}
+
+// Insert a key, tombstones which are in the way are pruned, a bounded trie
+// evicts keys.
+static bool trie_put(struct trie *obj, const uint8_t *key,
+                     const size_t key_size, void *data, void **old,
+                     const uint32_t *score)
+{
+        // the record is reserved first: a stored key is always logged
+        if (obj->wal && !trie_wal_reserve(obj, key_size))
+                return false;
+        bool res = trie_store(obj, key, key_size, data, old, score);
+        if (!res && obj->dead && trie_unbury(obj, key, key_size))
+                res = trie_store(obj, key, key_size, data, old, score);
+        // only a stored key is logged, the log goes before evicted keys
+        if (res && obj->wal)
+                trie_wal_record(obj,
+                                score ? TRIE_WAL_INSERT_SCORED
+                                      : TRIE_WAL_INSERT,
+                                key, key_size, data, score ? *score : 0);
+        if (res && obj->bounded)
+                trie_evict(obj, key, key_size);
+        return res;
+}
+
+// +--------------------------------------------------------------------------+
+// | Public functions                                                         |
+// +--------------------------------------------------------------------------+
+
+struct trie *trie_new(trie_allocator_t allocator,
+                      trie_deallocator_t deallocator)
+{
+        struct trie *trie;
+        // create a structure
+        if (allocator) {
+                trie = allocator(sizeof(struct trie));
+        } else {
+                trie = calloc(1, sizeof(struct trie));
+        }
+        if (trie) {
+                memset(trie, 0, sizeof(*trie));
+                trie->allocator   = allocator ? allocator : malloc;
+                trie->deallocator = deallocator ? deallocator : free;
+                // the index is an optimization, the trie works without it
+                trie_index_build(trie, 1);
+        }
+
+        return trie;
+}
+
+void trie_delete(struct trie **trie)
+{
+        if (!trie || !(*trie))
+                return;
+        trie_wal_close(*trie);
+        trie_free_nodes(*trie, false);
+        while ((*trie)->free_nodes) {
+                struct trie_node *node = (*trie)->free_nodes;
+                (*trie)->free_nodes    = node->negative;
+                if (!trie_arena_has((*trie)->arena, (*trie)->arena_size, node))
+                        (*trie)->deallocator(node);
+        }
+        if ((*trie)->arena)
+                munmap((*trie)->arena, (*trie)->arena_bytes);
+        if ((*trie)->hand)
+                (*trie)->deallocator((*trie)->hand);
+        if ((*trie)->purge)
+                (*trie)->deallocator((*trie)->purge);
+        if ((*trie)->filter_memory)
+                (*trie)->deallocator((*trie)->filter_memory);
+#ifdef TRIE_HEAT
+        trie_set_heat(*trie, 0);
+#endif
+        trie_index_build(*trie, 0);
+        // Seppuku!
+        (*trie)->deallocator(*trie);
+        *trie = NULL;
+}
+
+void trie_clear(struct trie *trie)
+{
+        if (trie == NULL)
+                return;
+        if (trie->wal && !trie_wal_log(trie, TRIE_WAL_CLEAR, NULL, 0, NULL, 0))
+                return;
+        trie_free_nodes(trie, true);
+}
+
+void trie_set_destructor(struct trie *trie, trie_destructor_t destructor)
+{
+        if (trie)
+                trie->destructor = destructor;
+}
+
+void trie_set_lazy(struct trie *trie, bool lazy, size_t steps)
+{
+        if (trie == NULL)
+                return;
+        trie->lazy       = lazy;
+        trie->lazy_steps = steps;
+}
+
+size_t trie_purge(struct trie *trie, size_t steps)
+{
+        if (trie == NULL)
+                return 0;
+        if (steps == 0)
+                trie_purge_all(trie);
+        else
+                trie_purge_steps(trie, steps);
+        return trie->dead;
+}
+
+size_t trie_tombstones(struct trie *trie)
+{
+        return trie ? trie->dead : 0;
+}
+
+bool trie_set_filter(struct trie *trie, size_t keys)
+{
+        if (trie == NULL)
+                return false;
+        void *memory = NULL;
+        size_t blocks = 0;
+        if (keys) {
+                // blocks are aligned to cache lines
+                const size_t block = TRIE_FILTER_WORDS * sizeof(uint64_t);
+                blocks = (keys * TRIE_FILTER_COUNTERS + 127) / 128;
+                memory = trie->allocator(blocks * block + block - 1);
+                if (memory == NULL)
+                        return false;
+        }
+        void *old_memory        = trie->filter_memory;
+        uint64_t *old_filter    = trie->filter;
+        const size_t old_blocks = trie->filter_blocks;
+        trie->filter_memory     = memory;
+        trie->filter_blocks     = blocks;
+        trie->filter            = NULL;
+        if (memory) {
+                const uintptr_t mask = TRIE_FILTER_WORDS * sizeof(uint64_t) - 1;
+                trie->filter =
+                    (uint64_t *)(((uintptr_t)memory + mask) & ~mask);
+                if (!trie_filter_build(trie)) {
+                        trie->deallocator(memory);
+                        trie->filter_memory = old_memory;
+                        trie->filter        = old_filter;
+                        trie->filter_blocks = old_blocks;
+                        return false;
+                }
+        }
+        if (old_memory)
+                trie->deallocator(old_memory);
+        return true;
+}
+
+void trie_set_capacity(struct trie *trie, size_t keys, size_t bytes,
+                       trie_value_callback_t evict, void *ctx)
+{
+        if (trie == NULL)
+                return;
+        // nodes aren't counted exactly by unbounded tries
+        if (!trie->bounded)
+                trie->nodes = trie_nodes_count(trie);
+        trie->bounded   = keys != 0 || bytes != 0;
+        trie->max_keys  = keys;
+        trie->max_bytes = bytes;
+        trie->evict     = evict;
+        trie->evict_ctx = ctx;
+        if (trie->bounded)
+                trie_evict(trie, NULL, 0);
+}
+
+bool trie_insert(struct trie *root, const uint8_t *key, const size_t key_size,
+                 void *data, void **old)
+{
+        return trie_put(root, key, key_size, data, old, NULL);
+}
+
+bool trie_insert_scored(struct trie *root, const uint8_t *key,
+                        const size_t key_size, void *data, uint32_t score,
+                        void **old)
+{
+        return trie_put(root, key, key_size, data, old, &score);
+}
+
+bool trie_at(struct trie *root, const uint8_t *key, const size_t key_size,
+             void **data)
+{
+        // most misses don't touch nodes
+        if (root->filter && !trie_filter_has(root, key, key_size))
+                return false;
+        struct find_res found = trie_lookup(root, key, key_size);
+        if (found.sz == key_size && found.prev && found.prev->data_flag &&
+            !found.prev->dead) {
+                // a hit for the clock hand of a bounded trie
+                if (root->bounded && !found.prev->referenced)
+                        found.prev->referenced = true;
+                memcpy(data, &found.prev->data, sizeof(*data));
+                return true;
+        }
+
+        return false;
+}
+
+bool trie_remove(struct trie *obj, const uint8_t *key, const size_t key_size,
+                 void **data)
+{
+        struct find_res found = trie_lookup(obj, key, key_size);
+        if (found.sz == key_size && found.prev) {
+                if (trie_data(found.prev, data)) {
+                        if (obj->wal && !trie_wal_log(obj, TRIE_WAL_REMOVE, key,
+                                                      key_size, NULL, 0))
+                                return false;
+                        trie_filter_count(obj, key, key_size, -1);
+                        if (!obj->lazy) {
+                                trie_unlink(obj, found.prev, 1);
+                                return true;
+                        }
+                        trie_bury(obj, found.prev, key, key_size);
+                        if (obj->lazy_steps)
+                                trie_purge_steps(obj, obj->lazy_steps);
+                        return true;
+                }
+        }
+        return false;
+}
+
+size_t trie_write_batch(struct trie *trie, struct trie_write *writes,
+                        size_t size)
+{
+        if (trie == NULL || writes == NULL)
+                return 0;
+
+        size_t count = 0, max_size = 0;
+        for (size_t i = 0; i < size; ++i) {
+                writes[i].done = false;
+                if (writes[i].key == NULL || writes[i].key_size == 0)
+                        continue;
+                ++count;
+                if (writes[i].key_size > max_size)
+                        max_size = writes[i].key_size;
+        }
+        if (count == 0)
+                return 0;
+
+        // sorted changes, the path of the last key and keys which are added
+        // below its nodes but aren't counted yet
+        struct trie_write **sorted = trie->allocator(
+            count * sizeof(*sorted) +
+            max_size * (sizeof(struct trie_node *) + sizeof(uint32_t)));
+        if (sorted == NULL)
+                return 0;
+        struct trie_node **path = (struct trie_node **)&sorted[count];
+        uint32_t *pending       = (uint32_t *)&path[max_size];
+        memset(pending, 0, max_size * sizeof(*pending));
+        for (size_t i = 0, j = 0; i < size; ++i) {
+                if (writes[i].key && writes[i].key_size)
+                        sorted[j++] = &writes[i];
+        }
+        qsort(sorted, count, sizeof(*sorted), trie_write_compare);
+
+        // the path is of the last key which was looked up
+        const uint8_t *prev = NULL;
+        size_t done = 0, valid = 0; // nodes of the path
+        for (size_t i = 0; i < count; ++i) {
+                struct trie_write *write = sorted[i];
+                if (write->remove && trie->filter &&
+                    !trie_filter_has(trie, write->key, write->key_size))
+                        continue;
+                size_t depth = 0;
+                if (prev) {
+                        while (depth < valid && depth < write->key_size &&
+                               prev[depth] == write->key[depth])
+                                ++depth;
+                }
+                prev = write->key;
+                trie_batch_flush(path, pending, depth, valid);
+
+                struct trie_node *last;
+                valid = trie_batch_descend(trie, path, depth, write->key,
+                                           write->key_size, &last);
+                if (!write->remove) {
+                        void *data  = write->data;
+                        write->done = trie_batch_insert(trie, path, pending,
+                                                        valid, last, write);
+                        // tombstones in the way are pruned, it moves nodes
+                        if (!write->done && trie->dead) {
+                                trie_batch_flush(path, pending, 0, valid);
+                                if (trie_unbury(trie, write->key,
+                                                write->key_size)) {
+                                        valid = trie_batch_descend(
+                                            trie, path, 0, write->key,
+                                            write->key_size, &last);
+                                        write->done = trie_batch_insert(
+                                            trie, path, pending, valid, last,
+                                            write);
+                                }
+                        }
+                        if (write->done)
+                                valid = write->key_size;
+                        // only a stored key is logged (its record is
+                        // reserved by trie_batch_insert)
+                        if (write->done && trie->wal)
+                                trie_wal_record(trie, TRIE_WAL_INSERT,
+                                                write->key, write->key_size,
+                                                data, 0);
+                } else if (valid == write->key_size &&
+                           path[valid - 1]->data_flag &&
+                           !path[valid - 1]->dead) {
+                        valid = trie_batch_remove(trie, path, pending, write);
+                }
+                done += write->done;
+        }
+        trie_batch_flush(path, pending, 0, valid);
+        trie->deallocator(sorted);
+        // the path is gone, so keys are evicted after the batch
+        if (trie->bounded)
+                trie_evict(trie, NULL, 0);
+        return done;
+}
+
+struct trie_node *trie_begin(struct trie *trie)
+{
+        if (trie == NULL || trie->root == NULL)
+                return NULL;
+        struct trie_node *node = begin(trie->root);
+        return node->dead ? trie_next(node) : node;
+}
+
+struct trie_node *trie_next(struct trie_node *node)
+{
+        do
+                node = trie_node_next(node);
+        while (node && node->dead);
+        return node;
+}
+
+bool trie_data(struct trie_node *node, void **data)
+{
+        if (node == NULL || data == NULL || !node->data_flag || node->dead)
+                return false;
+        memcpy(data, &node->data, sizeof(node->data));
+        return true;
+}
+
+struct trie_node *trie_next_delete(struct trie *obj, struct trie_node *node)
+{
+        if (obj == NULL || node == NULL)
+                return NULL;
+        if (obj->wal && !trie_wal_log_node(obj, node))
+                return NULL;
+        trie_filter_node(obj, node, -1);
+        if (!obj->lazy) {
+                // tombstones stay if lazy removal was turned off
+                struct trie_node *next = trie_unlink(obj, node, 1);
+                return next && next->dead ? trie_next(next) : next;
+        }
+        trie_bury(obj, node, NULL, 0);
+        return trie_next(node);
+}
+
+size_t trie_remove_prefix(struct trie *trie, const uint8_t *prefix,
+                          const size_t prefix_size,
+                          trie_value_callback_t callback, void *ctx,
+                          unsigned int flags)
+{
+        if (trie == NULL || trie->root == NULL)
+                return 0;
+        if (trie->wal && !trie_wal_log(trie, TRIE_WAL_REMOVE_PREFIX, prefix,
+                                       prefix_size, NULL, 0))
+                return 0;
+
+        struct trie_release release = {
+            .deallocator = trie->deallocator,
+            .free_nodes  = &trie->free_nodes,
+            .arena       = trie->arena,
+            .arena_size  = trie->arena_size,
+            .destructor  = trie->destructor,
+            .callback    = callback,
+            .ctx         = ctx,
+            .dead        = &trie->dead,
+        };
+        size_t count;
+        if (prefix_size == 0) {
+                // the whole trie
+                count        = trie_count_prefix(trie, NULL, 0);
+                release.root = trie->root;
+                trie->root   = NULL;
+                trie_free_nodes(trie, false);
+        } else {
+                struct find_res found = trie_lookup(trie, prefix, prefix_size);
+                struct trie_node *node = found.prev;
+                if (found.sz != prefix_size || node == NULL)
+                        return 0;
+                count = node->count;
+                if (trie->filter) {
+                        struct trie_node *i = begin(node);
+                        i = i->dead ? trie_next(i) : i;
+                        for (size_t n = 0; n < count; ++n, i = trie_next(i))
+                                trie_filter_node(trie, i, -1);
+                }
+
+                // detach children, the node is removed like a key
+                // (the value of a tombstone has been returned)
+                trie_purge_detach(trie);
+                release.root = trie_detach(trie, node, prefix, prefix_size);
+                if (release.root == NULL && node->dead)
+                        --trie->dead;
+                else if (release.root == NULL && callback)
+                        callback(ctx, node->data);
+                else if (release.root == NULL && trie->destructor)
+                        trie->destructor(node->data);
+                trie_unlink(trie, node, (uint32_t)count);
+        }
+
+        if (release.root == NULL)
+                return count;
+        // nodes of the arena go to the free list, it isn't for threads, nodes
+        // of a bounded trie and tombstones are counted
+        if ((flags & TRIE_REMOVE_DEFERRED) && trie->arena == NULL &&
+            !trie->bounded && trie->dead == 0) {
+                struct trie_release *arg = trie->allocator(sizeof(*arg));
+                pthread_t thread;
+                if (arg) {
+                        *arg = release;
+                        if (pthread_create(&thread, NULL, trie_release_thread,
+                                           arg) == 0) {
+                                pthread_detach(thread);
+                                return count;
+                        }
+                        trie->deallocator(arg);
+                }
+        }
+        trie->nodes -= trie_release(&release);
+        return count;
+}
+
+bool trie_root_index(struct trie *trie, unsigned int depth)
+{
+        if (trie == NULL || depth > 2)
+                return false;
+        return trie_index_build(trie, depth);
+}
+
+bool trie_compact(struct trie *trie, unsigned int flags)
+{
+        if (trie == NULL)
+                return false;
+        trie_purge_all(trie);
+
+        size_t count = 0, depth = 1, max_depth = 0;
+        for (struct trie_node *i = trie->root; i;
+             i                   = trie_node_walk(i, &depth)) {
+                ++count;
+                if (depth > max_depth)
+                        max_depth = depth;
+        }
+
+        struct trie_node *arena = NULL;
+        size_t bytes            = count * sizeof(*arena);
+        if (flags & TRIE_COMPACT_HUGEPAGES)
+                bytes = (bytes + TRIE_HUGEPAGE - 1) & ~(TRIE_HUGEPAGE - 1);
+        struct trie_chain {
+                size_t begin, end;
+        } *stack = NULL;
+        if (count) {
+                arena = mmap(NULL, bytes, PROT_READ | PROT_WRITE,
+                             MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+                if (arena == MAP_FAILED)
+                        return false;
+                if (flags & TRIE_COMPACT_HUGEPAGES)
+                        madvise(arena, bytes, MADV_HUGEPAGE);
+                stack = trie->allocator(max_depth * sizeof(*stack));
+                if (stack == NULL) {
+                        munmap(arena, bytes);
+                        return false;
+                }
+
+                // chains in the depth-first order, siblings are adjacent
+                size_t size = trie_compact_chain(arena, 0, trie->root, NULL);
+                size_t top  = 0;
+                stack[top++] = (struct trie_chain){0, size};
+                while (top) {
+                        struct trie_chain *chain = &stack[top - 1];
+                        if (chain->begin == chain->end) {
+                                --top;
+                                continue;
+                        }
+                        struct trie_node *node = &arena[chain->begin++];
+                        struct trie_node *child = trie_node_get_positive(node);
+                        if (child == NULL)
+                                continue;
+                        const size_t begin = size;
+                        size = trie_compact_chain(arena, size, child, node);
+                        node->positive = &arena[begin];
+                        stack[top++]   = (struct trie_chain){begin, size};
+                }
+                assert(size == count);
+                trie->deallocator(stack);
+        }
+
+        // old nodes of the heap are freed, the old arena goes away at once
+        const struct trie_release release = {
+            .root        = trie->root,
+            .deallocator = trie->deallocator,
+            .arena       = trie->arena,
+            .arena_size  = trie->arena_size,
+        };
+        trie_release(&release);
+        for (struct trie_node **i = &trie->free_nodes; *i;) {
+                if (trie_arena_has(trie->arena, trie->arena_size, *i))
+                        *i = (*i)->negative;
+                else
+                        i = &(*i)->negative;
+        }
+        if (trie->arena)
+                munmap(trie->arena, trie->arena_bytes);
+
+        trie->root        = arena;
+        trie->arena       = arena;
+        trie->arena_size  = count;
+        trie->arena_bytes = bytes;
+        return trie_index_rebuild(trie);
+}
+
+bool trie_merge(struct trie *dst, struct trie *src, trie_resolve_t resolve,
+                void *ctx)
+{
+        return trie_combine(dst, src, TRIE_COMBINE_MERGE, resolve, ctx);
+}
+
+bool trie_intersect(struct trie *dst, struct trie *src,
+                    trie_resolve_t resolve, void *ctx)
+{
+        return trie_combine(dst, src, TRIE_COMBINE_INTERSECT, resolve, ctx);
+}
+
+bool trie_subtract(struct trie *dst, struct trie *src)
+{
+        return trie_combine(dst, src, TRIE_COMBINE_SUBTRACT, NULL, NULL);
+}
+
+bool trie_score(struct trie_node *node, uint32_t *score)
+{
+        if (node == NULL || score == NULL || !node->data_flag)
+                return false;
+        *score = node->score;
+        return true;
+}
+
+size_t trie_key(struct trie_node *node, uint8_t *key, size_t size)
+{
+        size_t depth = 0;
+        for (struct trie_node *i = node; i; i = trie_node_get_chain_parent(i))
+                ++depth;
+        if (key == NULL || size < depth)
+                return depth;
+
+        size_t pos = depth;
+        for (struct trie_node *i = node; i; i = trie_node_get_chain_parent(i))
+                key[--pos] = i->symbol;
+        return depth;
+}
+
+size_t trie_count_prefix(struct trie *trie, const uint8_t *prefix,
+                         const size_t prefix_size)
+{
+        if (trie == NULL || trie->root == NULL)
+                return 0;
+
+        if (prefix_size == 0)
+                return trie->keys;
+
+        struct find_res found = trie_lookup(trie, prefix, prefix_size);
+        return found.sz == prefix_size ? found.prev->count : 0;
+}
+
+bool trie_rank(struct trie *trie, const uint8_t *key, const size_t key_size,
+               size_t *rank)
+{
+        if (trie == NULL || key == NULL || key_size == 0 || rank == NULL)
+                return false;
+
+        // keys of the previous siblings go before the key on every level
+        size_t res             = 0;
+        struct trie_node *node = trie->root;
+        for (size_t i = 0; node;) {
+                if (node->symbol != key[i]) {
+                        res += node->count;
+                        node = trie_node_get_negative(node);
+                        continue;
+                }
+                if (++i == key_size) {
+                        if (!node->data_flag || node->dead)
+                                return false;
+                        *rank = res;
+                        return true;
+                }
+                node = trie_node_get_positive(node);
+        }
+        return false;
+}
+
+struct trie_node *trie_select(struct trie *trie, size_t rank)
+{
+        if (trie == NULL)
+                return NULL;
+
+        struct trie_node *node = trie->root;
+        while (node) {
+                if (rank >= node->count) {
+                        rank -= node->count;
+                        node = trie_node_get_negative(node);
+                } else if (node->data_flag) {
+                        return node;
+                } else {
+                        node = trie_node_get_positive(node);
+                }
+        }
+        return NULL;
+}
+
+size_t trie_topk(struct trie *trie, const uint8_t *prefix,
+                 const size_t prefix_size, size_t k, struct trie_node **out)
+{
+        if (trie == NULL || trie->root == NULL || out == NULL || k == 0)
+                return 0;
+
+        struct trie_node *chain = trie->root;
+        size_t keys             = trie->keys;
+        if (prefix_size != 0) {
+                struct find_res found =
+                    trie_lookup(trie, prefix, prefix_size);
+                // (tombstones only below the prefix)
+                if (found.sz != prefix_size || found.prev->count == 0)
+                        return 0;
+                if (found.prev->data_flag) {
+                        out[0] = found.prev;
+                        return 1;
+                }
+                chain = trie_node_get_positive(found.prev);
+                keys  = found.prev->count;
+        }
+        // there are no more keys to keep (and the size of the heap can't
+        // overflow)
+        if (k > keys)
+                k = keys;
+
+        struct topk_item *items = trie->allocator(k * sizeof(*items));
+        if (items == NULL)
+                return 0;
+
+        // Best-first search: the max score of a subtree is the score of its
+        // best key, so keys are popped in the order of their scores.
+        size_t size = 0, count = 0, depth = prefix_size + 1;
+        for (; chain; chain = trie_node_get_negative(chain)) {
+                struct topk_item item = {chain, chain->score, depth};
+                if (chain->count)
+                        topk_push(items, &size, k, &item);
+        }
+        while (size != 0 && count < k) {
+                const struct topk_item top = items[--size];
+                if (top.node->data_flag) {
+                        out[count++] = top.node;
+                        continue;
+                }
+                for (struct trie_node *i = trie_node_get_positive(top.node); i;
+                     i                   = trie_node_get_negative(i)) {
+                        struct topk_item item = {i, i->score, top.depth + 1};
+                        if (i->count)
+                                topk_push(items, &size, k - count, &item);
+                }
+        }
+
+        trie->deallocator(items);
+        return count;
 }
 
 bool trie_export_dot(struct trie *obj, const char *file_name)
@@ -479,7 +2219,8 @@ bool trie_export_dot(struct trie *obj, const char *file_name)
                         symbol[2] = '0';
                         symbol[3] = '\0';
                 }
-                fprintf(file, "\tN%zu [label=\"%s\"];\n", (size_t)node, symbol);
+                fprintf(file, "\tN%zu [label=\"%s\"%s];\n", (size_t)node,
+                        symbol, node->dead ? ", style=\"dashed\"" : "");
                 struct trie_node *p = node->positive, *n = node->negative;
                 if (p)
                         fprintf(file, "\tN%zu -> %s%zu [%s];\n", (size_t)node,
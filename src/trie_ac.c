@@ -0,0 +1,369 @@
+/*
+ * trie_ac.c
+ * Copyright (C) 2016 DerShokus <lily.coder@gmail.com>
+ *
+ * Distributed under terms of the MIT license.
+ */
+
+#include "trie_ac.h"
+#include "trie_internal.h"
+
+#include <assert.h>
+#include <stdlib.h>
+
+// Children of a state are stored as a contiguous range of states sorted by
+// symbol, so a transition is a scan over a short array of bytes or, for wide
+// states, a rank in a bitmap of symbols. The root has a dense table because
+// the scanner sits there most of the time. Fields used by every step are kept
+// apart from the rest to spend less cache lines per step on large automata.
+
+#define TRIE_AC_LINEAR 8
+
+struct trie_ac_goto {
+        uint32_t child; // the first child state
+        uint32_t wide;  // a bitmap of wide states
+        uint16_t children;
+        bool match;
+        bool output; // the fail path has a match
+};
+
+struct trie_ac_wide {
+        uint64_t bits[4];
+        uint8_t rank[4]; // the number of bits in the previous words
+};
+
+struct trie_ac_state {
+        uint32_t output; // the nearest state on the fail path with a match
+        uint32_t depth;
+        void *data;
+};
+
+struct trie_ac {
+        trie_allocator_t allocator;
+        trie_deallocator_t deallocator;
+
+        uint32_t size;
+        struct trie_ac_goto *gotos;
+        struct trie_ac_wide *wides;
+        uint32_t *fails; // the longest proper suffix which is a state too
+        uint8_t *symbols;
+        struct trie_ac_state *states;
+        uint32_t root[256];
+};
+
+struct trie_ac_scanner {
+        const struct trie_ac *ac;
+        uint32_t state;
+        uint64_t offset;
+};
+
+static size_t trie_ac_count_nodes(struct trie_node *node)
+{
+        size_t count = 0;
+        while (node) {
+                ++count;
+                if (trie_node_get_positive(node) == NULL) {
+                        while (node && trie_node_get_negative(node) == NULL) {
+                                node = trie_node_get_parent(node);
+                        }
+                        if (node)
+                                node = trie_node_get_negative(node);
+                } else {
+                        node = trie_node_get_positive(node);
+                }
+        }
+        return count;
+}
+
+static inline uint32_t trie_ac_goto(const struct trie_ac *ac, uint32_t state,
+                                    uint8_t symbol)
+{
+        if (state == 0)
+                return ac->root[symbol];
+
+        const struct trie_ac_goto *g = &ac->gotos[state];
+        const uint8_t *symbols       = &ac->symbols[g->child];
+        if (g->children <= TRIE_AC_LINEAR) {
+                for (uint32_t i = 0; i < g->children; ++i) {
+                        if (symbols[i] == symbol)
+                                return g->child + i;
+                }
+                return 0;
+        }
+
+        const struct trie_ac_wide *wide = &ac->wides[g->wide];
+        const uint64_t bits             = wide->bits[symbol >> 6];
+        const uint64_t bit              = 1ull << (symbol & 63);
+        if ((bits & bit) == 0)
+                return 0;
+        return g->child + wide->rank[symbol >> 6] +
+               (uint32_t)__builtin_popcountll(bits & (bit - 1));
+}
+
+// insertion sort of a freshly added range of children by symbol
+static void trie_ac_sort(struct trie_ac *ac, struct trie_node **chains,
+                         uint32_t from, uint32_t to)
+{
+        for (uint32_t i = from + 1; i < to; ++i) {
+                const uint8_t symbol             = ac->symbols[i];
+                const struct trie_ac_goto g      = ac->gotos[i];
+                const struct trie_ac_state state = ac->states[i];
+                struct trie_node *chain          = chains[i];
+                uint32_t j                       = i;
+                for (; j > from && ac->symbols[j - 1] > symbol; --j) {
+                        ac->symbols[j] = ac->symbols[j - 1];
+                        ac->gotos[j]   = ac->gotos[j - 1];
+                        ac->states[j]  = ac->states[j - 1];
+                        chains[j]      = chains[j - 1];
+                }
+                ac->symbols[j] = symbol;
+                ac->gotos[j]   = g;
+                ac->states[j]  = state;
+                chains[j]      = chain;
+        }
+}
+
+// Breadth-first numbering of the trie. Returns the number of states.
+static uint32_t trie_ac_build_goto(struct trie_ac *ac, struct trie_node *root,
+                                   struct trie_node **chains)
+{
+        uint32_t tail = 1;
+        chains[0]     = root;
+        for (uint32_t head = 0; head < tail; ++head) {
+                struct trie_ac_goto *g = &ac->gotos[head];
+                const uint32_t first   = tail;
+                for (struct trie_node *node = chains[head]; node;
+                     node                   = trie_node_get_negative(node)) {
+                        if (head != 0 && node->data_flag && !node->dead &&
+                            node->symbol == '\0') {
+                                // a terminator: the parent is the match
+                                g->match              = true;
+                                ac->states[head].data = node->data;
+                                continue;
+                        }
+                        memset(&ac->gotos[tail], 0, sizeof(ac->gotos[tail]));
+                        memset(&ac->states[tail], 0, sizeof(ac->states[tail]));
+                        ac->states[tail].depth = ac->states[head].depth + 1;
+                        ac->symbols[tail]      = node->symbol;
+                        if (node->data_flag) {
+                                // tombstones (see trie_set_lazy) don't match
+                                ac->gotos[tail].match = !node->dead;
+                                ac->states[tail].data = node->data;
+                                chains[tail]          = NULL;
+                        } else {
+                                chains[tail] = trie_node_get_positive(node);
+                        }
+                        ++tail;
+                }
+                g->child    = first;
+                g->children = (uint16_t)(tail - first);
+                trie_ac_sort(ac, chains, first, tail);
+        }
+        return tail;
+}
+
+static bool trie_ac_build_wide(struct trie_ac *ac)
+{
+        uint32_t count = 0;
+        for (uint32_t s = 1; s < ac->size; ++s) {
+                if (ac->gotos[s].children > TRIE_AC_LINEAR)
+                        ++count;
+        }
+        if (count == 0)
+                return true;
+
+        ac->wides = ac->allocator(count * sizeof(struct trie_ac_wide));
+        if (ac->wides == NULL)
+                return false;
+        memset(ac->wides, 0, count * sizeof(struct trie_ac_wide));
+
+        count = 0;
+        for (uint32_t s = 1; s < ac->size; ++s) {
+                struct trie_ac_goto *g = &ac->gotos[s];
+                if (g->children <= TRIE_AC_LINEAR)
+                        continue;
+                struct trie_ac_wide *wide = &ac->wides[count];
+                g->wide                   = count++;
+                for (uint32_t i = 0; i < g->children; ++i) {
+                        const uint8_t symbol = ac->symbols[g->child + i];
+                        wide->bits[symbol >> 6] |= 1ull << (symbol & 63);
+                }
+                for (int i = 1; i < 4; ++i) {
+                        wide->rank[i] =
+                            (uint8_t)(wide->rank[i - 1] +
+                                      __builtin_popcountll(wide->bits[i - 1]));
+                }
+        }
+        return true;
+}
+
+static void trie_ac_build_fail(struct trie_ac *ac)
+{
+        const struct trie_ac_goto *root = &ac->gotos[0];
+        for (uint32_t i = 0; i < root->children; ++i) {
+                const uint32_t child         = root->child + i;
+                ac->root[ac->symbols[child]] = child;
+                ac->fails[child]             = 0;
+        }
+
+        // states are numbered in BFS order, so fail links of the shallower
+        // states are ready when their children are processed
+        for (uint32_t s = 1; s < ac->size; ++s) {
+                const struct trie_ac_goto *g = &ac->gotos[s];
+                for (uint32_t i = 0; i < g->children; ++i) {
+                        const uint32_t child = g->child + i;
+                        const uint8_t symbol = ac->symbols[child];
+                        uint32_t fail        = ac->fails[s];
+                        uint32_t next        = trie_ac_goto(ac, fail, symbol);
+                        while (next == 0 && fail != 0) {
+                                fail = ac->fails[fail];
+                                next = trie_ac_goto(ac, fail, symbol);
+                        }
+
+                        ac->fails[child] = next;
+                        ac->states[child].output =
+                            ac->gotos[next].match ? next
+                                                  : ac->states[next].output;
+                        ac->gotos[child].output =
+                            ac->states[child].output != 0;
+                }
+        }
+}
+
+// +--------------------------------------------------------------------------+
+// | Public functions                                                         |
+// +--------------------------------------------------------------------------+
+
+struct trie_ac *trie_ac_new(struct trie *trie)
+{
+        if (trie == NULL)
+                return NULL;
+
+        struct trie_ac *ac = trie->allocator(sizeof(struct trie_ac));
+        if (ac == NULL)
+                return NULL;
+        memset(ac, 0, sizeof(*ac));
+        ac->allocator   = trie->allocator;
+        ac->deallocator = trie->deallocator;
+
+        const size_t count = trie_ac_count_nodes(trie->root) + 1;
+        if (count > UINT32_MAX) {
+                trie_ac_delete(&ac);
+                return NULL;
+        }
+
+        struct trie_node **chains =
+            ac->allocator(count * sizeof(struct trie_node *));
+        ac->gotos   = ac->allocator(count * sizeof(struct trie_ac_goto));
+        ac->fails   = ac->allocator(count * sizeof(uint32_t));
+        ac->symbols = ac->allocator(count * sizeof(uint8_t));
+        ac->states  = ac->allocator(count * sizeof(struct trie_ac_state));
+        if (chains == NULL || ac->gotos == NULL || ac->fails == NULL ||
+            ac->symbols == NULL || ac->states == NULL) {
+                if (chains)
+                        ac->deallocator(chains);
+                trie_ac_delete(&ac);
+                return NULL;
+        }
+
+        memset(&ac->gotos[0], 0, sizeof(ac->gotos[0]));
+        memset(&ac->states[0], 0, sizeof(ac->states[0]));
+        ac->fails[0]   = 0;
+        ac->symbols[0] = '\0';
+        ac->size       = trie_ac_build_goto(ac, trie->root, chains);
+        ac->deallocator(chains);
+        if (!trie_ac_build_wide(ac)) {
+                trie_ac_delete(&ac);
+                return NULL;
+        }
+        trie_ac_build_fail(ac);
+
+        return ac;
+}
+
+void trie_ac_delete(struct trie_ac **ac)
+{
+        if (!ac || !(*ac))
+                return;
+        void *arrays[] = {(*ac)->gotos, (*ac)->wides, (*ac)->fails,
+                          (*ac)->symbols, (*ac)->states};
+        for (size_t i = 0; i < sizeof(arrays) / sizeof(arrays[0]); ++i) {
+                if (arrays[i])
+                        (*ac)->deallocator(arrays[i]);
+        }
+        (*ac)->deallocator(*ac);
+        *ac = NULL;
+}
+
+struct trie_ac_scanner *trie_ac_scanner_new(const struct trie_ac *ac)
+{
+        if (ac == NULL)
+                return NULL;
+
+        struct trie_ac_scanner *scanner =
+            ac->allocator(sizeof(struct trie_ac_scanner));
+        if (scanner) {
+                scanner->ac = ac;
+                trie_ac_scanner_reset(scanner);
+        }
+        return scanner;
+}
+
+void trie_ac_scanner_delete(struct trie_ac_scanner **scanner)
+{
+        if (!scanner || !(*scanner))
+                return;
+        (*scanner)->ac->deallocator(*scanner);
+        *scanner = NULL;
+}
+
+void trie_ac_scanner_reset(struct trie_ac_scanner *scanner)
+{
+        assert(scanner != NULL);
+
+        scanner->state  = 0;
+        scanner->offset = 0;
+}
+
+bool trie_ac_feed(struct trie_ac_scanner *scanner, const uint8_t *buf,
+                  size_t size, trie_ac_callback_t callback, void *ctx)
+{
+        if (scanner == NULL || (buf == NULL && size != 0))
+                return false;
+
+        const struct trie_ac *ac = scanner->ac;
+        uint32_t state           = scanner->state;
+        bool proceed             = true;
+
+        size_t i = 0;
+        for (; i < size && proceed; ++i) {
+                const uint8_t symbol = buf[i];
+                for (;;) {
+                        const uint32_t next = trie_ac_goto(ac, state, symbol);
+                        if (next != 0 || state == 0) {
+                                state = next;
+                                break;
+                        }
+                        state = ac->fails[state];
+                }
+
+                const struct trie_ac_goto *g = &ac->gotos[state];
+                if (!g->match && !g->output)
+                        continue;
+
+                const struct trie_ac_state *states = ac->states;
+                uint32_t match = g->match ? state : states[state].output;
+                for (; match && callback; match = states[match].output) {
+                        if (!callback(ctx, scanner->offset + i + 1,
+                                      states[match].depth,
+                                      states[match].data)) {
+                                proceed = false;
+                                break;
+                        }
+                }
+        }
+
+        scanner->state = state;
+        scanner->offset += i;
+        return proceed;
+}
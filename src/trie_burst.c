@@ -0,0 +1,657 @@
+/*
+ * trie_burst.c
+ * Copyright (C) 2016 DerShokus <lily.coder@gmail.com>
+ *
+ * Distributed under terms of the MIT license.
+ */
+
+#include "trie_burst.h"
+
+#include <assert.h>
+#include <stdlib.h>
+
+// A slot of a node points to a node or to a bucket, buckets are tagged by the
+// low bit. A bucket keeps records one after another: the suffix size (one
+// byte below 128 or two bytes), the suffix and the value. Records are sorted,
+// so a search stops at the first greater suffix and a burst moves records to
+// new buckets in order.
+
+#define TRIE_BURST_DEFAULT 64
+#define TRIE_BURST_SUFFIX_MAX 0x7fff
+
+struct trie_burst_node {
+        void *slots[256];
+        unsigned int children; // slots which aren't NULL
+        bool has_data;         // of the key which ends at the node
+        void *data;
+};
+
+struct trie_burst_bucket {
+        uint32_t count;
+        size_t size; // bytes of records
+        size_t capacity;
+        uint8_t records[];
+};
+
+struct trie_burst {
+        void *root;
+        trie_allocator_t allocator;
+        trie_deallocator_t deallocator;
+        size_t burst;
+        size_t size;
+};
+
+static inline bool trie_burst_is_bucket(const void *slot)
+{
+        return (uintptr_t)slot & 1;
+}
+
+static inline struct trie_burst_bucket *trie_burst_bucket(const void *slot)
+{
+        return (struct trie_burst_bucket *)((uintptr_t)slot & ~(uintptr_t)1);
+}
+
+static inline void *trie_burst_tag(struct trie_burst_bucket *bucket)
+{
+        return (void *)((uintptr_t)bucket | 1);
+}
+
+static inline size_t trie_burst_record_size(size_t size)
+{
+        return (size < 128 ? 1 : 2) + size + sizeof(void *);
+}
+
+// Returns the suffix of a record, its size returns by size parameter.
+static inline uint8_t *trie_burst_suffix(uint8_t *record, size_t *size)
+{
+        if (record[0] < 128) {
+                *size = record[0];
+                return record + 1;
+        }
+        *size = (size_t)(record[0] & 0x7f) << 8 | record[1];
+        return record + 2;
+}
+
+static inline uint8_t *trie_burst_put(uint8_t *record, const uint8_t *suffix,
+                                      size_t size, void *data)
+{
+        if (size < 128) {
+                *record++ = (uint8_t)size;
+        } else {
+                *record++ = (uint8_t)(0x80 | size >> 8);
+                *record++ = (uint8_t)size;
+        }
+        memcpy(record, suffix, size);
+        memcpy(record + size, &data, sizeof(data));
+        return record + size + sizeof(data);
+}
+
+static inline int trie_burst_compare(const uint8_t *a, size_t a_size,
+                                     const uint8_t *b, size_t b_size)
+{
+        const int res = memcmp(a, b, a_size < b_size ? a_size : b_size);
+        if (res != 0)
+                return res;
+        return (a_size > b_size) - (a_size < b_size);
+}
+
+// Returns the offset of the record of a suffix or of the first greater one,
+// found tells which.
+static size_t trie_burst_find(struct trie_burst_bucket *bucket,
+                              const uint8_t *suffix, size_t size, bool *found)
+{
+        size_t pos = 0;
+        while (pos < bucket->size) {
+                size_t record_size;
+                const uint8_t *record =
+                    trie_burst_suffix(&bucket->records[pos], &record_size);
+                const int res =
+                    trie_burst_compare(record, record_size, suffix, size);
+                if (res >= 0) {
+                        *found = res == 0;
+                        return pos;
+                }
+                pos = (size_t)(record - bucket->records) + record_size +
+                      sizeof(void *);
+        }
+        *found = false;
+        return pos;
+}
+
+static inline void **trie_burst_value(struct trie_burst_bucket *bucket,
+                                      size_t pos)
+{
+        size_t size;
+        uint8_t *suffix = trie_burst_suffix(&bucket->records[pos], &size);
+        return (void **)(suffix + size);
+}
+
+static struct trie_burst_bucket *trie_burst_bucket_new(struct trie_burst *obj,
+                                                       size_t capacity)
+{
+        struct trie_burst_bucket *bucket =
+            obj->allocator(sizeof(*bucket) + capacity);
+        if (bucket) {
+                bucket->count    = 0;
+                bucket->size     = 0;
+                bucket->capacity = capacity;
+        }
+        return bucket;
+}
+
+static struct trie_burst_node *trie_burst_node_new(struct trie_burst *obj)
+{
+        struct trie_burst_node *node = obj->allocator(sizeof(*node));
+        if (node)
+                memset(node, 0, sizeof(*node));
+        return node;
+}
+
+static bool trie_burst_bucket_insert(struct trie_burst *obj, void **slot,
+                                     size_t pos, const uint8_t *suffix,
+                                     size_t size, void *data)
+{
+        struct trie_burst_bucket *bucket = trie_burst_bucket(*slot);
+        const size_t record              = trie_burst_record_size(size);
+        if (bucket->size + record > bucket->capacity) {
+                size_t capacity = 2 * bucket->capacity;
+                if (capacity < bucket->size + record)
+                        capacity = bucket->size + record;
+                struct trie_burst_bucket *grown =
+                    trie_burst_bucket_new(obj, capacity);
+                if (grown == NULL)
+                        return false;
+                grown->count = bucket->count;
+                grown->size  = bucket->size;
+                memcpy(grown->records, bucket->records, bucket->size);
+                obj->deallocator(bucket);
+                bucket = grown;
+                *slot  = trie_burst_tag(bucket);
+        }
+
+        memmove(&bucket->records[pos + record], &bucket->records[pos],
+                bucket->size - pos);
+        trie_burst_put(&bucket->records[pos], suffix, size, data);
+        bucket->size += record;
+        ++bucket->count;
+        return true;
+}
+
+// Replace a bucket by a node with a bucket for every first byte of suffixes.
+static bool trie_burst_burst(struct trie_burst *obj, void **slot)
+{
+        struct trie_burst_bucket *bucket = trie_burst_bucket(*slot);
+        size_t bytes[256]                = {0};
+        for (size_t pos = 0; pos < bucket->size;) {
+                size_t size;
+                const uint8_t *suffix =
+                    trie_burst_suffix(&bucket->records[pos], &size);
+                if (size)
+                        bytes[suffix[0]] += trie_burst_record_size(size - 1);
+                pos = (size_t)(suffix - bucket->records) + size +
+                      sizeof(void *);
+        }
+
+        struct trie_burst_node *node = trie_burst_node_new(obj);
+        if (node == NULL)
+                return false;
+        for (unsigned int i = 0; i < 256; ++i) {
+                if (bytes[i] == 0)
+                        continue;
+                struct trie_burst_bucket *child =
+                    trie_burst_bucket_new(obj, bytes[i]);
+                if (child == NULL) {
+                        for (unsigned int j = 0; j < i; ++j) {
+                                if (node->slots[j])
+                                        obj->deallocator(trie_burst_bucket(
+                                            node->slots[j]));
+                        }
+                        obj->deallocator(node);
+                        return false;
+                }
+                node->slots[i] = trie_burst_tag(child);
+                ++node->children;
+        }
+
+        // records stay sorted in every new bucket
+        for (size_t pos = 0; pos < bucket->size;) {
+                size_t size;
+                const uint8_t *suffix =
+                    trie_burst_suffix(&bucket->records[pos], &size);
+                void *data;
+                memcpy(&data, suffix + size, sizeof(data));
+                pos = (size_t)(suffix - bucket->records) + size +
+                      sizeof(void *);
+                if (size == 0) {
+                        node->has_data = true;
+                        node->data     = data;
+                        continue;
+                }
+                struct trie_burst_bucket *child =
+                    trie_burst_bucket(node->slots[suffix[0]]);
+                child->size = (size_t)(trie_burst_put(
+                                           &child->records[child->size],
+                                           suffix + 1, size - 1, data) -
+                                       child->records);
+                ++child->count;
+        }
+        obj->deallocator(bucket);
+        *slot = node;
+        return true;
+}
+
+// Free nodes of the key path which have neither keys nor other children.
+// depth is the number of nodes of the path.
+static void trie_burst_prune(struct trie_burst *obj, const uint8_t *key,
+                             size_t depth)
+{
+        void **slot = &obj->root, **cut = NULL;
+        struct trie_burst_node *parent = NULL, *cut_parent = NULL;
+        size_t cut_depth = 0;
+        for (size_t i = 0; i < depth; ++i) {
+                struct trie_burst_node *node = *slot;
+                const unsigned int path      = i + 1 < depth;
+                if (node->has_data || node->children > path) {
+                        cut = NULL;
+                } else if (cut == NULL) {
+                        cut        = slot;
+                        cut_parent = parent;
+                        cut_depth  = i;
+                }
+                parent = node;
+                if (path)
+                        slot = &node->slots[key[i]];
+        }
+        if (cut == NULL)
+                return;
+
+        struct trie_burst_node *node = *cut;
+        *cut                         = NULL;
+        if (cut_parent)
+                --cut_parent->children;
+        for (size_t i = cut_depth; i < depth; ++i) {
+                struct trie_burst_node *next =
+                    i + 1 < depth ? node->slots[key[i]] : NULL;
+                obj->deallocator(node);
+                node = next;
+        }
+}
+
+struct trie_burst *trie_burst_new(trie_allocator_t allocator,
+                                  trie_deallocator_t deallocator,
+                                  size_t burst)
+{
+        if (allocator == NULL)
+                allocator = malloc;
+        if (deallocator == NULL)
+                deallocator = free;
+        struct trie_burst *obj = allocator(sizeof(*obj));
+        if (obj) {
+                memset(obj, 0, sizeof(*obj));
+                obj->allocator   = allocator;
+                obj->deallocator = deallocator;
+                obj->burst       = burst ? burst : TRIE_BURST_DEFAULT;
+        }
+        return obj;
+}
+
+void trie_burst_delete(struct trie_burst **obj)
+{
+        if (obj == NULL || *obj == NULL)
+                return;
+
+        // nodes which are left to free are linked by data
+        struct trie_burst_node *list = NULL;
+        if ((*obj)->root && trie_burst_is_bucket((*obj)->root)) {
+                (*obj)->deallocator(trie_burst_bucket((*obj)->root));
+        } else if ((*obj)->root) {
+                list       = (*obj)->root;
+                list->data = NULL;
+        }
+        while (list) {
+                struct trie_burst_node *node = list;
+                list                         = node->data;
+                for (unsigned int i = 0; node->children && i < 256; ++i) {
+                        void *slot = node->slots[i];
+                        if (slot == NULL)
+                                continue;
+                        if (trie_burst_is_bucket(slot)) {
+                                (*obj)->deallocator(trie_burst_bucket(slot));
+                                continue;
+                        }
+                        struct trie_burst_node *child = slot;
+                        child->data                   = list;
+                        list                          = child;
+                }
+                (*obj)->deallocator(node);
+        }
+        (*obj)->deallocator(*obj);
+        *obj = NULL;
+}
+
+bool trie_burst_insert(struct trie_burst *obj, const uint8_t *key,
+                       const size_t key_size, void *data, void **old)
+{
+        if (old)
+                *old = NULL;
+        if (obj == NULL || key == NULL || key_size == 0)
+                return false;
+
+        void **slot                    = &obj->root;
+        struct trie_burst_node *parent = NULL;
+        size_t i                       = 0;
+        for (;;) {
+                const size_t size = key_size - i;
+                if (*slot == NULL) {
+                        // too long suffixes go through nodes
+                        const size_t record = trie_burst_record_size(size);
+                        void *created;
+                        if (size > TRIE_BURST_SUFFIX_MAX)
+                                created = trie_burst_node_new(obj);
+                        else
+                                created = trie_burst_bucket_new(obj, record);
+                        if (created == NULL) {
+                                trie_burst_prune(obj, key, i);
+                                return false;
+                        }
+                        *slot = size > TRIE_BURST_SUFFIX_MAX
+                                    ? created
+                                    : trie_burst_tag(created);
+                        if (parent)
+                                ++parent->children;
+                }
+
+                if (!trie_burst_is_bucket(*slot)) {
+                        parent = *slot;
+                        if (i == key_size) {
+                                if (old && parent->has_data)
+                                        *old = parent->data;
+                                obj->size += !parent->has_data;
+                                parent->has_data = true;
+                                parent->data     = data;
+                                return true;
+                        }
+                        slot = &parent->slots[key[i++]];
+                        continue;
+                }
+
+                struct trie_burst_bucket *bucket = trie_burst_bucket(*slot);
+                bool found;
+                const size_t pos = trie_burst_find(bucket, &key[i], size,
+                                                   &found);
+                if (found) {
+                        void **value = trie_burst_value(bucket, pos);
+                        if (old)
+                                memcpy(old, value, sizeof(*old));
+                        memcpy(value, &data, sizeof(data));
+                        return true;
+                }
+                if (size <= TRIE_BURST_SUFFIX_MAX &&
+                    bucket->count < obj->burst) {
+                        if (!trie_burst_bucket_insert(obj, slot, pos, &key[i],
+                                                      size, data))
+                                return false;
+                        ++obj->size;
+                        return true;
+                }
+                if (!trie_burst_burst(obj, slot))
+                        return false;
+        }
+}
+
+bool trie_burst_at(const struct trie_burst *obj, const uint8_t *key,
+                   const size_t key_size, void **data)
+{
+        if (obj == NULL || key == NULL || key_size == 0)
+                return false;
+
+        const void *slot = obj->root;
+        size_t i         = 0;
+        while (slot && !trie_burst_is_bucket(slot)) {
+                const struct trie_burst_node *node = slot;
+                if (i == key_size) {
+                        if (node->has_data && data)
+                                *data = node->data;
+                        return node->has_data;
+                }
+                slot = node->slots[key[i++]];
+        }
+        if (slot == NULL)
+                return false;
+
+        struct trie_burst_bucket *bucket = trie_burst_bucket(slot);
+        bool found;
+        const size_t pos =
+            trie_burst_find(bucket, &key[i], key_size - i, &found);
+        if (found && data)
+                memcpy(data, trie_burst_value(bucket, pos), sizeof(*data));
+        return found;
+}
+
+bool trie_burst_remove(struct trie_burst *obj, const uint8_t *key,
+                       const size_t key_size, void **data)
+{
+        if (obj == NULL || key == NULL || key_size == 0)
+                return false;
+
+        void **slot                    = &obj->root;
+        struct trie_burst_node *parent = NULL;
+        size_t i                       = 0;
+        while (*slot && !trie_burst_is_bucket(*slot)) {
+                parent = *slot;
+                if (i == key_size) {
+                        if (!parent->has_data)
+                                return false;
+                        if (data)
+                                *data = parent->data;
+                        parent->has_data = false;
+                        --obj->size;
+                        trie_burst_prune(obj, key, i + 1);
+                        return true;
+                }
+                slot = &parent->slots[key[i++]];
+        }
+        if (*slot == NULL)
+                return false;
+
+        struct trie_burst_bucket *bucket = trie_burst_bucket(*slot);
+        bool found;
+        const size_t pos =
+            trie_burst_find(bucket, &key[i], key_size - i, &found);
+        if (!found)
+                return false;
+        if (data)
+                memcpy(data, trie_burst_value(bucket, pos), sizeof(*data));
+        const size_t record = trie_burst_record_size(key_size - i);
+        memmove(&bucket->records[pos], &bucket->records[pos + record],
+                bucket->size - pos - record);
+        bucket->size -= record;
+        --bucket->count;
+        --obj->size;
+        if (bucket->count == 0) {
+                obj->deallocator(bucket);
+                *slot = NULL;
+                if (parent) {
+                        --parent->children;
+                        trie_burst_prune(obj, key, i);
+                }
+        }
+        return true;
+}
+
+size_t trie_burst_size(const struct trie_burst *obj)
+{
+        return obj ? obj->size : 0;
+}
+
+// +--------------------------------------------------------------------------+
+// | Walk                                                                     |
+// +--------------------------------------------------------------------------+
+
+struct trie_burst_frame {
+        const struct trie_burst_node *node;
+        unsigned int next; // slot
+};
+
+struct trie_burst_walker {
+        const struct trie_burst *obj;
+        trie_burst_callback_t callback;
+        void *ctx;
+        uint8_t *key;
+        size_t capacity;
+        struct trie_burst_frame *frames;
+        size_t top, frames_capacity;
+};
+
+static bool trie_burst_reserve(struct trie_burst_walker *walker, size_t size)
+{
+        if (size <= walker->capacity)
+                return true;
+        size_t capacity = walker->capacity ? 2 * walker->capacity : 256;
+        while (capacity < size)
+                capacity *= 2;
+        uint8_t *key = walker->obj->allocator(capacity);
+        if (key == NULL)
+                return false;
+        if (walker->key) {
+                memcpy(key, walker->key, walker->capacity);
+                walker->obj->deallocator(walker->key);
+        }
+        walker->key      = key;
+        walker->capacity = capacity;
+        return true;
+}
+
+// Report records of a bucket which start with the rest of a prefix, the key
+// has depth bytes before suffixes. The rest can't be in the key of the
+// walker: it's reallocated by long suffixes.
+static bool trie_burst_walk_bucket(struct trie_burst_walker *walker,
+                                   struct trie_burst_bucket *bucket,
+                                   size_t depth, const uint8_t *rest,
+                                   size_t rest_size)
+{
+        bool found;
+        size_t pos = trie_burst_find(bucket, rest, rest_size, &found);
+        while (pos < bucket->size) {
+                size_t size;
+                const uint8_t *suffix =
+                    trie_burst_suffix(&bucket->records[pos], &size);
+                if (size < rest_size || memcmp(suffix, rest, rest_size) != 0)
+                        break;
+                if (!trie_burst_reserve(walker, depth + size))
+                        return false;
+                memcpy(&walker->key[depth], suffix, size);
+                void *data;
+                memcpy(&data, suffix + size, sizeof(data));
+                if (!walker->callback(walker->ctx, walker->key, depth + size,
+                                      data))
+                        return false;
+                pos = (size_t)(suffix - bucket->records) + size +
+                      sizeof(void *);
+        }
+        return true;
+}
+
+static bool trie_burst_push(struct trie_burst_walker *walker,
+                            const struct trie_burst_node *node, size_t depth)
+{
+        if (node->has_data &&
+            !walker->callback(walker->ctx, walker->key, depth, node->data))
+                return false;
+        if (walker->top == walker->frames_capacity) {
+                const size_t capacity = walker->frames_capacity
+                                            ? 2 * walker->frames_capacity
+                                            : 16;
+                struct trie_burst_frame *frames =
+                    walker->obj->allocator(capacity * sizeof(*frames));
+                if (frames == NULL)
+                        return false;
+                if (walker->frames) {
+                        memcpy(frames, walker->frames,
+                               walker->top * sizeof(*frames));
+                        walker->obj->deallocator(walker->frames);
+                }
+                walker->frames          = frames;
+                walker->frames_capacity = capacity;
+        }
+        walker->frames[walker->top++] = (struct trie_burst_frame){node, 0};
+        return true;
+}
+
+// Walk a subtree in the order of symbols, the key of the node has depth
+// bytes.
+static bool trie_burst_walk_node(struct trie_burst_walker *walker,
+                                 const struct trie_burst_node *node,
+                                 size_t depth)
+{
+        const size_t base = depth;
+        if (!trie_burst_push(walker, node, depth))
+                return false;
+        while (walker->top) {
+                struct trie_burst_frame *frame =
+                    &walker->frames[walker->top - 1];
+                if (frame->next == 256) {
+                        --walker->top;
+                        continue;
+                }
+                const unsigned int symbol = frame->next++;
+                const void *slot          = frame->node->slots[symbol];
+                if (slot == NULL)
+                        continue;
+
+                depth = base + walker->top;
+                if (!trie_burst_reserve(walker, depth))
+                        return false;
+                walker->key[depth - 1] = (uint8_t)symbol;
+                if (trie_burst_is_bucket(slot)) {
+                        const uint8_t *all = (const uint8_t *)"";
+                        if (!trie_burst_walk_bucket(walker,
+                                                    trie_burst_bucket(slot),
+                                                    depth, all, 0))
+                                return false;
+                } else if (!trie_burst_push(walker, slot, depth)) {
+                        return false;
+                }
+        }
+        return true;
+}
+
+bool trie_burst_walk(const struct trie_burst *obj, const uint8_t *prefix,
+                     const size_t prefix_size,
+                     trie_burst_callback_t callback, void *ctx)
+{
+        if (obj == NULL || callback == NULL ||
+            (prefix == NULL && prefix_size != 0))
+                return false;
+
+        struct trie_burst_walker walker = {
+            .obj      = obj,
+            .callback = callback,
+            .ctx      = ctx,
+        };
+        if (!trie_burst_reserve(&walker, prefix_size + 1))
+                return false;
+        if (prefix_size)
+                memcpy(walker.key, prefix, prefix_size);
+
+        const void *slot = obj->root;
+        size_t i         = 0;
+        for (; slot && !trie_burst_is_bucket(slot) && i < prefix_size; ++i)
+                slot = ((const struct trie_burst_node *)slot)
+                           ->slots[prefix[i]];
+
+        bool res = true;
+        if (slot && trie_burst_is_bucket(slot))
+                // the rest is compared with suffixes of the caller's prefix,
+                // the key of the walker moves when it grows
+                res = trie_burst_walk_bucket(&walker, trie_burst_bucket(slot),
+                                             i, &prefix[i], prefix_size - i);
+        else if (slot)
+                res = trie_burst_walk_node(&walker, slot, prefix_size);
+
+        if (walker.key)
+                obj->deallocator(walker.key);
+        if (walker.frames)
+                obj->deallocator(walker.frames);
+        return res;
+}
@@ -0,0 +1,311 @@
+/*
+ * trie_heat.c
+ * Copyright (C) 2016 DerShokus <lily.coder@gmail.com>
+ *
+ * Distributed under terms of the MIT license.
+ */
+
+#include "trie.h"
+#include "trie_internal.h"
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef TRIE_HEAT
+
+// Threads take slots in turn, threads which share a slot are still counted
+// right (counters are atomic), they just share a cache line.
+#define TRIE_HEAT_SLOTS 64
+#define TRIE_HEAT_LINE 64
+
+struct trie_heat_slot {
+        uint64_t lookups;
+        struct trie_heat_level levels[TRIE_HEAT_LEVELS];
+} __attribute__((aligned(TRIE_HEAT_LINE)));
+
+// Lookups of a thread which are left until the next sample, the slot of
+// a thread (from 1, 0 - none yet).
+static __thread uint32_t trie_heat_countdown;
+static __thread unsigned int trie_heat_thread;
+static unsigned int trie_heat_threads;
+
+static inline void trie_heat_add(uint64_t *counter, uint64_t value)
+{
+        __atomic_fetch_add(counter, value, __ATOMIC_RELAXED);
+}
+
+// Pre-order step over all nodes.
+static struct trie_node *trie_heat_walk(struct trie_node *node)
+{
+        struct trie_node *next = trie_node_get_positive(node);
+        if (next)
+                return next;
+        for (; node; node = trie_node_get_parent(node)) {
+                next = trie_node_get_negative(node);
+                if (next)
+                        return next;
+        }
+        return NULL;
+}
+
+// Sampled lookups which stop at the node: they aren't passed to children.
+static uint32_t trie_heat_end(struct trie_node *node)
+{
+        uint32_t children = 0;
+        for (struct trie_node *i = trie_node_get_positive(node); i;
+             i                   = trie_node_get_negative(i))
+                children += i->heat;
+        // lookups of other threads may be counted in the middle
+        return node->heat > children ? node->heat - children : 0;
+}
+
+static void trie_heat_symbol(FILE *file, uint8_t symbol)
+{
+        if (symbol == '\0')
+                fprintf(file, "\\\\0");
+        else if (symbol == '"' || symbol == '\\')
+                fprintf(file, "\\%c", symbol);
+        else if (isprint(symbol))
+                fprintf(file, "%c", symbol);
+        else
+                fprintf(file, "0x%02x", symbol);
+}
+
+static int trie_heat_compare(const void *a, const void *b)
+{
+        const uintptr_t x = (uintptr_t) * (struct trie_node *const *)a;
+        const uintptr_t y = (uintptr_t) * (struct trie_node *const *)b;
+        return x < y ? -1 : x > y;
+}
+
+// Nodes of the paths to the ends (with ends), sorted and unique.
+// Returns the number of nodes or SIZE_MAX if memory allocation failed.
+static size_t trie_heat_paths(struct trie *obj, struct trie_node **ends,
+                              size_t count, struct trie_node ***nodes)
+{
+        size_t size = 0, capacity = 0;
+        *nodes = NULL;
+        for (size_t n = 0; n < count; ++n) {
+                for (struct trie_node *i = ends[n]; i;
+                     i = trie_node_get_chain_parent(i)) {
+                        if (size == capacity) {
+                                capacity = capacity ? 2 * capacity : 64;
+                                struct trie_node **buf = obj->allocator(
+                                    capacity * sizeof(*buf));
+                                if (buf == NULL) {
+                                        if (*nodes)
+                                                obj->deallocator(*nodes);
+                                        return SIZE_MAX;
+                                }
+                                if (*nodes) {
+                                        memcpy(buf, *nodes,
+                                               size * sizeof(*buf));
+                                        obj->deallocator(*nodes);
+                                }
+                                *nodes = buf;
+                        }
+                        (*nodes)[size++] = i;
+                }
+        }
+        if (size == 0)
+                return 0;
+        qsort(*nodes, size, sizeof(**nodes), trie_heat_compare);
+        size_t unique = 1;
+        for (size_t i = 1; i < size; ++i) {
+                if ((*nodes)[i] != (*nodes)[unique - 1])
+                        (*nodes)[unique++] = (*nodes)[i];
+        }
+        return unique;
+}
+
+void trie_heat_count(const struct trie *obj, const uint8_t *key,
+                     size_t key_size)
+{
+        if (trie_heat_countdown) {
+                --trie_heat_countdown;
+                return;
+        }
+        trie_heat_countdown = obj->heat_sample - 1;
+        if (trie_heat_thread == 0)
+                trie_heat_thread = __atomic_add_fetch(&trie_heat_threads, 1,
+                                                      __ATOMIC_RELAXED);
+        struct trie_heat_slot *slot =
+            &obj->heat[(trie_heat_thread - 1) % TRIE_HEAT_SLOTS];
+        trie_heat_add(&slot->lookups, 1);
+
+        // the walk of trie_find which counts hops, the root index isn't
+        // used: heat shows chains which it would skip
+        struct trie_node *node = obj->root;
+        for (size_t depth = 0; key && depth < key_size && node; ++depth) {
+                struct trie_heat_level *level =
+                    &slot->levels[depth < TRIE_HEAT_LEVELS
+                                      ? depth
+                                      : TRIE_HEAT_LEVELS - 1];
+                uint64_t hops = 0;
+                while (node && node->symbol != key[depth]) {
+                        node = trie_node_get_negative(node);
+                        ++hops;
+                }
+                trie_heat_add(&level->visits, 1);
+                trie_heat_add(&level->hops, hops);
+                if (node == NULL)
+                        break;
+                // nodes are moved by removals, so their visits are kept
+                // by nodes rather than by slots (see trie_set_heat)
+                __atomic_fetch_add(&node->heat, 1, __ATOMIC_RELAXED);
+                node = trie_node_get_positive(node);
+        }
+}
+
+bool trie_set_heat(struct trie *trie, uint32_t sample)
+{
+        if (trie == NULL)
+                return false;
+        const size_t size = TRIE_HEAT_SLOTS * sizeof(struct trie_heat_slot);
+        void *memory      = NULL;
+        if (sample) {
+                memory = trie->allocator(size + TRIE_HEAT_LINE - 1);
+                if (memory == NULL)
+                        return false;
+        }
+        if (trie->heat_memory)
+                trie->deallocator(trie->heat_memory);
+        trie->heat_memory = memory;
+        trie->heat_sample = sample;
+        trie->heat        = NULL;
+        for (struct trie_node *i = trie->root; i; i = trie_heat_walk(i))
+                i->heat = 0;
+        if (memory) {
+                const uintptr_t mask = TRIE_HEAT_LINE - 1;
+                trie->heat =
+                    (struct trie_heat_slot *)(((uintptr_t)memory + mask) &
+                                              ~mask);
+                memset(trie->heat, 0, size);
+        }
+        return true;
+}
+
+uint64_t trie_heat(struct trie *trie, struct trie_heat_level *levels,
+                   size_t size)
+{
+        if (trie == NULL || trie->heat == NULL)
+                return 0;
+        if (size > TRIE_HEAT_LEVELS)
+                size = TRIE_HEAT_LEVELS;
+        if (levels)
+                memset(levels, 0, size * sizeof(*levels));
+        uint64_t lookups = 0;
+        for (size_t i = 0; i < TRIE_HEAT_SLOTS; ++i) {
+                const struct trie_heat_slot *slot = &trie->heat[i];
+                lookups += __atomic_load_n(&slot->lookups, __ATOMIC_RELAXED);
+                for (size_t j = 0; levels && j < size; ++j) {
+                        const struct trie_heat_level *level = &slot->levels[j];
+                        levels[j].visits += __atomic_load_n(&level->visits,
+                                                            __ATOMIC_RELAXED);
+                        levels[j].hops +=
+                            __atomic_load_n(&level->hops, __ATOMIC_RELAXED);
+                }
+        }
+        return lookups;
+}
+
+bool trie_export_heat(struct trie *obj, const char *file_name, size_t paths)
+{
+        if (obj == NULL || obj->heat == NULL || file_name == NULL)
+                return false;
+
+        // the ends of the hottest paths, the hottest first
+        struct trie_node **ends = NULL;
+        size_t count            = 0;
+        if (paths) {
+                ends = obj->allocator(paths * sizeof(*ends));
+                if (ends == NULL)
+                        return false;
+        }
+        for (struct trie_node *i = obj->root; i && paths;
+             i                   = trie_heat_walk(i)) {
+                const uint32_t end = trie_heat_end(i);
+                if (end == 0 ||
+                    (count == paths && trie_heat_end(ends[count - 1]) >= end))
+                        continue;
+                size_t pos = count < paths ? count++ : count - 1;
+                for (; pos && trie_heat_end(ends[pos - 1]) < end; --pos)
+                        ends[pos] = ends[pos - 1];
+                ends[pos] = i;
+        }
+        struct trie_node **nodes;
+        const size_t size = trie_heat_paths(obj, ends, count, &nodes);
+        if (ends)
+                obj->deallocator(ends);
+        if (size == SIZE_MAX)
+                return false;
+
+        FILE *file = fopen(file_name, "w");
+        if (file == NULL) {
+                if (nodes)
+                        obj->deallocator(nodes);
+                return false;
+        }
+        struct trie_heat_level levels[TRIE_HEAT_LEVELS];
+        const uint64_t lookups = trie_heat(obj, levels, TRIE_HEAT_LEVELS);
+        fprintf(file, "digraph heat {\n\tlabelloc=\"t\";\n\tlabel=\"");
+        for (size_t i = 0; i < TRIE_HEAT_LEVELS && levels[i].visits; ++i)
+                fprintf(file, "level %zu: %llu visits, %.2f hops\\l", i,
+                        (unsigned long long)levels[i].visits,
+                        (double)levels[i].hops / (double)levels[i].visits);
+        fprintf(file, "\";\n\tR [label=\"%llu lookups\", shape=\"box\"];\n",
+                (unsigned long long)lookups);
+
+        uint32_t max = 1;
+        for (size_t i = 0; i < size; ++i)
+                max = nodes[i]->heat > max ? nodes[i]->heat : max;
+        for (size_t i = 0; i < size; ++i) {
+                struct trie_node *node   = nodes[i];
+                struct trie_node *parent = trie_node_get_chain_parent(node);
+                fprintf(file, "\tN%zu [label=\"", (size_t)node);
+                trie_heat_symbol(file, node->symbol);
+                fprintf(file,
+                        "\\n%u\", style=\"filled\", "
+                        "fillcolor=\"0.000 %.3f 1.000\"];\n",
+                        node->heat, (double)node->heat / max);
+                if (parent)
+                        fprintf(file, "\tN%zu -> N%zu;\n", (size_t)parent,
+                                (size_t)node);
+                else
+                        fprintf(file, "\tR -> N%zu;\n", (size_t)node);
+        }
+        fprintf(file, "}\n");
+        if (nodes)
+                obj->deallocator(nodes);
+        return fclose(file) == 0;
+}
+
+#else
+
+bool trie_set_heat(struct trie *trie, uint32_t sample)
+{
+        (void)trie;
+        (void)sample;
+        return false;
+}
+
+uint64_t trie_heat(struct trie *trie, struct trie_heat_level *levels,
+                   size_t size)
+{
+        (void)trie;
+        (void)levels;
+        (void)size;
+        return 0;
+}
+
+bool trie_export_heat(struct trie *obj, const char *file_name, size_t paths)
+{
+        (void)obj;
+        (void)file_name;
+        (void)paths;
+        return false;
+}
+
+#endif /* TRIE_HEAT */
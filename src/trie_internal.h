@@ -0,0 +1,179 @@
+/*
+ * trie_internal.h
+ * Copyright (C) 2016 DerShokus <lily.coder@gmail.com>
+ *
+ * Distributed under terms of the MIT license.
+ */
+
+#ifndef TRIE_INTERNAL_H
+#define TRIE_INTERNAL_H
+
+/*
+ * Node layout shared by the library's translation units. Not installed.
+ */
+
+#include "trie.h"
+
+#include <assert.h>
+
+struct trie_node {
+        uint8_t symbol;
+        uint32_t count; // number of keys in the subtree
+
+        struct trie_node *negative; // negative or parent node
+        bool parent;
+
+        bool data_flag;
+        bool referenced; // a hit since the clock hand passed (trie_at)
+        bool dead;       // a tombstone of a removed key (see trie_set_lazy)
+        uint32_t score; // score of the key or max score in the subtree
+#ifdef TRIE_HEAT
+        uint32_t heat; // sampled lookups through the node (see trie_set_heat)
+#endif
+        union {
+                struct trie_node *positive;
+                void *data;
+        };
+};
+
+#define TRIE_INDEX_SIZE 256
+#define TRIE_INDEX2_SIZE (256 * 256)
+#define TRIE_HUGEPAGE ((size_t)2 << 20)
+
+struct trie {
+        struct trie_node *root;
+        trie_allocator_t allocator;
+        trie_deallocator_t deallocator;
+        trie_destructor_t destructor;
+
+        // nodes kept by trie_clear for reuse (linked by negative)
+        struct trie_node *free_nodes;
+
+        // the region of nodes relocated by trie_compact
+        struct trie_node *arena;
+        size_t arena_size;  // nodes
+        size_t arena_bytes; // the mapping
+
+        // nodes of the first levels by leading bytes (see trie_root_index)
+        struct trie_node **index;
+        struct trie_node **index2;
+
+        // the write-ahead log (see trie_wal.h)
+        struct trie_wal *wal;
+
+        // nodes in use, it's exact while a trie is bounded
+        size_t nodes;
+        // stored keys (tombstones aren't counted)
+        size_t keys;
+
+        // the budget of a bounded trie (see trie_set_capacity)
+        bool bounded;
+        size_t max_keys, max_bytes;
+        trie_value_callback_t evict;
+        void *evict_ctx;
+        // the key of the next node of the clock hand
+        uint8_t *hand;
+        size_t hand_size, hand_capacity;
+
+        // lazy removal (see trie_set_lazy): tombstones and the node where
+        // the next purge starts (trie_unlink keeps it), or its key if nodes
+        // went away by subtrees
+        bool lazy;
+        size_t lazy_steps;
+        size_t dead;
+        struct trie_node *purge_node;
+        uint8_t *purge;
+        size_t purge_size, purge_capacity;
+
+        // the counting Bloom filter of keys (see trie_set_filter): blocks of
+        // 128 4-bit counters, a block is a cache line
+        uint64_t *filter;
+        void *filter_memory;
+        size_t filter_blocks;
+
+#ifdef TRIE_HEAT
+        // counters of sampled lookups (see trie_set_heat): a slot for a
+        // thread, slots are cache lines
+        struct trie_heat_slot *heat;
+        void *heat_memory;
+        uint32_t heat_sample;
+#endif
+};
+
+// Changes which are logged (trie_wal.c).
+enum trie_wal_op {
+        TRIE_WAL_INSERT = 1,
+        TRIE_WAL_INSERT_SCORED,
+        TRIE_WAL_REMOVE,
+        TRIE_WAL_REMOVE_PREFIX,
+        TRIE_WAL_CLEAR,
+};
+
+// Reserve a record of a change before it's applied, so the change can be
+// logged once it's done (see trie_wal_record).
+// Returns false if the log failed, the change mustn't be applied then.
+bool trie_wal_reserve(struct trie *obj, size_t key_size);
+
+// Log a change which has a reserved record.
+void trie_wal_record(struct trie *obj, enum trie_wal_op op, const uint8_t *key,
+                     size_t key_size, void *data, uint32_t score);
+
+// Log a change which can't fail once it's logged (a removal of a found key).
+// Returns false if the log failed, the change mustn't be applied then.
+bool trie_wal_log(struct trie *obj, enum trie_wal_op op, const uint8_t *key,
+                  size_t key_size, void *data, uint32_t score);
+
+// Log removing of the key of a node.
+bool trie_wal_log_node(struct trie *obj, struct trie_node *node);
+
+// Sync the log and detach it from a trie.
+void trie_wal_close(struct trie *obj);
+
+#ifdef TRIE_HEAT
+// Count a lookup if it's sampled (trie_heat.c).
+void trie_heat_count(const struct trie *obj, const uint8_t *key,
+                     size_t key_size);
+#endif
+
+static inline struct trie_node *trie_node_get_parent(struct trie_node *node)
+{
+        assert(node != NULL);
+        return node->parent ? node->negative : NULL;
+}
+
+static inline struct trie_node *trie_node_get_negative(struct trie_node *node)
+{
+        assert(node != NULL);
+
+        return node->parent ? NULL : node->negative;
+}
+
+static inline struct trie_node *trie_node_get_positive(struct trie_node *node)
+{
+        assert(node != NULL);
+
+        return node->data_flag ? NULL : node->positive;
+}
+
+static inline struct trie_node *
+trie_node_get_chain_parent(struct trie_node *node)
+{
+        assert(node != NULL);
+
+        while (trie_node_get_negative(node)) {
+                node = trie_node_get_negative(node);
+        }
+        return trie_node_get_parent(node);
+}
+
+static inline struct trie_node *begin(struct trie_node *node)
+{
+        assert(node != NULL);
+
+        for (struct trie_node *positive = trie_node_get_positive(node);
+             positive; positive         = trie_node_get_positive(positive))
+                node = positive;
+        return node;
+}
+
+#endif /* !TRIE_INTERNAL_H */
@@ -0,0 +1,128 @@
+/*
+ * trie_load.c
+ * Copyright (C) 2016 DerShokus <lily.coder@gmail.com>
+ *
+ * Distributed under terms of the MIT license.
+ */
+
+#define _GNU_SOURCE
+
+#include "trie.h"
+#include "trie_internal.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static bool trie_load_value(const uint8_t *begin, const uint8_t *end,
+                            void **value)
+{
+        if (begin == end)
+                return false;
+
+        uintptr_t res = 0;
+        for (; begin != end; ++begin) {
+                if (*begin < '0' || *begin > '9')
+                        return false;
+                const uintptr_t digit = (uintptr_t)(*begin - '0');
+                // a value has to fit in a pointer
+                if (res > (UINTPTR_MAX - digit) / 10)
+                        return false;
+                res = res * 10 + digit;
+        }
+        *value = (void *)res;
+        return true;
+}
+
+// A line is [begin, end), the end is the delimiter or the end of a file.
+static bool trie_load_line(struct trie *trie, const uint8_t *begin,
+                           const uint8_t *end, uint8_t delimiter, bool last,
+                           size_t line, unsigned int flags)
+{
+        const uint8_t *key_end = end;
+        void *value            = NULL, *old;
+
+        if (begin == end)
+                return true;
+        if (flags & TRIE_LOAD_VALUES) {
+                key_end = memrchr(begin, '\t', (size_t)(end - begin));
+                if (key_end == NULL ||
+                    !trie_load_value(key_end + 1, end, &value))
+                        return false;
+        } else if (flags & TRIE_LOAD_LINE_NUMBERS) {
+                value = (void *)(uintptr_t)line;
+        }
+
+        size_t key_size = (size_t)(key_end - begin);
+        if (key_size == 0)
+                return true;
+        if (!(flags & TRIE_LOAD_TERMINATED))
+                return trie_insert(trie, begin, key_size, value, &old);
+        // the delimiter follows the key in the file
+        if (key_end == end && !last)
+                return trie_insert(trie, begin, key_size + 1, value, &old);
+
+        // the last line hasn't a delimiter to keep, a tab follows a key of
+        // a value
+        uint8_t buf[256];
+        uint8_t *key = key_size < sizeof(buf) ? buf
+                                              : trie->allocator(key_size + 1);
+        if (key == NULL)
+                return false;
+        memcpy(key, begin, key_size);
+        key[key_size]  = delimiter;
+        const bool res = trie_insert(trie, key, key_size + 1, value, &old);
+        if (key != buf)
+                trie->deallocator(key);
+        return res;
+}
+
+bool trie_load_file(struct trie *trie, const char *path, uint8_t delimiter,
+                    unsigned int flags, size_t *lines)
+{
+        if (lines)
+                *lines = 0;
+        if (trie == NULL || path == NULL)
+                return false;
+
+        const int fd = open(path, O_RDONLY);
+        if (fd < 0)
+                return false;
+        struct stat st;
+        // only a regular file has its size to be mapped, a pipe or a file
+        // of /proc looks empty
+        if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+                close(fd);
+                return false;
+        }
+        const size_t size = (size_t)st.st_size;
+        if (size == 0) {
+                close(fd);
+                return true;
+        }
+        uint8_t *map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (map == MAP_FAILED)
+                return false;
+        madvise(map, size, MADV_SEQUENTIAL);
+
+        // memchr of libc is vectorized
+        bool res    = true;
+        size_t line = 0;
+        for (const uint8_t *pos = map, *end = map + size; pos < end;
+             ++line) {
+                const uint8_t *next =
+                    memchr(pos, delimiter, (size_t)(end - pos));
+                res = trie_load_line(trie, pos, next ? next : end, delimiter,
+                                     next == NULL, line, flags);
+                if (!res)
+                        break;
+                pos = next ? next + 1 : end;
+        }
+
+        munmap(map, size);
+        if (lines)
+                *lines = line;
+        return res;
+}
@@ -0,0 +1,361 @@
+/*
+ * trie_shm.c
+ * Copyright (C) 2016 DerShokus <lily.coder@gmail.com>
+ *
+ * Distributed under terms of the MIT license.
+ */
+
+#include "trie_shm.h"
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+
+// The region starts with the header, nodes follow it. A node is referred by
+// its number, 0 is NULL (the first node isn't used). Children of a node are
+// a chain of siblings in the order of insertion like in struct trie.
+//
+// Readers load fields which writers change by relaxed atomics and check the
+// sequence number after a lookup: it's odd while a writer changes the trie
+// and grows by every change. A lookup which overlaps a change may follow
+// a freed node, so numbers are checked against the region and sibling hops
+// are bounded: it can't crash or hang, it's retried.
+
+#define TRIE_SHM_MAGIC 0x316d687365697274ull // "trieshm1"
+#define TRIE_SHM_SYMBOLS 256
+
+struct trie_shm_node {
+        uint32_t child; // the first child
+        uint32_t next;  // the next sibling (or the next free node)
+        uint8_t symbol;
+        uint8_t data_flag;
+        uint64_t value;
+};
+
+struct trie_shm_header {
+        uint64_t magic;
+        uint64_t size; // bytes of the region
+        uint32_t seq;  // odd while a writer changes the trie
+        pthread_mutex_t lock;
+        uint32_t root;     // the first node of the root chain
+        uint32_t capacity; // nodes which fit the region (with node 0)
+        uint32_t top;      // the first node which has never been used
+        uint32_t free;     // freed nodes linked by next
+        uint32_t free_count;
+        uint64_t count; // keys
+};
+
+// A handle of a process: the addresses of the mapping.
+struct trie_shm {
+        struct trie_shm_header *header;
+        struct trie_shm_node *nodes;
+};
+
+#define TRIE_SHM_HEADER_SIZE                                                   \
+        ((sizeof(struct trie_shm_header) + 63) & ~(size_t)63)
+
+static inline uint32_t trie_shm_get(const uint32_t *link)
+{
+        return __atomic_load_n(link, __ATOMIC_RELAXED);
+}
+
+static inline void trie_shm_set(uint32_t *link, uint32_t node)
+{
+        __atomic_store_n(link, node, __ATOMIC_RELAXED);
+}
+
+static struct trie_shm *trie_shm_handle(void *region)
+{
+        struct trie_shm *obj = malloc(sizeof(*obj));
+        if (obj) {
+                obj->header = region;
+                obj->nodes  = (struct trie_shm_node *)((uint8_t *)region +
+                                                      TRIE_SHM_HEADER_SIZE);
+        }
+        return obj;
+}
+
+static void trie_shm_lock(struct trie_shm *obj)
+{
+        struct trie_shm_header *header = obj->header;
+        pthread_mutex_lock(&header->lock);
+        __atomic_store_n(&header->seq, header->seq + 1, __ATOMIC_RELAXED);
+        __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+static void trie_shm_unlock(struct trie_shm *obj)
+{
+        struct trie_shm_header *header = obj->header;
+        __atomic_store_n(&header->seq, header->seq + 1, __ATOMIC_RELEASE);
+        pthread_mutex_unlock(&header->lock);
+}
+
+static uint32_t trie_shm_node_new(struct trie_shm *obj, uint8_t symbol)
+{
+        struct trie_shm_header *header = obj->header;
+        uint32_t node                  = header->free;
+        if (node) {
+                header->free = obj->nodes[node].next;
+                --header->free_count;
+        } else {
+                node = header->top++;
+        }
+        struct trie_shm_node *i = &obj->nodes[node];
+        trie_shm_set(&i->child, 0);
+        trie_shm_set(&i->next, 0);
+        __atomic_store_n(&i->symbol, symbol, __ATOMIC_RELAXED);
+        __atomic_store_n(&i->data_flag, 0, __ATOMIC_RELAXED);
+        return node;
+}
+
+// Free a chain of sole children.
+static void trie_shm_free_chain(struct trie_shm *obj, uint32_t node)
+{
+        struct trie_shm_header *header = obj->header;
+        while (node) {
+                const uint32_t child = obj->nodes[node].child;
+                trie_shm_set(&obj->nodes[node].next, header->free);
+                header->free = node;
+                ++header->free_count;
+                node = child;
+        }
+}
+
+// Find the link to the node with the symbol in a chain or the link which
+// ends the chain (writers only).
+static uint32_t *trie_shm_slot(struct trie_shm *obj, uint32_t *link,
+                               uint8_t symbol)
+{
+        while (*link && obj->nodes[*link].symbol != symbol)
+                link = &obj->nodes[*link].next;
+        return link;
+}
+
+// A lookup which may overlap a change (see above).
+// Returns true if the key was found.
+static bool trie_shm_find(const struct trie_shm *obj, const uint8_t *key,
+                          size_t key_size, uint64_t *value)
+{
+        const uint32_t capacity = obj->header->capacity;
+        uint32_t node           = trie_shm_get(&obj->header->root);
+        for (size_t i = 0;; node = trie_shm_get(&obj->nodes[node].child)) {
+                for (size_t hops = 0; node; ++hops) {
+                        if (node >= capacity || hops == TRIE_SHM_SYMBOLS)
+                                return false;
+                        const struct trie_shm_node *n = &obj->nodes[node];
+                        if (__atomic_load_n(&n->symbol, __ATOMIC_RELAXED) ==
+                            key[i])
+                                break;
+                        node = trie_shm_get(&n->next);
+                }
+                if (node == 0 || node >= capacity)
+                        return false;
+                const struct trie_shm_node *n = &obj->nodes[node];
+                const bool data =
+                    __atomic_load_n(&n->data_flag, __ATOMIC_RELAXED);
+                if (++i == key_size) {
+                        if (data)
+                                *value = __atomic_load_n(&n->value,
+                                                         __ATOMIC_RELAXED);
+                        return data;
+                }
+                if (data)
+                        return false;
+        }
+}
+
+// +--------------------------------------------------------------------------+
+// | Public functions                                                         |
+// +--------------------------------------------------------------------------+
+
+struct trie_shm *trie_shm_create(void *region, size_t size)
+{
+        if (region == NULL || (uintptr_t)region % 8 ||
+            size < TRIE_SHM_HEADER_SIZE + 2 * sizeof(struct trie_shm_node))
+                return NULL;
+
+        struct trie_shm_header *header = region;
+        memset(header, 0, sizeof(*header));
+        pthread_mutexattr_t attr;
+        if (pthread_mutexattr_init(&attr) != 0)
+                return NULL;
+        const bool shared =
+            pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED) == 0 &&
+            pthread_mutex_init(&header->lock, &attr) == 0;
+        pthread_mutexattr_destroy(&attr);
+        if (!shared)
+                return NULL;
+
+        size_t capacity =
+            (size - TRIE_SHM_HEADER_SIZE) / sizeof(struct trie_shm_node);
+        if (capacity > UINT32_MAX)
+                capacity = UINT32_MAX;
+        header->size     = size;
+        header->capacity = (uint32_t)capacity;
+        header->top      = 1;
+        // the magic goes last: the region has a trie from now
+        __atomic_store_n(&header->magic, TRIE_SHM_MAGIC, __ATOMIC_RELEASE);
+        return trie_shm_handle(region);
+}
+
+struct trie_shm *trie_shm_attach(void *region, size_t size)
+{
+        if (region == NULL || (uintptr_t)region % 8 ||
+            size < TRIE_SHM_HEADER_SIZE)
+                return NULL;
+        const struct trie_shm_header *header = region;
+        if (__atomic_load_n(&header->magic, __ATOMIC_ACQUIRE) !=
+                TRIE_SHM_MAGIC ||
+            header->size != size)
+                return NULL;
+        return trie_shm_handle(region);
+}
+
+void trie_shm_detach(struct trie_shm **obj)
+{
+        if (obj == NULL || *obj == NULL)
+                return;
+        free(*obj);
+        *obj = NULL;
+}
+
+bool trie_shm_insert(struct trie_shm *obj, const uint8_t *key,
+                     const size_t key_size, uint64_t value, uint64_t *old)
+{
+        if (old)
+                *old = 0;
+        if (obj == NULL || key == NULL || key_size == 0)
+                return false;
+
+        trie_shm_lock(obj);
+        struct trie_shm_header *header = obj->header;
+        uint32_t *link                 = &header->root;
+        bool res                       = false;
+        for (size_t i = 0; i < key_size; ++i) {
+                link = trie_shm_slot(obj, link, key[i]);
+                if (*link == 0) {
+                        // the rest of the key is a new chain, it's linked
+                        // when it's ready
+                        const size_t need = key_size - i;
+                        if (need > header->capacity - header->top +
+                                       (size_t)header->free_count)
+                                break;
+                        const uint32_t first = trie_shm_node_new(obj, key[i]);
+                        uint32_t last        = first;
+                        for (size_t j = i + 1; j < key_size; ++j) {
+                                const uint32_t node =
+                                    trie_shm_node_new(obj, key[j]);
+                                trie_shm_set(&obj->nodes[last].child, node);
+                                last = node;
+                        }
+                        struct trie_shm_node *leaf = &obj->nodes[last];
+                        __atomic_store_n(&leaf->value, value,
+                                         __ATOMIC_RELAXED);
+                        __atomic_store_n(&leaf->data_flag, 1,
+                                         __ATOMIC_RELAXED);
+                        trie_shm_set(link, first);
+                        __atomic_store_n(&header->count, header->count + 1,
+                                         __ATOMIC_RELAXED);
+                        res = true;
+                        break;
+                }
+
+                // a key can't be a prefix of another one
+                struct trie_shm_node *node = &obj->nodes[*link];
+                if (i + 1 == key_size && node->data_flag) {
+                        if (old)
+                                *old = node->value;
+                        __atomic_store_n(&node->value, value,
+                                         __ATOMIC_RELAXED);
+                        res = true;
+                }
+                if (node->data_flag)
+                        break;
+                link = &node->child;
+        }
+        trie_shm_unlock(obj);
+        return res;
+}
+
+bool trie_shm_at(const struct trie_shm *obj, const uint8_t *key,
+                 const size_t key_size, uint64_t *value)
+{
+        if (obj == NULL || key == NULL || key_size == 0 || value == NULL)
+                return false;
+
+        const uint32_t *seq = &obj->header->seq;
+        for (;;) {
+                const uint32_t begin = __atomic_load_n(seq, __ATOMIC_ACQUIRE);
+                if (begin & 1) {
+                        sched_yield();
+                        continue;
+                }
+                uint64_t found_value = 0;
+                const bool found =
+                    trie_shm_find(obj, key, key_size, &found_value);
+                __atomic_thread_fence(__ATOMIC_ACQUIRE);
+                if (__atomic_load_n(seq, __ATOMIC_RELAXED) == begin) {
+                        if (found)
+                                *value = found_value;
+                        return found;
+                }
+        }
+}
+
+bool trie_shm_remove(struct trie_shm *obj, const uint8_t *key,
+                     const size_t key_size, uint64_t *value)
+{
+        if (obj == NULL || key == NULL || key_size == 0)
+                return false;
+
+        trie_shm_lock(obj);
+        struct trie_shm_header *header = obj->header;
+        // the link to the first node which leads only to the key: nodes
+        // below it are sole children
+        uint32_t *link = &header->root, *cut = link;
+        bool res       = false;
+        for (size_t i = 0; i < key_size; ++i) {
+                uint32_t *slot = trie_shm_slot(obj, link, key[i]);
+                if (*slot == 0)
+                        break;
+                struct trie_shm_node *node = &obj->nodes[*slot];
+                if (slot != link || node->next)
+                        cut = slot;
+                if (i + 1 == key_size && node->data_flag) {
+                        if (value)
+                                *value = node->value;
+                        res = true;
+                }
+                if (node->data_flag)
+                        break;
+                link = &node->child;
+        }
+        if (res) {
+                const uint32_t node = *cut;
+                trie_shm_set(cut, obj->nodes[node].next);
+                trie_shm_free_chain(obj, node);
+                __atomic_store_n(&header->count, header->count - 1,
+                                 __ATOMIC_RELAXED);
+        }
+        trie_shm_unlock(obj);
+        return res;
+}
+
+size_t trie_shm_size(const struct trie_shm *obj)
+{
+        if (obj == NULL)
+                return 0;
+        return (size_t)__atomic_load_n(&obj->header->count, __ATOMIC_RELAXED);
+}
+
+size_t trie_shm_used(const struct trie_shm *obj)
+{
+        if (obj == NULL)
+                return 0;
+        struct trie_shm_header *header = obj->header;
+        pthread_mutex_lock(&header->lock);
+        const size_t nodes = (size_t)header->top - header->free_count;
+        pthread_mutex_unlock(&header->lock);
+        return TRIE_SHM_HEADER_SIZE + nodes * sizeof(struct trie_shm_node);
+}
@@ -0,0 +1,744 @@
+/*
+ * trie_wal.c
+ * Copyright (C) 2016 DerShokus <lily.coder@gmail.com>
+ *
+ * Distributed under terms of the MIT license.
+ */
+
+#define _GNU_SOURCE
+
+#include "trie_wal.h"
+#include "trie_internal.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+// A log record: crc and size of the payload, then the payload: sequence,
+// op, score, value, key size and the key. Numbers are in the host order.
+#define TRIE_WAL_HEADER 8
+#define TRIE_WAL_PAYLOAD (8 + 1 + 4 + 8 + 4)
+
+// An image: magic and sequence of the last logged change, then records
+// (key size, score, value, key), the end mark, the number of keys and crc.
+#define TRIE_WAL_MAGIC "TRIECKP1"
+#define TRIE_WAL_END UINT32_MAX
+
+#define TRIE_WAL_CHECKPOINT "checkpoint"
+#define TRIE_WAL_CHECKPOINT_TMP "checkpoint.tmp"
+
+struct trie_wal {
+        char dir[PATH_MAX];
+        struct trie_wal_config config;
+        int fd;            // the current log
+        uint64_t sequence; // of the last record
+        bool failed;
+
+        // records which aren't written yet
+        uint8_t *buf;
+        size_t size;
+        size_t capacity;
+        size_t records;
+        uint64_t group_start; // ms
+
+        // a key for trie_wal_log_node
+        uint8_t *key;
+        size_t key_capacity;
+
+        pid_t checkpoint;             // a running checkpoint
+        uint64_t checkpoint_sequence; // the last change of its image
+};
+
+// +--------------------------------------------------------------------------+
+// | Files                                                                    |
+// +--------------------------------------------------------------------------+
+
+static uint32_t crc_table[256];
+
+// CRC-32 (IEEE), crc of a previous part continues the sum
+static uint32_t trie_wal_crc(uint32_t crc, const uint8_t *buf, size_t size)
+{
+        if (crc_table[1] == 0) {
+                for (uint32_t i = 0; i < 256; ++i) {
+                        uint32_t c = i;
+                        for (int k = 0; k < 8; ++k)
+                                c = c & 1 ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+                        crc_table[i] = c;
+                }
+        }
+
+        crc = ~crc;
+        for (size_t i = 0; i < size; ++i)
+                crc = crc_table[(crc ^ buf[i]) & 0xff] ^ (crc >> 8);
+        return ~crc;
+}
+
+static uint64_t trie_wal_now(void)
+{
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return (uint64_t)ts.tv_sec * 1000 + (uint64_t)ts.tv_nsec / 1000000;
+}
+
+// Returns false if the path is longer than PATH_MAX.
+static bool trie_wal_path(const char *dir, const char *name, char *path)
+{
+        const int size = snprintf(path, PATH_MAX, "%s/%s", dir, name);
+        return size >= 0 && size < PATH_MAX;
+}
+
+static bool trie_wal_log_path(const char *dir, uint64_t start, char *path)
+{
+        const int size =
+            snprintf(path, PATH_MAX, "%s/log.%016" PRIx64, dir, start);
+        return size >= 0 && size < PATH_MAX;
+}
+
+// Parse a log name, start is the sequence of its first record.
+static bool trie_wal_log_name(const char *name, uint64_t *start)
+{
+        if (strncmp(name, "log.", 4) != 0 || name[4] == '\0')
+                return false;
+        char *end;
+        *start = strtoull(&name[4], &end, 16);
+        return *end == '\0';
+}
+
+// Make names of a directory durable.
+static bool trie_wal_sync_dir(const char *dir)
+{
+        const int fd = open(dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (fd < 0)
+                return false;
+        const bool res = fsync(fd) == 0;
+        close(fd);
+        return res;
+}
+
+static bool trie_wal_write_all(int fd, const uint8_t *buf, size_t size)
+{
+        while (size) {
+                const ssize_t written = write(fd, buf, size);
+                if (written < 0 && errno == EINTR)
+                        continue;
+                if (written <= 0)
+                        return false;
+                buf += written;
+                size -= (size_t)written;
+        }
+        return true;
+}
+
+static int cmp_sequence(const void *a, const void *b)
+{
+        const uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+        return x < y ? -1 : x > y ? 1 : 0;
+}
+
+// Starts of logs of a directory in the ascending order.
+// Returns the number of logs or -1 if the operation failed.
+static ssize_t trie_wal_list(struct trie *obj, const char *dir,
+                             uint64_t **starts)
+{
+        DIR *dirp = opendir(dir);
+        if (dirp == NULL)
+                return -1;
+
+        size_t count = 0;
+        uint64_t start;
+        for (struct dirent *i = readdir(dirp); i; i = readdir(dirp))
+                count += trie_wal_log_name(i->d_name, &start);
+
+        *starts = obj->allocator((count + 1) * sizeof(**starts));
+        if (*starts == NULL) {
+                closedir(dirp);
+                return -1;
+        }
+        rewinddir(dirp);
+        size_t size = 0;
+        for (struct dirent *i = readdir(dirp); i && size < count;
+             i               = readdir(dirp)) {
+                if (trie_wal_log_name(i->d_name, &start))
+                        (*starts)[size++] = start;
+        }
+        closedir(dirp);
+
+        qsort(*starts, size, sizeof(**starts), cmp_sequence);
+        return (ssize_t)size;
+}
+
+// Remove logs which an image covers.
+static void trie_wal_remove_logs(struct trie *obj, uint64_t sequence)
+{
+        const struct trie_wal *wal = obj->wal;
+        uint64_t *starts;
+        const ssize_t count = trie_wal_list(obj, wal->dir, &starts);
+        if (count < 0)
+                return;
+
+        char path[PATH_MAX];
+        for (ssize_t i = 0; i < count; ++i) {
+                if (starts[i] <= sequence &&
+                    trie_wal_log_path(wal->dir, starts[i], path))
+                        unlink(path);
+        }
+        obj->deallocator(starts);
+}
+
+// Start a new log after the last record.
+static bool trie_wal_open(struct trie_wal *wal)
+{
+        char path[PATH_MAX];
+        wal->fd = -1;
+        if (trie_wal_log_path(wal->dir, wal->sequence + 1, path))
+                wal->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_APPEND |
+                                         O_CLOEXEC,
+                               0644);
+        if (wal->fd < 0 || !trie_wal_sync_dir(wal->dir))
+                wal->failed = true;
+        return !wal->failed;
+}
+
+// Write and sync the current group.
+static bool trie_wal_flush(struct trie_wal *wal)
+{
+        if (wal->failed || wal->size == 0)
+                return !wal->failed;
+        if (!trie_wal_write_all(wal->fd, wal->buf, wal->size) ||
+            fdatasync(wal->fd) != 0)
+                wal->failed = true;
+        wal->size    = 0;
+        wal->records = 0;
+        return !wal->failed;
+}
+
+// Check a running checkpoint, logs before its image go away if it's done.
+// Returns false if the checkpoint failed.
+static bool trie_wal_reap(struct trie *obj, bool wait)
+{
+        struct trie_wal *wal = obj->wal;
+        if (wal->checkpoint == 0)
+                return true;
+
+        int status;
+        pid_t pid;
+        do {
+                pid = waitpid(wal->checkpoint, &status, wait ? 0 : WNOHANG);
+        } while (pid < 0 && errno == EINTR);
+        if (pid == 0)
+                return true;
+
+        wal->checkpoint = 0;
+        if (pid < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0)
+                return false;
+        trie_wal_remove_logs(obj, wal->checkpoint_sequence);
+        return true;
+}
+
+// +--------------------------------------------------------------------------+
+// | Images                                                                   |
+// +--------------------------------------------------------------------------+
+
+// An image is written by a forked child, a child of a multithreaded process
+// can't call malloc (or stdio): its buffers are mapped before fork and the
+// key buffer grows by mremap.
+struct trie_wal_image {
+        char tmp[PATH_MAX], path[PATH_MAX];
+        int fd;
+        uint32_t crc;
+        uint8_t *buf;
+        size_t size;
+        uint8_t *key;
+        size_t key_capacity;
+};
+
+#define TRIE_WAL_IMAGE_BUF ((size_t)1 << 20)
+
+static void *trie_wal_image_map(size_t size)
+{
+        void *res = mmap(NULL, size, PROT_READ | PROT_WRITE,
+                         MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        return res == MAP_FAILED ? NULL : res;
+}
+
+static void trie_wal_image_free(struct trie_wal_image *image)
+{
+        if (image->buf)
+                munmap(image->buf, TRIE_WAL_IMAGE_BUF);
+        if (image->key)
+                munmap(image->key, image->key_capacity);
+}
+
+static bool trie_wal_image_new(struct trie_wal_image *image, const char *dir)
+{
+        memset(image, 0, sizeof(*image));
+        image->fd           = -1;
+        image->key_capacity = 4096;
+        image->buf          = trie_wal_image_map(TRIE_WAL_IMAGE_BUF);
+        image->key          = trie_wal_image_map(image->key_capacity);
+        if (image->buf && image->key &&
+            trie_wal_path(dir, TRIE_WAL_CHECKPOINT_TMP, image->tmp) &&
+            trie_wal_path(dir, TRIE_WAL_CHECKPOINT, image->path))
+                return true;
+        trie_wal_image_free(image);
+        return false;
+}
+
+static bool trie_wal_image_flush(struct trie_wal_image *image)
+{
+        const bool res = trie_wal_write_all(image->fd, image->buf, image->size);
+        image->size    = 0;
+        return res;
+}
+
+// Append bytes which aren't summed by crc.
+static bool trie_wal_append(struct trie_wal_image *image, const void *buf,
+                            size_t size)
+{
+        if (image->size + size > TRIE_WAL_IMAGE_BUF) {
+                if (!trie_wal_image_flush(image))
+                        return false;
+                if (size > TRIE_WAL_IMAGE_BUF)
+                        return trie_wal_write_all(image->fd, buf, size);
+        }
+        memcpy(&image->buf[image->size], buf, size);
+        image->size += size;
+        return true;
+}
+
+static bool trie_wal_put(struct trie_wal_image *image, const void *buf,
+                         size_t size)
+{
+        image->crc = trie_wal_crc(image->crc, buf, size);
+        return trie_wal_append(image, buf, size);
+}
+
+static bool trie_wal_put_keys(struct trie *obj, struct trie_wal_image *image)
+{
+        bool res       = true;
+        uint64_t count = 0;
+        for (struct trie_node *i = trie_begin(obj); i && res;
+             i                   = trie_next(i), ++count) {
+                size_t size = trie_key(i, image->key, image->key_capacity);
+                if (size > image->key_capacity) {
+                        void *key = mremap(image->key, image->key_capacity,
+                                           size * 2, MREMAP_MAYMOVE);
+                        if (key == MAP_FAILED)
+                                return false;
+                        image->key          = key;
+                        image->key_capacity = size * 2;
+                        trie_key(i, image->key, image->key_capacity);
+                }
+
+                void *data;
+                uint32_t score;
+                trie_data(i, &data);
+                trie_score(i, &score);
+                const uint32_t key_size = (uint32_t)size;
+                const uint64_t value    = (uintptr_t)data;
+                res = trie_wal_put(image, &key_size, sizeof(key_size)) &&
+                      trie_wal_put(image, &score, sizeof(score)) &&
+                      trie_wal_put(image, &value, sizeof(value)) &&
+                      trie_wal_put(image, image->key, size);
+        }
+
+        const uint32_t end = TRIE_WAL_END;
+        return res && trie_wal_put(image, &end, sizeof(end)) &&
+               trie_wal_put(image, &count, sizeof(count));
+}
+
+// Write the image of a trie which includes changes up to the sequence.
+static bool trie_wal_write_image(struct trie *obj, struct trie_wal_image *image,
+                                 const char *dir, uint64_t sequence)
+{
+        image->fd = open(image->tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+                         0644);
+        if (image->fd < 0)
+                return false;
+
+        image->crc  = 0;
+        image->size = 0;
+        bool res    = trie_wal_put(image, TRIE_WAL_MAGIC, 8) &&
+                   trie_wal_put(image, &sequence, sizeof(sequence)) &&
+                   trie_wal_put_keys(obj, image);
+        const uint32_t crc = image->crc;
+        res = res && trie_wal_append(image, &crc, sizeof(crc)) &&
+              trie_wal_image_flush(image) && fsync(image->fd) == 0;
+        res       = close(image->fd) == 0 && res;
+        image->fd = -1;
+
+        // the new image replaces the old one at once
+        if (!res || rename(image->tmp, image->path) != 0) {
+                unlink(image->tmp);
+                return false;
+        }
+        return trie_wal_sync_dir(dir);
+}
+
+// Map a whole file. Returns false if it's missing or empty.
+static bool trie_wal_map(const char *path, const uint8_t **buf, size_t *size)
+{
+        const int fd = open(path, O_RDONLY | O_CLOEXEC);
+        if (fd < 0)
+                return false;
+        struct stat st;
+        if (fstat(fd, &st) != 0 || st.st_size == 0) {
+                close(fd);
+                return false;
+        }
+        *size = (size_t)st.st_size;
+        *buf  = mmap(NULL, *size, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (*buf == MAP_FAILED)
+                return false;
+        madvise((void *)*buf, *size, MADV_SEQUENTIAL);
+        return true;
+}
+
+// Load the image of a directory if there is one.
+static bool trie_wal_read_image(struct trie *obj, const char *dir,
+                                uint64_t *sequence)
+{
+        char path[PATH_MAX];
+        *sequence = 0;
+        if (!trie_wal_path(dir, TRIE_WAL_CHECKPOINT, path))
+                return false;
+
+        const uint8_t *buf;
+        size_t size;
+        if (!trie_wal_map(path, &buf, &size))
+                return access(path, F_OK) != 0;
+
+        // magic, sequence, end mark, count and crc at least
+        bool res = size >= 8 + 8 + 4 + 8 + 4 &&
+                   memcmp(buf, TRIE_WAL_MAGIC, 8) == 0;
+        if (res) {
+                uint32_t crc;
+                memcpy(&crc, &buf[size - sizeof(crc)], sizeof(crc));
+                res = crc == trie_wal_crc(0, buf, size - sizeof(crc));
+        }
+        if (!res) {
+                munmap((void *)buf, size);
+                return false;
+        }
+        memcpy(sequence, &buf[8], sizeof(*sequence));
+
+        const uint8_t *pos = &buf[16], *end = &buf[size - 4 - 8 - 4];
+        for (;;) {
+                uint32_t key_size, score;
+                uint64_t value;
+                memcpy(&key_size, pos, sizeof(key_size));
+                if (key_size == TRIE_WAL_END)
+                        break;
+                if ((size_t)(end - pos) < 16 + (size_t)key_size) {
+                        res = false;
+                        break;
+                }
+                memcpy(&score, &pos[4], sizeof(score));
+                memcpy(&value, &pos[8], sizeof(value));
+                void *old;
+                if (!trie_insert_scored(obj, &pos[16], key_size,
+                                        (void *)(uintptr_t)value, score,
+                                        &old)) {
+                        res = false;
+                        break;
+                }
+                pos += 16 + key_size;
+        }
+        res = res && pos == end;
+
+        munmap((void *)buf, size);
+        return res;
+}
+
+static void trie_wal_apply(struct trie *obj, uint8_t op, const uint8_t *key,
+                           size_t key_size, void *data, uint32_t score)
+{
+        void *old;
+        switch (op) {
+        case TRIE_WAL_INSERT:
+                trie_insert(obj, key, key_size, data, &old);
+                break;
+        case TRIE_WAL_INSERT_SCORED:
+                trie_insert_scored(obj, key, key_size, data, score, &old);
+                break;
+        case TRIE_WAL_REMOVE:
+                trie_remove(obj, key, key_size, &old);
+                break;
+        case TRIE_WAL_REMOVE_PREFIX:
+                trie_remove_prefix(obj, key, key_size, NULL, NULL, 0);
+                break;
+        case TRIE_WAL_CLEAR:
+                trie_clear(obj);
+                break;
+        }
+}
+
+// Replay records of a log which follow the sequence (of the image or
+// previous logs). A torn or broken record ends the log.
+static void trie_wal_replay(struct trie *obj, const char *path,
+                            uint64_t *sequence)
+{
+        const uint8_t *buf;
+        size_t size;
+        if (!trie_wal_map(path, &buf, &size))
+                return;
+
+        uint64_t last = 0;
+        for (size_t pos = 0; size - pos >= TRIE_WAL_HEADER;) {
+                uint32_t crc, payload_size;
+                memcpy(&crc, &buf[pos], sizeof(crc));
+                memcpy(&payload_size, &buf[pos + 4], sizeof(payload_size));
+                const uint8_t *payload = &buf[pos + TRIE_WAL_HEADER];
+                if (payload_size < TRIE_WAL_PAYLOAD ||
+                    size - pos - TRIE_WAL_HEADER < payload_size ||
+                    crc != trie_wal_crc(0, payload, payload_size))
+                        break;
+
+                uint64_t record, value;
+                uint32_t score, key_size;
+                memcpy(&record, payload, sizeof(record));
+                memcpy(&score, &payload[9], sizeof(score));
+                memcpy(&value, &payload[13], sizeof(value));
+                memcpy(&key_size, &payload[21], sizeof(key_size));
+                if (key_size != payload_size - TRIE_WAL_PAYLOAD ||
+                    record <= last)
+                        break;
+                last = record;
+                if (record > *sequence) {
+                        trie_wal_apply(obj, payload[8],
+                                       &payload[TRIE_WAL_PAYLOAD], key_size,
+                                       (void *)(uintptr_t)value, score);
+                        *sequence = record;
+                }
+                pos += TRIE_WAL_HEADER + payload_size;
+        }
+        munmap((void *)buf, size);
+}
+
+// +--------------------------------------------------------------------------+
+// | Internal functions                                                       |
+// +--------------------------------------------------------------------------+
+
+bool trie_wal_reserve(struct trie *obj, size_t key_size)
+{
+        struct trie_wal *wal = obj->wal;
+        if (wal->failed)
+                return false;
+        trie_wal_reap(obj, false);
+
+        const size_t need = TRIE_WAL_HEADER + TRIE_WAL_PAYLOAD + key_size;
+        if (wal->size + need > wal->capacity) {
+                size_t capacity = wal->capacity * 2;
+                while (capacity < wal->size + need)
+                        capacity *= 2;
+                uint8_t *buf = obj->allocator(capacity);
+                if (buf == NULL) {
+                        wal->failed = true;
+                        return false;
+                }
+                memcpy(buf, wal->buf, wal->size);
+                obj->deallocator(wal->buf);
+                wal->buf      = buf;
+                wal->capacity = capacity;
+        }
+        return true;
+}
+
+void trie_wal_record(struct trie *obj, enum trie_wal_op op, const uint8_t *key,
+                     size_t key_size, void *data, uint32_t score)
+{
+        struct trie_wal *wal = obj->wal;
+        const size_t need    = TRIE_WAL_HEADER + TRIE_WAL_PAYLOAD + key_size;
+
+        uint8_t *record             = &wal->buf[wal->size];
+        uint8_t *payload            = &record[TRIE_WAL_HEADER];
+        const uint64_t sequence     = wal->sequence + 1;
+        const uint64_t value        = (uintptr_t)data;
+        const uint32_t size         = (uint32_t)key_size;
+        const uint32_t payload_size = (uint32_t)(TRIE_WAL_PAYLOAD + key_size);
+        memcpy(payload, &sequence, sizeof(sequence));
+        payload[8] = (uint8_t)op;
+        memcpy(&payload[9], &score, sizeof(score));
+        memcpy(&payload[13], &value, sizeof(value));
+        memcpy(&payload[21], &size, sizeof(size));
+        if (key_size)
+                memcpy(&payload[TRIE_WAL_PAYLOAD], key, key_size);
+        const uint32_t crc = trie_wal_crc(0, payload, payload_size);
+        memcpy(record, &crc, sizeof(crc));
+        memcpy(&record[4], &payload_size, sizeof(payload_size));
+        wal->size += need;
+        wal->sequence = sequence;
+
+        // group commit, a failed write is reported by trie_wal_sync
+        const uint64_t now = trie_wal_now();
+        if (wal->records++ == 0)
+                wal->group_start = now;
+        if (wal->records >= wal->config.group_records ||
+            now - wal->group_start >= wal->config.group_msec)
+                trie_wal_flush(wal);
+}
+
+bool trie_wal_log(struct trie *obj, enum trie_wal_op op, const uint8_t *key,
+                  size_t key_size, void *data, uint32_t score)
+{
+        if (!trie_wal_reserve(obj, key_size))
+                return false;
+        trie_wal_record(obj, op, key, key_size, data, score);
+        return true;
+}
+
+bool trie_wal_log_node(struct trie *obj, struct trie_node *node)
+{
+        struct trie_wal *wal = obj->wal;
+        size_t size          = trie_key(node, wal->key, wal->key_capacity);
+        if (size > wal->key_capacity) {
+                obj->deallocator(wal->key);
+                wal->key_capacity = size * 2;
+                wal->key          = obj->allocator(wal->key_capacity);
+                if (wal->key == NULL) {
+                        wal->key_capacity = 0;
+                        wal->failed       = true;
+                        return false;
+                }
+                trie_key(node, wal->key, wal->key_capacity);
+        }
+        return trie_wal_log(obj, TRIE_WAL_REMOVE, wal->key, size, NULL, 0);
+}
+
+void trie_wal_close(struct trie *obj)
+{
+        struct trie_wal *wal = obj->wal;
+        if (wal == NULL)
+                return;
+        trie_wal_flush(wal);
+        trie_wal_reap(obj, true);
+        if (wal->fd >= 0)
+                close(wal->fd);
+        if (wal->buf)
+                obj->deallocator(wal->buf);
+        if (wal->key)
+                obj->deallocator(wal->key);
+        obj->deallocator(wal);
+        obj->wal = NULL;
+}
+
+// +--------------------------------------------------------------------------+
+// | Public functions                                                         |
+// +--------------------------------------------------------------------------+
+
+struct trie *trie_recover(const char *dir, const struct trie_wal_config *config,
+                          trie_allocator_t allocator,
+                          trie_deallocator_t deallocator)
+{
+        if (dir == NULL || strlen(dir) + 32 > PATH_MAX)
+                return NULL;
+        if (mkdir(dir, 0755) != 0 && errno != EEXIST)
+                return NULL;
+
+        struct trie *obj = trie_new(allocator, deallocator);
+        if (obj == NULL)
+                return NULL;
+        struct trie_wal *wal = obj->allocator(sizeof(*wal));
+        if (wal == NULL) {
+                trie_delete(&obj);
+                return NULL;
+        }
+        memset(wal, 0, sizeof(*wal));
+        strcpy(wal->dir, dir);
+        wal->fd       = -1;
+        wal->capacity = 1 << 16;
+        wal->buf      = obj->allocator(wal->capacity);
+        if (config) {
+                wal->config = *config;
+        } else {
+                wal->config.group_records = 128;
+                wal->config.group_msec    = 10;
+        }
+
+        // a checkpoint which didn't complete
+        char path[PATH_MAX];
+        if (trie_wal_path(dir, TRIE_WAL_CHECKPOINT_TMP, path))
+                unlink(path);
+
+        uint64_t *starts = NULL;
+        ssize_t count    = -1;
+        if (wal->buf && trie_wal_read_image(obj, dir, &wal->sequence))
+                count = trie_wal_list(obj, dir, &starts);
+        for (ssize_t i = 0; i < count; ++i) {
+                if (trie_wal_log_path(dir, starts[i], path))
+                        trie_wal_replay(obj, path, &wal->sequence);
+        }
+        if (starts)
+                obj->deallocator(starts);
+
+        // the trie logs its changes from now on
+        obj->wal = wal;
+        if (count < 0 || !trie_wal_open(wal)) {
+                trie_delete(&obj);
+                return NULL;
+        }
+        return obj;
+}
+
+bool trie_wal_sync(struct trie *trie)
+{
+        if (trie == NULL || trie->wal == NULL)
+                return false;
+        return trie_wal_flush(trie->wal);
+}
+
+bool trie_checkpoint(struct trie *trie)
+{
+        if (trie == NULL || trie->wal == NULL)
+                return false;
+        struct trie_wal *wal = trie->wal;
+        trie_wal_reap(trie, true);
+        if (!trie_wal_flush(wal))
+                return false;
+
+        // changes after the image go to a new log
+        const uint64_t sequence = wal->sequence;
+        close(wal->fd);
+        if (!trie_wal_open(wal))
+                return false;
+
+        // the child writes a copy-on-write snapshot of the trie
+        struct trie_wal_image image;
+        if (!trie_wal_image_new(&image, wal->dir))
+                return false;
+        const pid_t pid = fork();
+        if (pid == 0)
+                _exit(trie_wal_write_image(trie, &image, wal->dir, sequence)
+                          ? 0
+                          : 1);
+        if (pid < 0) {
+                const bool res =
+                    trie_wal_write_image(trie, &image, wal->dir, sequence);
+                trie_wal_image_free(&image);
+                if (!res)
+                        return false;
+                trie_wal_remove_logs(trie, sequence);
+                return true;
+        }
+        trie_wal_image_free(&image);
+        wal->checkpoint          = pid;
+        wal->checkpoint_sequence = sequence;
+        return true;
+}
+
+bool trie_checkpoint_wait(struct trie *trie)
+{
+        if (trie == NULL || trie->wal == NULL)
+                return false;
+        return trie_wal_reap(trie, true);
+}
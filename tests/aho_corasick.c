@@ -0,0 +1,140 @@
+/*
+ * aho_corasick.c
+ * Copyright (C) 2016 DerShokus <lily.coder@gmail.com>
+ *
+ * Distributed under terms of the MIT license.
+ */
+
+#include <trie.h>
+#include <trie_ac.h>
+#include <assert.h>
+#include <stdio.h>
+
+struct match {
+        uint64_t end;
+        size_t size;
+        void *data;
+};
+
+struct matches {
+        struct match items[32];
+        size_t size;
+};
+
+static bool collect(void *ctx, uint64_t end, size_t size, void *data)
+{
+        struct matches *matches = ctx;
+        assert(matches->size < 32);
+        struct match match             = {end, size, data};
+        matches->items[matches->size++] = match;
+        return true;
+}
+
+static bool stop(void *ctx, uint64_t end, size_t size, void *data)
+{
+        (void)end;
+        (void)size;
+        (void)data;
+        ++*(size_t *)ctx;
+        return false;
+}
+
+static bool contains(const struct matches *matches, uint64_t end, size_t size,
+                     void *data)
+{
+        for (size_t i = 0; i < matches->size; ++i) {
+                const struct match *m = &matches->items[i];
+                if (m->end == end && m->size == size && m->data == data)
+                        return true;
+        }
+        return false;
+}
+
+int main(void)
+{
+        // "he" is a prefix of "hers", so keys are stored with a terminator
+        static const char *words[] = {"he", "she", "his", "hers", NULL};
+
+        struct trie *obj = trie_new(NULL, NULL);
+        for (size_t i = 0; words[i]; ++i) {
+                void *old;
+                bool ret = trie_insert(obj, (const uint8_t *)words[i],
+                                       strlen(words[i]) + 1,
+                                       (void *)(i + 1), &old);
+                assert(ret);
+        }
+
+        struct trie_ac *ac = trie_ac_new(obj);
+        assert(ac);
+        struct trie_ac_scanner *scanner = trie_ac_scanner_new(ac);
+        assert(scanner);
+
+        // 1. The classic example in one chunk
+        struct matches matches = {.size = 0};
+        const char *text       = "ushers";
+        bool ret = trie_ac_feed(scanner, (const uint8_t *)text, strlen(text),
+                                collect, &matches);
+        assert(ret);
+        assert(matches.size == 3);
+        assert(contains(&matches, 4, 3, (void *)2)); // she
+        assert(contains(&matches, 4, 2, (void *)1)); // he
+        assert(contains(&matches, 6, 4, (void *)4)); // hers
+        printf("1. [DONE] One chunk\n");
+
+        // 2. The same text byte by byte
+        trie_ac_scanner_reset(scanner);
+        matches.size = 0;
+        for (size_t i = 0; text[i]; ++i) {
+                ret = trie_ac_feed(scanner, (const uint8_t *)&text[i], 1,
+                                   collect, &matches);
+                assert(ret);
+        }
+        assert(matches.size == 3);
+        assert(contains(&matches, 4, 3, (void *)2));
+        assert(contains(&matches, 4, 2, (void *)1));
+        assert(contains(&matches, 6, 4, (void *)4));
+        printf("2. [DONE] Chunk boundaries\n");
+
+        // 3. Offsets continue over chunks
+        matches.size = 0;
+        text         = "xhisx";
+        ret = trie_ac_feed(scanner, (const uint8_t *)text, strlen(text),
+                           collect, &matches);
+        assert(ret);
+        assert(matches.size == 1);
+        assert(contains(&matches, 10, 3, (void *)3));
+        printf("3. [DONE] Stream offsets\n");
+
+        // 4. A callback stops the scan
+        trie_ac_scanner_reset(scanner);
+        size_t calls = 0;
+        text         = "hehehe";
+        ret = trie_ac_feed(scanner, (const uint8_t *)text, strlen(text), stop,
+                           &calls);
+        assert(!ret);
+        assert(calls == 1);
+        printf("4. [DONE] Stop\n");
+
+        trie_ac_scanner_delete(&scanner);
+        assert(scanner == NULL);
+        trie_ac_delete(&ac);
+        assert(ac == NULL);
+
+        // 5. An empty trie never matches
+        struct trie *empty = trie_new(NULL, NULL);
+        ac                 = trie_ac_new(empty);
+        assert(ac);
+        scanner      = trie_ac_scanner_new(ac);
+        matches.size = 0;
+        ret = trie_ac_feed(scanner, (const uint8_t *)"abc", 3, collect,
+                           &matches);
+        assert(ret);
+        assert(matches.size == 0);
+        trie_ac_scanner_delete(&scanner);
+        trie_ac_delete(&ac);
+        trie_delete(&empty);
+        printf("5. [DONE] Empty trie\n");
+
+        trie_delete(&obj);
+        return 0;
+}
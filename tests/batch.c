@@ -0,0 +1,181 @@
+/*
+ * batch.c
+ * Copyright (C) 2016 DerShokus <lily.coder@gmail.com>
+ *
+ * Distributed under terms of the MIT license.
+ */
+
+#include <trie.h>
+#include <trie_wal.h>
+#include <assert.h>
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#define KEYS 2000
+#define BATCH 500
+
+struct word {
+        uint8_t key[8];
+        size_t size;
+};
+
+static struct word words[KEYS];
+
+// the same changes one by one
+static void apply(struct trie *obj, struct trie_write *write)
+{
+        void *data;
+        if (write->remove)
+                write->done =
+                    trie_remove(obj, write->key, write->key_size, &data);
+        else
+                write->done = trie_insert(obj, write->key, write->key_size,
+                                          write->data, &data);
+        // failed changes keep their values
+        if (write->done)
+                write->data = data;
+}
+
+static void check(struct trie *obj, struct trie *model)
+{
+        // terminated and unterminated keys
+        for (size_t i = 0; i < 2 * KEYS; ++i) {
+                const struct word *word = &words[i / 2];
+                const size_t size       = word->size - i % 2;
+                void *data, *expected;
+                const bool found = trie_at(obj, word->key, size, &data);
+                assert(found == trie_at(model, word->key, size, &expected));
+                assert(!found || data == expected);
+
+                // counts of every prefix
+                for (size_t j = 1; j <= size; ++j)
+                        assert(trie_count_prefix(obj, word->key, j) ==
+                               trie_count_prefix(model, word->key, j));
+        }
+        const size_t count = trie_count_prefix(obj, NULL, 0);
+        assert(count == trie_count_prefix(model, NULL, 0));
+
+        size_t rank = 0;
+        for (struct trie_node *i = trie_begin(obj); i; i = trie_next(i))
+                assert(trie_select(obj, rank++) == i);
+        assert(rank == count);
+}
+
+static struct trie_write writes[BATCH], copies[BATCH];
+static size_t order[BATCH];
+
+// the order of a batch: keys, then positions
+static int order_compare(const void *a, const void *b)
+{
+        const struct trie_write *x = &copies[*(const size_t *)a];
+        const struct trie_write *y = &copies[*(const size_t *)b];
+        const size_t size          = x->key_size < y->key_size ? x->key_size
+                                                               : y->key_size;
+        const int res = memcmp(x->key, y->key, size);
+        if (res != 0)
+                return res;
+        if (x->key_size != y->key_size)
+                return x->key_size < y->key_size ? -1 : 1;
+        return (x > y) - (x < y);
+}
+
+// Random changes of random keys, unterminated ones may be prefixes of
+// others and fail.
+static void fill(void)
+{
+        for (size_t i = 0; i < BATCH; ++i) {
+                const struct word *word = &words[(size_t)rand() % KEYS];
+                struct trie_write *write = &writes[i];
+                write->key               = word->key;
+                write->key_size          = word->size;
+                if (rand() % 20 == 0)
+                        --write->key_size;
+                write->remove = rand() % 3 == 0;
+                write->data   = write->remove ? NULL : (void *)(size_t)rand();
+                copies[i]     = *write;
+                order[i]      = i;
+        }
+        qsort(order, BATCH, sizeof(order[0]), order_compare);
+}
+
+int main(void)
+{
+        srand(38);
+        for (size_t i = 0; i < KEYS; ++i) {
+                struct word *word = &words[i];
+                word->size        = 1 + (size_t)rand() % 6;
+                for (size_t j = 0; j < word->size; ++j)
+                        word->key[j] = (uint8_t)('a' + rand() % 3);
+                word->key[word->size++] = '\0';
+        }
+
+        // 0. Batches give the same results as changes one by one
+        struct trie *obj   = trie_new(NULL, NULL);
+        struct trie *model = trie_new(NULL, NULL);
+        trie_root_index(obj, 2);
+        for (size_t n = 0; n < 40; ++n) {
+                fill();
+                size_t done = 0;
+                for (size_t i = 0; i < BATCH; ++i) {
+                        apply(model, &copies[order[i]]);
+                        done += copies[order[i]].done;
+                }
+                assert(trie_write_batch(obj, writes, BATCH) == done);
+                for (size_t i = 0; i < BATCH; ++i) {
+                        assert(writes[i].done == copies[i].done);
+                        assert(writes[i].data == copies[i].data);
+                }
+                check(obj, model);
+        }
+        printf("0. [DONE] Batches\n");
+
+        // 1. Everything is removed by a batch
+        const size_t count = trie_count_prefix(obj, NULL, 0);
+        struct trie_write *all = malloc(2 * KEYS * sizeof(*all));
+        size_t i               = 0;
+        for (size_t j = 0; j < 2 * KEYS; ++j) {
+                const struct word *word = &words[j / 2];
+                const size_t size       = word->size - j % 2;
+                void *data;
+                if (!trie_remove(model, word->key, size, &data))
+                        continue;
+                all[i++] = (struct trie_write){word->key, size, NULL, true,
+                                               false};
+        }
+        assert(trie_write_batch(obj, all, i) == count);
+        assert(trie_begin(obj) == NULL);
+        check(obj, model);
+        free(all);
+        trie_delete(&obj);
+        trie_delete(&model);
+        printf("1. [DONE] Removing\n");
+
+        // 2. Batches are logged
+        char dir[] = "/tmp/trie_batch_XXXXXX";
+        assert(mkdtemp(dir));
+        obj   = trie_recover(dir, NULL, NULL, NULL);
+        model = trie_new(NULL, NULL);
+        for (size_t n = 0; n < 5; ++n) {
+                fill();
+                for (size_t j = 0; j < BATCH; ++j)
+                        apply(model, &copies[order[j]]);
+                trie_write_batch(obj, writes, BATCH);
+        }
+        trie_delete(&obj);
+        obj = trie_recover(dir, NULL, NULL, NULL);
+        check(obj, model);
+        trie_delete(&obj);
+        trie_delete(&model);
+        DIR *dirp = opendir(dir);
+        for (struct dirent *e = readdir(dirp); e; e = readdir(dirp)) {
+                char path[512];
+                snprintf(path, sizeof(path), "%s/%s", dir, e->d_name);
+                unlink(path);
+        }
+        closedir(dirp);
+        rmdir(dir);
+        printf("2. [DONE] Log\n");
+        return 0;
+}
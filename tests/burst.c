@@ -0,0 +1,216 @@
+/*
+ * burst.c
+ * Copyright (C) 2016 DerShokus <lily.coder@gmail.com>
+ *
+ * Distributed under terms of the MIT license.
+ */
+
+#include <trie_burst.h>
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define KEYS 3000
+#define LONG_SIZE 32770 // longer than a suffix of a bucket
+
+struct word {
+        uint8_t *key;
+        size_t size;
+        bool enabled;
+};
+
+static struct word words[KEYS];
+static size_t order[KEYS];
+
+static int word_compare(const void *a, const void *b)
+{
+        const struct word *x = &words[*(const size_t *)a];
+        const struct word *y = &words[*(const size_t *)b];
+        const int res = memcmp(x->key, y->key,
+                               x->size < y->size ? x->size : y->size);
+        if (res != 0)
+                return res;
+        return (x->size > y->size) - (x->size < y->size);
+}
+
+struct walk {
+        const uint8_t *prefix;
+        size_t prefix_size;
+        size_t next; // in order
+        size_t limit;
+};
+
+static bool has_prefix(const struct word *word, const uint8_t *prefix,
+                       size_t size)
+{
+        return word->size >= size && memcmp(word->key, prefix, size) == 0;
+}
+
+// keys come in the sorted order
+static bool visit(void *ctx, const uint8_t *key, size_t key_size, void *data)
+{
+        struct walk *walk = ctx;
+        while (walk->next < KEYS) {
+                const struct word *word = &words[order[walk->next]];
+                if (word->enabled &&
+                    has_prefix(word, walk->prefix, walk->prefix_size))
+                        break;
+                ++walk->next;
+        }
+        assert(walk->next < KEYS);
+        const size_t i = order[walk->next++];
+        assert(data == (void *)i);
+        assert(key_size == words[i].size);
+        assert(memcmp(key, words[i].key, key_size) == 0);
+        return --walk->limit != 0;
+}
+
+static void check(struct trie_burst *obj)
+{
+        size_t enabled = 0;
+        for (size_t i = 0; i < KEYS; ++i) {
+                void *data;
+                const bool found =
+                    trie_burst_at(obj, words[i].key, words[i].size, &data);
+                assert(found == words[i].enabled);
+                assert(!found || data == (void *)i);
+                enabled += words[i].enabled;
+        }
+        assert(trie_burst_size(obj) == enabled);
+
+        // all keys and keys of random prefixes
+        struct walk walk = {(const uint8_t *)"", 0, 0, SIZE_MAX};
+        assert(trie_burst_walk(obj, NULL, 0, visit, &walk));
+        for (size_t n = 0; n < 50; ++n) {
+                const struct word *word = &words[(size_t)rand() % KEYS];
+                const size_t size       = (size_t)rand() % (word->size + 1);
+                struct walk prefixed    = {word->key, size, 0, SIZE_MAX};
+                assert(trie_burst_walk(obj, word->key, size, visit,
+                                       &prefixed));
+                for (; prefixed.next < KEYS; ++prefixed.next) {
+                        const struct word *rest =
+                            &words[order[prefixed.next]];
+                        assert(!rest->enabled ||
+                               !has_prefix(rest, word->key, size));
+                }
+        }
+}
+
+static void run(size_t burst)
+{
+        struct trie_burst *obj = trie_burst_new(NULL, NULL, burst);
+        for (size_t i = 0; i < KEYS; ++i) {
+                void *old;
+                assert(trie_burst_insert(obj, words[i].key, words[i].size,
+                                         (void *)i, &old));
+                assert(old == NULL);
+                words[i].enabled = true;
+        }
+        check(obj);
+
+        // a walk stops when the callback returns false
+        struct walk walk = {(const uint8_t *)"", 0, 0, 10};
+        assert(!trie_burst_walk(obj, NULL, 0, visit, &walk));
+
+        for (size_t n = 0; n < 4 * KEYS; ++n) {
+                const size_t i    = (size_t)rand() % KEYS;
+                struct word *word = &words[i];
+                void *data;
+                if (word->enabled) {
+                        assert(trie_burst_remove(obj, word->key, word->size,
+                                                 &data));
+                        assert(data == (void *)i);
+                        assert(!trie_burst_remove(obj, word->key, word->size,
+                                                  &data));
+                } else {
+                        assert(trie_burst_insert(obj, word->key, word->size,
+                                                 (void *)i, &data));
+                }
+                word->enabled = !word->enabled;
+                if (n % 1000 == 0)
+                        check(obj);
+        }
+        check(obj);
+
+        for (size_t i = 0; i < KEYS; ++i) {
+                void *data;
+                if (i % 2 && words[i].enabled) {
+                        assert(trie_burst_remove(obj, words[i].key,
+                                                 words[i].size, &data));
+                        words[i].enabled = false;
+                }
+        }
+        check(obj);
+        trie_burst_delete(&obj);
+        assert(obj == NULL);
+}
+
+// Records of a bucket are longer than the key buffer of a walk.
+static bool visit_long(void *ctx, const uint8_t *key, size_t key_size,
+                       void *data)
+{
+        size_t *count = ctx;
+        assert(key_size == 1000 && key[0] == 'p');
+        assert(key[key_size - 1] == (uint8_t)(uintptr_t)data);
+        ++*count;
+        return true;
+}
+
+int main(void)
+{
+        srand(37);
+
+        // distinct keys of a small alphabet, prefixes of each other too
+        for (size_t i = 0; i < KEYS;) {
+                struct word *word = &words[i];
+                word->size        = 1 + (size_t)rand() % 12;
+                if (i < 4)
+                        word->size = LONG_SIZE + i;
+                word->key = malloc(word->size);
+                for (size_t j = 0; j < word->size; ++j)
+                        word->key[j] = (uint8_t)('a' + rand() % 3);
+                bool same = false;
+                for (size_t j = 0; j < i && !same; ++j)
+                        same = words[j].size == word->size &&
+                               memcmp(words[j].key, word->key,
+                                      word->size) == 0;
+                if (same) {
+                        free(word->key);
+                        continue;
+                }
+                order[i] = i;
+                ++i;
+        }
+        qsort(order, KEYS, sizeof(order[0]), word_compare);
+
+        run(1);
+        printf("0. [DONE] Buckets of one key\n");
+        run(4);
+        printf("1. [DONE] Buckets of four keys\n");
+        run(0);
+        printf("2. [DONE] Default buckets\n");
+        run(100000);
+        printf("3. [DONE] Buckets which don't burst\n");
+
+        // 4. A prefix walk over long suffixes of a bucket
+        struct trie_burst *obj = trie_burst_new(NULL, NULL, 100000);
+        uint8_t key[1000];
+        memset(key, 'x', sizeof(key));
+        key[0] = 'p';
+        for (size_t i = 0; i < 10; ++i) {
+                void *old;
+                key[sizeof(key) - 1] = (uint8_t)i;
+                assert(trie_burst_insert(obj, key, sizeof(key), (void *)i,
+                                         &old));
+        }
+        size_t count = 0;
+        assert(trie_burst_walk(obj, (const uint8_t *)"px", 2, visit_long,
+                               &count));
+        assert(count == 10);
+        trie_burst_delete(&obj);
+        printf("4. [DONE] Long suffixes\n");
+
+        for (size_t i = 0; i < KEYS; ++i)
+                free(words[i].key);
+        return 0;
+}
@@ -0,0 +1,156 @@
+/*
+ * capacity.c
+ * Copyright (C) 2016 DerShokus <lily.coder@gmail.com>
+ *
+ * Distributed under terms of the MIT license.
+ */
+
+#include <trie.h>
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define KEYS 20000
+#define CAPACITY 1000
+#define HOT 100
+
+static size_t evicted;
+
+static void on_evict(void *ctx, void *data)
+{
+        (void)ctx;
+        (void)data;
+        ++evicted;
+}
+
+static size_t key_of(size_t id, uint8_t *key)
+{
+        return (size_t)sprintf((char *)key, "/cache/%zu/%zu", id % 97, id) +
+               1;
+}
+
+// Check values of present keys.
+static void check(struct trie *obj)
+{
+        for (struct trie_node *i = trie_begin(obj); i; i = trie_next(i)) {
+                uint8_t key[32], expected[32];
+                void *data;
+                const size_t size = trie_key(i, key, sizeof(key));
+                assert(trie_data(i, &data));
+                assert(key_of((size_t)data, expected) == size);
+                assert(memcmp(key, expected, size) == 0);
+        }
+}
+
+static int compare(const void *a, const void *b)
+{
+        return strcmp(a, b);
+}
+
+// Nodes are distinct prefixes of keys.
+static size_t nodes(struct trie *obj)
+{
+        const size_t count = trie_count_prefix(obj, NULL, 0);
+        char(*keys)[32]    = malloc(count * sizeof(*keys));
+        size_t n           = 0;
+        for (struct trie_node *i = trie_begin(obj); i; i = trie_next(i))
+                trie_key(i, (uint8_t *)keys[n++], sizeof(*keys));
+        qsort(keys, count, sizeof(*keys), compare);
+        size_t res = 0;
+        for (size_t i = 0; i < count; ++i) {
+                size_t common = 0;
+                while (i && keys[i][common] == keys[i - 1][common])
+                        ++common;
+                res += strlen(keys[i]) + 1 - common;
+        }
+        free(keys);
+        return res;
+}
+
+int main(void)
+{
+        // 0. The number of keys is bounded
+        struct trie *obj = trie_new(NULL, NULL);
+        trie_set_capacity(obj, CAPACITY, 0, on_evict, NULL);
+        for (size_t i = 0; i < KEYS; ++i) {
+                uint8_t key[32];
+                void *old, *data;
+                const size_t size = key_of(i, key);
+                assert(trie_insert(obj, key, size, (void *)i, &old));
+                assert(trie_at(obj, key, size, &data) && data == (void *)i);
+                assert(trie_count_prefix(obj, NULL, 0) ==
+                       (i < CAPACITY ? i + 1 : CAPACITY));
+        }
+        assert(evicted == KEYS - CAPACITY);
+        check(obj);
+        printf("0. [DONE] Keys\n");
+
+        // 1. Keys with hits stay
+        for (size_t id = KEYS; id < KEYS + HOT; ++id) {
+                uint8_t key[32];
+                void *old, *data;
+                const size_t size = key_of(id, key);
+                assert(trie_insert(obj, key, size, (void *)id, &old));
+                assert(trie_at(obj, key, size, &data));
+        }
+        for (size_t i = 0; i < KEYS; ++i) {
+                if (i % 50 == 0) {
+                        for (size_t id = KEYS; id < KEYS + HOT; ++id) {
+                                uint8_t key[32];
+                                void *data;
+                                assert(trie_at(obj, key, key_of(id, key),
+                                               &data));
+                        }
+                }
+                uint8_t key[32];
+                void *old;
+                const size_t id = 2 * KEYS + i;
+                assert(trie_insert(obj, key, key_of(id, key), (void *)id,
+                                   &old));
+        }
+        check(obj);
+        printf("1. [DONE] Hits\n");
+
+        // 2. A smaller budget evicts at once, a zero one unbounds
+        evicted = 0;
+        trie_set_capacity(obj, HOT, 0, on_evict, NULL);
+        assert(trie_count_prefix(obj, NULL, 0) == HOT);
+        assert(evicted == CAPACITY - HOT);
+        trie_set_capacity(obj, 0, 0, NULL, NULL);
+        for (size_t i = 0; i < KEYS; ++i) {
+                uint8_t key[32];
+                void *old;
+                trie_insert(obj, key, key_of(3 * KEYS + i, key),
+                            (void *)(3 * KEYS + i), &old);
+        }
+        assert(trie_count_prefix(obj, NULL, 0) == KEYS + HOT);
+        printf("2. [DONE] Changes\n");
+
+        // 3. Bytes of nodes are bounded, a node is larger than 3 pointers
+        const size_t bytes = 64 << 10;
+        evicted            = 0;
+        trie_set_capacity(obj, 0, bytes, on_evict, NULL);
+        assert(evicted > 0);
+        assert(nodes(obj) * 3 * sizeof(void *) <= bytes);
+        for (size_t i = 0; i < KEYS; ++i) {
+                uint8_t key[32];
+                void *old;
+                assert(trie_insert(obj, key, key_of(4 * KEYS + i, key),
+                                   (void *)(4 * KEYS + i), &old));
+                if (i % 1000 == 0)
+                        assert(nodes(obj) * 3 * sizeof(void *) <= bytes);
+        }
+        check(obj);
+
+        // a key which is larger than the budget stays alone
+        uint8_t key[4096];
+        memset(key, 'x', sizeof(key));
+        void *old;
+        trie_set_capacity(obj, 0, 1024, on_evict, NULL);
+        assert(trie_insert(obj, key, sizeof(key), NULL, &old));
+        assert(trie_count_prefix(obj, NULL, 0) == 1);
+        trie_delete(&obj);
+        printf("3. [DONE] Bytes\n");
+        return 0;
+}
@@ -0,0 +1,119 @@
+/*
+ * clear.c
+ * Copyright (C) 2016 DerShokus <lily.coder@gmail.com>
+ *
+ * Distributed under terms of the MIT license.
+ */
+
+#include <trie.h>
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define KEYS 1000
+
+static size_t allocated, deallocated, destroyed;
+static uint8_t keys[KEYS][8];
+static size_t sizes[KEYS];
+
+static void *counting_malloc(size_t size)
+{
+        ++allocated;
+        return malloc(size);
+}
+
+static void counting_free(void *ptr)
+{
+        ++deallocated;
+        free(ptr);
+}
+
+static void destructor(void *data)
+{
+        assert((size_t)data < KEYS);
+        ++destroyed;
+}
+
+static void fill(struct trie *obj)
+{
+        for (size_t i = 0; i < KEYS; ++i) {
+                void *old;
+                bool ret = trie_insert(obj, keys[i], sizes[i], (void *)i, &old);
+                assert(ret);
+        }
+        assert(trie_count_prefix(obj, NULL, 0) == KEYS);
+}
+
+int main(void)
+{
+        srand(31);
+        struct trie *probe = trie_new(NULL, NULL);
+        for (size_t i = 0; i < KEYS;) {
+                sizes[i] = 1 + (size_t)rand() % 6;
+                for (size_t j = 0; j < sizes[i]; ++j)
+                        keys[i][j] = (uint8_t)('a' + rand() % 8);
+                keys[i][sizes[i]++] = '\0';
+
+                void *old;
+                if (trie_at(probe, keys[i], sizes[i], &old))
+                        continue; // the same key
+                trie_insert(probe, keys[i], sizes[i], NULL, &old);
+                ++i;
+        }
+        trie_delete(&probe);
+
+        struct trie *obj = trie_new(counting_malloc, counting_free);
+        trie_set_destructor(obj, destructor);
+
+        // 0. Clear calls the destructor for every value
+        fill(obj);
+        const size_t filled = allocated;
+        trie_clear(obj);
+        assert(destroyed == KEYS);
+        assert(trie_begin(obj) == NULL);
+        assert(trie_count_prefix(obj, NULL, 0) == 0);
+        for (size_t i = 0; i < KEYS; ++i) {
+                void *data;
+                assert(!trie_at(obj, keys[i], sizes[i], &data));
+        }
+        assert(deallocated == 0);
+        printf("0. [DONE] Clear\n");
+
+        // 1. The same keys reuse nodes of the cleared trie
+        fill(obj);
+        assert(allocated == filled);
+        for (size_t i = 0; i < KEYS; ++i) {
+                void *data;
+                assert(trie_at(obj, keys[i], sizes[i], &data));
+                assert(data == (void *)i);
+        }
+        printf("1. [DONE] Refill\n");
+
+        // 2. Removed values go back to the caller, not to the destructor
+        destroyed = 0;
+        for (size_t i = 0; i < KEYS; i += 2) {
+                void *data;
+                assert(trie_remove(obj, keys[i], sizes[i], &data));
+        }
+        assert(destroyed == 0);
+        printf("2. [DONE] Removing\n");
+
+        // 3. Delete frees everything, the rest values are destroyed
+        trie_clear(obj);
+        assert(destroyed == KEYS / 2);
+        fill(obj);
+        trie_delete(&obj);
+        assert(obj == NULL);
+        assert(destroyed == KEYS + KEYS / 2);
+        assert(allocated == deallocated);
+        printf("3. [DONE] Delete\n");
+
+        // 4. Clear of an empty trie
+        obj = trie_new(NULL, NULL);
+        trie_clear(obj);
+        assert(trie_begin(obj) == NULL);
+        trie_delete(&obj);
+        printf("4. [DONE] Empty trie\n");
+
+        return 0;
+}
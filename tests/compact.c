@@ -0,0 +1,163 @@
+/*
+ * compact.c
+ * Copyright (C) 2016 DerShokus <lily.coder@gmail.com>
+ *
+ * Distributed under terms of the MIT license.
+ */
+
+#include <trie.h>
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define KEYS 3000
+
+struct word {
+        uint8_t key[8];
+        size_t size;
+        uint32_t score;
+        bool enabled;
+};
+
+static struct word words[KEYS];
+static size_t order[KEYS];
+
+static void insert(struct trie *obj, size_t i)
+{
+        void *old;
+        bool ret = trie_insert_scored(obj, words[i].key, words[i].size,
+                                      (void *)i, words[i].score, &old);
+        assert(ret);
+        words[i].enabled = true;
+}
+
+static void remove_key(struct trie *obj, size_t i)
+{
+        void *old;
+        bool ret = trie_remove(obj, words[i].key, words[i].size, &old);
+        assert(ret);
+        assert(old == (void *)i);
+        words[i].enabled = false;
+}
+
+// Returns the number of keys, their values are saved in the order.
+static size_t check(struct trie *obj)
+{
+        size_t count = 0;
+        for (size_t i = 0; i < KEYS; ++i) {
+                void *data;
+                const bool found =
+                    trie_at(obj, words[i].key, words[i].size, &data);
+                assert(found == words[i].enabled);
+                assert(!found || data == (void *)i);
+                count += found;
+        }
+        assert(trie_count_prefix(obj, NULL, 0) == count);
+
+        size_t n = 0;
+        for (struct trie_node *i = trie_begin(obj); i; i = trie_next(i)) {
+                void *data;
+                assert(trie_data(i, &data));
+                uint32_t score;
+                assert(trie_score(i, &score));
+                assert(score == words[(size_t)data].score);
+                assert(trie_select(obj, n) == i);
+                order[n++] = (size_t)data;
+        }
+        assert(n == count);
+
+        struct trie_node *best;
+        if (count) {
+                assert(trie_topk(obj, NULL, 0, 1, &best) == 1);
+                void *data;
+                assert(trie_data(best, &data));
+                for (size_t i = 0; i < KEYS; ++i)
+                        assert(!words[i].enabled ||
+                               words[i].score <= words[(size_t)data].score);
+        }
+        return count;
+}
+
+// Compaction keeps keys and the order of iteration.
+static void compact(struct trie *obj, unsigned int flags)
+{
+        static size_t before[KEYS];
+        const size_t count = check(obj);
+        memcpy(before, order, count * sizeof(order[0]));
+        assert(trie_compact(obj, flags));
+        assert(check(obj) == count);
+        assert(memcmp(before, order, count * sizeof(order[0])) == 0);
+}
+
+static void mix(struct trie *obj, size_t n)
+{
+        while (n--) {
+                const size_t i = (size_t)rand() % KEYS;
+                if (words[i].enabled)
+                        remove_key(obj, i);
+                else
+                        insert(obj, i);
+        }
+}
+
+int main(void)
+{
+        srand(34);
+        struct trie *obj = trie_new(NULL, NULL);
+        trie_root_index(obj, 2);
+
+        // 0. Unique keys of a small alphabet with a terminator
+        for (size_t i = 0; i < KEYS;) {
+                struct word *word = &words[i];
+                word->size        = 1 + (size_t)rand() % 6;
+                for (size_t j = 0; j < word->size; ++j)
+                        word->key[j] = (uint8_t)('a' + rand() % 5);
+                word->key[word->size++] = '\0';
+                word->score             = (uint32_t)rand();
+
+                void *old;
+                if (trie_at(obj, word->key, word->size, &old))
+                        continue; // the same key
+                insert(obj, i++);
+        }
+        mix(obj, KEYS);
+        compact(obj, 0);
+        printf("0. [DONE] Compaction\n");
+
+        // 1. Changes reuse nodes of the region, compaction again
+        mix(obj, 3 * KEYS);
+        check(obj);
+        compact(obj, TRIE_COMPACT_HUGEPAGES);
+        mix(obj, KEYS);
+        compact(obj, 0);
+        printf("1. [DONE] Changes after compaction\n");
+
+        // 2. Removing of subtrees
+        size_t removed = trie_remove_prefix(obj, (const uint8_t *)"a", 1,
+                                            NULL, NULL, 0);
+        removed += trie_remove_prefix(obj, (const uint8_t *)"b", 1, NULL,
+                                      NULL, TRIE_REMOVE_DEFERRED);
+        for (size_t i = 0; i < KEYS; ++i) {
+                if (words[i].key[0] == 'a' || words[i].key[0] == 'b') {
+                        removed -= words[i].enabled;
+                        words[i].enabled = false;
+                }
+        }
+        assert(removed == 0);
+        check(obj);
+        mix(obj, KEYS);
+        check(obj);
+        printf("2. [DONE] Removing of prefixes\n");
+
+        // 3. Clear and an empty trie
+        trie_clear(obj);
+        for (size_t i = 0; i < KEYS; ++i)
+                words[i].enabled = false;
+        compact(obj, 0);
+        mix(obj, KEYS);
+        compact(obj, 0);
+        printf("3. [DONE] Clear\n");
+
+        trie_delete(&obj);
+        return 0;
+}
@@ -0,0 +1,144 @@
+/*
+ * count.c
+ * Copyright (C) 2016 DerShokus <lily.coder@gmail.com>
+ *
+ * Distributed under terms of the MIT license.
+ */
+
+#include <trie.h>
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define KEYS 1500
+
+struct word {
+        uint8_t key[8];
+        size_t size;
+        bool enabled;
+};
+
+static struct word words[KEYS];
+
+static size_t expected(const uint8_t *prefix, size_t size)
+{
+        size_t count = 0;
+        for (size_t i = 0; i < KEYS; ++i) {
+                if (words[i].enabled && words[i].size >= size &&
+                    memcmp(words[i].key, prefix, size) == 0)
+                        ++count;
+        }
+        return count;
+}
+
+static void check(struct trie *obj)
+{
+        assert(trie_count_prefix(obj, NULL, 0) == expected(NULL, 0));
+        for (uint8_t a = 'a'; a <= 'c'; ++a) {
+                uint8_t prefix[2] = {a, 'a'};
+                assert(trie_count_prefix(obj, prefix, 1) ==
+                       expected(prefix, 1));
+                for (uint8_t b = 'a'; b <= 'c'; ++b) {
+                        prefix[1] = b;
+                        assert(trie_count_prefix(obj, prefix, 2) ==
+                               expected(prefix, 2));
+                }
+        }
+
+        // rank and select follow the iteration order
+        size_t rank = 0;
+        for (struct trie_node *i = trie_begin(obj); i; i = trie_next(i)) {
+                assert(trie_select(obj, rank) == i);
+
+                uint8_t key[8];
+                const size_t size = trie_key(i, key, sizeof(key));
+                size_t found;
+                assert(trie_rank(obj, key, size, &found));
+                assert(found == rank);
+                ++rank;
+        }
+        assert(rank == expected(NULL, 0));
+        assert(trie_select(obj, rank) == NULL);
+}
+
+static void insert(struct trie *obj, size_t i)
+{
+        void *old;
+        bool ret = trie_insert(obj, words[i].key, words[i].size, (void *)i,
+                               &old);
+        assert(ret);
+        words[i].enabled = true;
+}
+
+static void remove_key(struct trie *obj, size_t i)
+{
+        void *old;
+        bool ret = trie_remove(obj, words[i].key, words[i].size, &old);
+        assert(ret);
+        assert(old == (void *)i);
+        words[i].enabled = false;
+}
+
+int main(void)
+{
+        srand(28);
+        struct trie *obj = trie_new(NULL, NULL);
+
+        // 0. Unique keys of a small alphabet with a terminator
+        for (size_t i = 0; i < KEYS;) {
+                struct word *word = &words[i];
+                word->size        = 1 + (size_t)rand() % 6;
+                for (size_t j = 0; j < word->size; ++j)
+                        word->key[j] = (uint8_t)('a' + rand() % 4);
+                word->key[word->size++] = '\0';
+
+                void *old;
+                if (trie_at(obj, word->key, word->size, &old))
+                        continue;
+                insert(obj, i++);
+        }
+        check(obj);
+        printf("0. [DONE] Insertion\n");
+
+        // 1. Mixed removing and insertion
+        for (size_t n = 0; n < 3 * KEYS; ++n) {
+                const size_t i = (size_t)rand() % KEYS;
+                if (words[i].enabled)
+                        remove_key(obj, i);
+                else
+                        insert(obj, i);
+                if (n % 100 == 0)
+                        check(obj);
+        }
+        check(obj);
+        printf("1. [DONE] Removing and insertion\n");
+
+        // 2. Delete every second key while iterating
+        size_t n = 0;
+        for (struct trie_node *i = trie_begin(obj); i;) {
+                if (n++ % 2 == 0) {
+                        void *data;
+                        assert(trie_data(i, &data));
+                        words[(size_t)data].enabled = false;
+                        i = trie_next_delete(obj, i);
+                } else {
+                        i = trie_next(i);
+                }
+        }
+        check(obj);
+        printf("2. [DONE] trie_next_delete\n");
+
+        // 3. Pagination
+        const size_t total = trie_count_prefix(obj, NULL, 0);
+        size_t seen        = 0;
+        for (size_t offset = 0; offset < total; offset += 10) {
+                struct trie_node *i = trie_select(obj, offset);
+                for (size_t j = 0; j < 10 && i; ++j, i = trie_next(i))
+                        ++seen;
+        }
+        assert(seen == total);
+        printf("3. [DONE] Pagination\n");
+
+        trie_delete(&obj);
+        return 0;
+}
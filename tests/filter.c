@@ -0,0 +1,164 @@
+/*
+ * filter.c
+ * Copyright (C) 2016 DerShokus <lily.coder@gmail.com>
+ *
+ * Distributed under terms of the MIT license.
+ */
+
+#include <trie.h>
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define KEYS 5000
+#define OPS 200000
+
+static size_t key_of(size_t id, uint8_t *key)
+{
+        return (size_t)sprintf((char *)key, "/%zu/%zu", id % 31, id) + 1;
+}
+
+// An allocator which fails for keys of LONG_KEY bytes when it's asked to.
+#define LONG_KEY 300
+static bool fail_keys;
+
+static void *allocator(size_t size)
+{
+        return fail_keys && size == LONG_KEY ? NULL : malloc(size);
+}
+
+// Lookups give the same results as the model ones: the filter never misses
+// a present key.
+static void check(struct trie *obj, struct trie *model)
+{
+        for (size_t id = 0; id < 2 * KEYS; ++id) {
+                uint8_t key[32];
+                void *data, *expected;
+                const size_t size = key_of(id, key);
+                const bool found  = trie_at(obj, key, size, &data);
+                assert(found == trie_at(model, key, size, &expected));
+                assert(!found || data == expected);
+        }
+        assert(trie_count_prefix(obj, NULL, 0) ==
+               trie_count_prefix(model, NULL, 0));
+}
+
+int main(void)
+{
+        srand(42);
+
+        // 0. Changes keep the filter
+        struct trie *obj   = trie_new(NULL, NULL);
+        struct trie *model = trie_new(NULL, NULL);
+        assert(trie_set_filter(obj, KEYS));
+        for (size_t i = 0; i < OPS; ++i) {
+                uint8_t key[32];
+                const size_t id   = (size_t)rand() % KEYS;
+                const size_t size = key_of(id, key);
+                void *old, *expected;
+                struct trie_write write = {key, size, (void *)i, false, false};
+                switch (rand() % 8) {
+                case 0:
+                case 1:
+                        assert(trie_insert(obj, key, size, (void *)i, &old));
+                        trie_insert(model, key, size, (void *)i, &expected);
+                        break;
+                case 2:
+                        assert(trie_write_batch(obj, &write, 1) == 1);
+                        trie_insert(model, key, size, (void *)i, &expected);
+                        break;
+                case 3:
+                        write.remove = true;
+                        assert(trie_write_batch(obj, &write, 1) ==
+                               trie_remove(model, key, size, &expected));
+                        break;
+                case 4:
+                        // a subtree of keys goes away
+                        if (rand() % 100 == 0) {
+                                const size_t prefix = key_of(id, key) -
+                                                      strlen(strrchr(
+                                                          (char *)key, '/'));
+                                assert(trie_remove_prefix(obj, key, prefix,
+                                                          NULL, NULL, 0) ==
+                                       trie_remove_prefix(model, key, prefix,
+                                                          NULL, NULL, 0));
+                        }
+                        break;
+                default:
+                        assert(trie_remove(obj, key, size, &old) ==
+                               trie_remove(model, key, size, &expected));
+                }
+                if (i == OPS / 2)
+                        trie_set_lazy(obj, true, 2);
+                if (i % 20000 == 0)
+                        check(obj, model);
+        }
+        check(obj, model);
+        for (struct trie_node *i = trie_begin(obj); i;) {
+                uint8_t key[32];
+                const size_t size = trie_key(i, key, sizeof(key));
+                void *expected;
+                assert(trie_remove(model, key, size, &expected));
+                i = trie_next_delete(obj, i);
+                if (rand() % 100 == 0)
+                        check(obj, model);
+        }
+        check(obj, model);
+        printf("0. [DONE] Changes\n");
+
+        // 1. A filter is counted again when it's resized, a merge and a
+        // clear change it too
+        for (size_t id = 0; id < KEYS; ++id) {
+                uint8_t key[32];
+                void *old;
+                const size_t size = key_of(id, key);
+                trie_insert(obj, key, size, (void *)id, &old);
+                trie_insert(model, key, size, (void *)id, &old);
+        }
+        assert(trie_set_filter(obj, KEYS / 10));
+        check(obj, model);
+        struct trie *other = trie_new(NULL, NULL);
+        assert(trie_set_filter(other, KEYS));
+        for (size_t id = KEYS; id < 2 * KEYS; ++id) {
+                uint8_t key[32];
+                void *old;
+                const size_t size = key_of(id, key);
+                trie_insert(other, key, size, (void *)id, &old);
+                trie_insert(model, key, size, (void *)id, &old);
+        }
+        assert(trie_merge(obj, other, NULL, NULL));
+        check(obj, model);
+        assert(trie_count_prefix(other, NULL, 0) == 0);
+        assert(trie_set_filter(obj, 0));
+        check(obj, model);
+        assert(trie_set_filter(obj, 2 * KEYS));
+        trie_clear(obj);
+        trie_clear(model);
+        check(obj, model);
+        trie_delete(&other);
+        trie_delete(&model);
+        trie_delete(&obj);
+        printf("1. [DONE] Rebuild\n");
+
+        // 2. A filter which can't count a long key doesn't hide it
+        obj = trie_new(allocator, free);
+        uint8_t key[LONG_KEY];
+        memset(key, 'k', sizeof(key));
+        void *data;
+        assert(trie_insert(obj, key, sizeof(key), (void *)1, &data));
+        assert(trie_set_filter(obj, KEYS));
+        fail_keys = true;
+        assert(!trie_set_filter(obj, 2 * KEYS));
+        assert(trie_at(obj, key, sizeof(key), &data) && data == (void *)1);
+        assert(trie_remove(obj, key, sizeof(key), &data));
+        other = trie_new(NULL, NULL);
+        assert(trie_insert(other, key, sizeof(key), (void *)2, &data));
+        assert(trie_merge(obj, other, NULL, NULL));
+        assert(trie_at(obj, key, sizeof(key), &data) && data == (void *)2);
+        fail_keys = false;
+        trie_delete(&other);
+        trie_delete(&obj);
+        printf("2. [DONE] Allocation failures\n");
+        return 0;
+}
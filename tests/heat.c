@@ -0,0 +1,114 @@
+/*
+ * heat.c
+ * Copyright (C) 2016 DerShokus <lily.coder@gmail.com>
+ *
+ * Distributed under terms of the MIT license.
+ */
+
+#include <trie.h>
+#include <assert.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define THREADS 4
+#define LOOKUPS 10000
+
+static void lookup(struct trie *obj, const char *key, size_t times)
+{
+        for (size_t i = 0; i < times; ++i) {
+                void *data;
+                assert(trie_at(obj, (const uint8_t *)key, strlen(key) + 1,
+                               &data));
+        }
+}
+
+static void *reader(void *arg)
+{
+        lookup(arg, "zoo", LOOKUPS);
+        return NULL;
+}
+
+// Count lines of a file which contain the text.
+static size_t lines(const char *file_name, const char *text)
+{
+        FILE *file = fopen(file_name, "r");
+        assert(file);
+        char line[512];
+        size_t res = 0;
+        while (fgets(line, sizeof(line), file))
+                res += strstr(line, text) != NULL;
+        fclose(file);
+        return res;
+}
+
+int main(void)
+{
+        const char *keys[] = {"xyz", "yes", "zoo", "hot", "warm", "cold"};
+        struct trie *obj   = trie_new(NULL, NULL);
+        for (size_t i = 0; i < sizeof(keys) / sizeof(keys[0]); ++i) {
+                void *old;
+                trie_insert(obj, (const uint8_t *)keys[i], strlen(keys[i]) + 1,
+                            (void *)i, &old);
+        }
+
+        // 0. Visits and hops of levels
+        struct trie_heat_level levels[TRIE_HEAT_LEVELS];
+        assert(trie_set_heat(obj, 1));
+        assert(trie_heat(obj, levels, TRIE_HEAT_LEVELS) == 0);
+        lookup(obj, "zoo", 10);
+        assert(trie_heat(obj, levels, TRIE_HEAT_LEVELS) == 10);
+        // the root chain is x, y, z, h, w, c
+        assert(levels[0].visits == 10 && levels[0].hops == 20);
+        for (size_t i = 1; i < 4; ++i)
+                assert(levels[i].visits == 10 && levels[i].hops == 0);
+        assert(levels[4].visits == 0);
+        printf("0. [DONE] Levels\n");
+
+        // 1. Every sample-th lookup is counted
+        assert(trie_set_heat(obj, 4));
+        lookup(obj, "xyz", 400);
+        assert(trie_heat(obj, levels, 1) == 100);
+        assert(levels[0].visits == 100 && levels[0].hops == 0);
+        printf("1. [DONE] Samples\n");
+
+        // 2. Counters of threads are merged
+        assert(trie_set_heat(obj, 1));
+        pthread_t threads[THREADS];
+        for (size_t i = 0; i < THREADS; ++i)
+                assert(pthread_create(&threads[i], NULL, reader, obj) == 0);
+        for (size_t i = 0; i < THREADS; ++i)
+                pthread_join(threads[i], NULL);
+        assert(trie_heat(obj, levels, 1) == THREADS * LOOKUPS);
+        assert(levels[0].hops == 2 * THREADS * LOOKUPS);
+        printf("2. [DONE] Threads\n");
+
+        // 3. Only the hottest paths are exported
+        const char *file_name = "heat.dot";
+        assert(trie_set_heat(obj, 1));
+        lookup(obj, "hot", 100);
+        lookup(obj, "warm", 10);
+        lookup(obj, "cold", 1);
+        assert(trie_export_heat(obj, file_name, 2));
+        assert(lines(file_name, "digraph heat") == 1);
+        // h, o, t, \0 and w, a, r, m, \0
+        assert(lines(file_name, "fillcolor") == 9);
+        assert(lines(file_name, "->") == 9);
+        assert(lines(file_name, "[label=\"c") == 0);
+        assert(lines(file_name, "\\n100\"") == 4);
+        assert(lines(file_name, "111 lookups") == 1);
+        assert(trie_export_heat(obj, file_name, 0));
+        assert(lines(file_name, "->") == 0);
+        remove(file_name);
+        printf("3. [DONE] Export\n");
+
+        // 4. Counting stops
+        assert(trie_set_heat(obj, 0));
+        lookup(obj, "hot", 1);
+        assert(trie_heat(obj, levels, TRIE_HEAT_LEVELS) == 0);
+        assert(!trie_export_heat(obj, file_name, 1));
+        trie_delete(&obj);
+        printf("4. [DONE] Stop\n");
+        return 0;
+}
@@ -0,0 +1,192 @@
+/*
+ * int.c
+ * Copyright (C) 2016 DerShokus <lily.coder@gmail.com>
+ *
+ * Distributed under terms of the MIT license.
+ */
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define TRIE_INT_NAME trie_ip4
+#define TRIE_INT_TYPE uint32_t
+#define TRIE_INT_STRIDE 8
+#include <trie_int.h>
+
+#define TRIE_INT_NAME trie_u32
+#define TRIE_INT_TYPE uint32_t
+#define TRIE_INT_STRIDE 16
+#include <trie_int.h>
+
+#define TRIE_INT_NAME trie_u64
+#define TRIE_INT_TYPE uint64_t
+#define TRIE_INT_STRIDE 4
+#include <trie_int.h>
+
+// unsigned __int128 is an extension of ISO C
+__extension__ typedef unsigned __int128 uint128;
+
+#define TRIE_INT_NAME trie_ip6
+#define TRIE_INT_TYPE uint128
+#define TRIE_INT_STRIDE 8
+#include <trie_int.h>
+
+#define ROUTES 2000
+
+struct route {
+        uint32_t prefix;
+        unsigned int length;
+        bool enabled;
+};
+
+static struct route routes[ROUTES];
+
+static uint32_t mask(unsigned int length)
+{
+        return length ? ~(uint32_t)0 << (32 - length) : 0;
+}
+
+// the longest enabled route (brute force), ROUTES if none
+static size_t expected(uint32_t addr)
+{
+        size_t best = ROUTES;
+        for (size_t i = 0; i < ROUTES; ++i) {
+                if (routes[i].enabled &&
+                    (addr & mask(routes[i].length)) == routes[i].prefix &&
+                    (best == ROUTES || routes[i].length > routes[best].length))
+                        best = i;
+        }
+        return best;
+}
+
+static void check(struct trie_ip4 *obj)
+{
+        size_t size = 0;
+        for (size_t i = 0; i < ROUTES; ++i) {
+                void *data;
+                const bool found = trie_ip4_at(obj, routes[i].prefix,
+                                               routes[i].length, &data);
+                assert(found == routes[i].enabled);
+                assert(!found || data == (void *)i);
+                size += routes[i].enabled;
+        }
+        assert(trie_ip4_size(obj) == size);
+
+        for (size_t n = 0; n < 2000; ++n) {
+                // near a route or anywhere
+                uint32_t addr = (uint32_t)rand() << 1 ^ (uint32_t)rand();
+                if (n % 2)
+                        addr = routes[(size_t)rand() % ROUTES].prefix |
+                               (addr & 0xff);
+                const size_t best = expected(addr);
+                void *data;
+                unsigned int length;
+                const bool found = trie_ip4_lookup(obj, addr, &data, &length);
+                assert(found == (best != ROUTES));
+                assert(!found || data == (void *)best);
+                assert(!found || length == routes[best].length);
+        }
+}
+
+int main(void)
+{
+        srand(35);
+
+        // 0. Distinct routes of any length
+        struct trie_ip4 *ip4 = trie_ip4_new(NULL, NULL);
+        for (size_t i = 0; i < ROUTES; ++i) {
+                struct route *route = &routes[i];
+                void *old;
+                do {
+                        route->length = (unsigned int)rand() % 33;
+                        // a few bits, so routes overlap
+                        route->prefix = ((uint32_t)rand() & 0xf0ff00ff) &
+                                        mask(route->length);
+                } while (trie_ip4_at(ip4, route->prefix, route->length, &old));
+                assert(trie_ip4_insert(ip4, route->prefix, route->length,
+                                       (void *)i, &old));
+                assert(old == NULL);
+                route->enabled = true;
+        }
+        check(ip4);
+        printf("0. [DONE] Insertion\n");
+
+        // 1. Replacing and removing
+        for (size_t n = 0; n < 3 * ROUTES; ++n) {
+                const size_t i      = (size_t)rand() % ROUTES;
+                struct route *route = &routes[i];
+                void *old;
+                if (route->enabled) {
+                        assert(trie_ip4_remove(ip4, route->prefix,
+                                               route->length, &old));
+                        assert(old == (void *)i);
+                        route->enabled = false;
+                } else if (!trie_ip4_at(ip4, route->prefix, route->length,
+                                        &old)) {
+                        assert(trie_ip4_insert(ip4, route->prefix,
+                                               route->length, (void *)i,
+                                               &old));
+                        route->enabled = true;
+                }
+                if (n % 500 == 0)
+                        check(ip4);
+        }
+        check(ip4);
+        printf("1. [DONE] Removing\n");
+
+        // 2. Everything is removed, nodes are freed
+        for (size_t i = 0; i < ROUTES; ++i) {
+                void *old;
+                if (routes[i].enabled)
+                        assert(trie_ip4_remove(ip4, routes[i].prefix,
+                                               routes[i].length, &old));
+                routes[i].enabled = false;
+        }
+        assert(trie_ip4_size(ip4) == 0);
+        assert(ip4->root == NULL);
+        trie_ip4_delete(&ip4);
+        assert(ip4 == NULL);
+        void *gone;
+        assert(!trie_ip4_at(ip4, 0, 0, &gone));
+        assert(!trie_ip4_lookup(ip4, 0, &gone, NULL));
+        printf("2. [DONE] Empty trie\n");
+
+        // 3. Exact keys of other widths and strides
+        struct trie_u32 *u32 = trie_u32_new(NULL, NULL);
+        struct trie_u64 *u64 = trie_u64_new(NULL, NULL);
+        struct trie_ip6 *ip6 = trie_ip6_new(NULL, NULL);
+        for (uint64_t i = 0; i < 1000; ++i) {
+                void *old;
+                const uint64_t key = i * 0x9E3779B97F4A7C15ull;
+                assert(trie_u32_insert(u32, (uint32_t)key, 32, (void *)i,
+                                       &old));
+                assert(trie_u64_insert(u64, key, 64, (void *)i, &old));
+                const uint128 wide = (uint128)key << 64 | i;
+                assert(trie_ip6_insert(ip6, wide, 128, (void *)i, &old));
+        }
+        const uint128 net = (uint128)0x20010db8u << 96;
+        void *old, *data;
+        assert(trie_ip6_insert(ip6, net, 32, (void *)1000, &old));
+        for (uint64_t i = 0; i < 1000; ++i) {
+                const uint64_t key = i * 0x9E3779B97F4A7C15ull;
+                assert(trie_u32_at(u32, (uint32_t)key, 32, &data));
+                assert(data == (void *)i);
+                assert(trie_u64_lookup(u64, key, &data, NULL));
+                assert(data == (void *)i);
+                assert(!trie_u64_at(u64, key + 1, 64, &data));
+                const uint128 wide = (uint128)key << 64 | i;
+                assert(trie_ip6_at(ip6, wide, 128, &data));
+                assert(data == (void *)i);
+        }
+        unsigned int length;
+        assert(trie_ip6_lookup(ip6, net | 42, &data, &length));
+        assert(data == (void *)1000 && length == 32);
+        assert(!trie_ip6_lookup(ip6, net ^ (uint128)1 << 127, &data, &length));
+        trie_u32_delete(&u32);
+        trie_u64_delete(&u64);
+        trie_ip6_delete(&ip6);
+        printf("3. [DONE] Widths\n");
+
+        return 0;
+}
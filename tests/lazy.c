@@ -0,0 +1,286 @@
+/*
+ * lazy.c
+ * Copyright (C) 2016 DerShokus <lily.coder@gmail.com>
+ *
+ * Distributed under terms of the MIT license.
+ */
+
+#include <trie.h>
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define KEYS 2000
+#define OPS 100000
+
+struct word {
+        uint8_t key[8];
+        size_t size;
+};
+
+static struct word words[KEYS];
+static size_t destroyed;
+
+static void destructor(void *data)
+{
+        (void)data;
+        ++destroyed;
+}
+
+// A random key, unterminated ones are prefixes of others.
+static const uint8_t *random_key(size_t *size)
+{
+        const struct word *word = &words[(size_t)rand() % KEYS];
+        *size                   = word->size - (rand() % 10 == 0);
+        return word->key;
+}
+
+// Keys, values, counts, ranks and top scores are the same as the model ones.
+static void check(struct trie *obj, struct trie *model)
+{
+        for (size_t i = 0; i < 2 * KEYS; ++i) {
+                const struct word *word = &words[i / 2];
+                const size_t size       = word->size - i % 2;
+                void *data, *expected;
+                const bool found = trie_at(obj, word->key, size, &data);
+                assert(found == trie_at(model, word->key, size, &expected));
+                assert(!found || data == expected);
+                size_t rank;
+                assert(trie_rank(obj, word->key, size, &rank) == found);
+                for (size_t j = 1; j <= size; ++j)
+                        assert(trie_count_prefix(obj, word->key, j) ==
+                               trie_count_prefix(model, word->key, j));
+        }
+        const size_t count = trie_count_prefix(obj, NULL, 0);
+        assert(count == trie_count_prefix(model, NULL, 0));
+
+        size_t rank = 0;
+        for (struct trie_node *i = trie_begin(obj); i; i = trie_next(i)) {
+                void *data;
+                assert(trie_data(i, &data));
+                assert(trie_select(obj, rank++) == i);
+        }
+        assert(rank == count);
+
+        struct trie_node *top[10], *expected[10];
+        const size_t k = trie_topk(obj, NULL, 0, 10, top);
+        assert(k == trie_topk(model, NULL, 0, 10, expected));
+        for (size_t i = 0; i < k; ++i) {
+                uint32_t score, expected_score;
+                trie_score(top[i], &score);
+                trie_score(expected[i], &expected_score);
+                assert(score == expected_score);
+        }
+}
+
+int main(void)
+{
+        srand(41);
+        for (size_t i = 0; i < KEYS; ++i) {
+                struct word *word = &words[i];
+                word->size        = 1 + (size_t)rand() % 6;
+                for (size_t j = 0; j < word->size; ++j)
+                        word->key[j] = (uint8_t)('a' + rand() % 3);
+                word->key[word->size++] = '\0';
+        }
+
+        // 0. Lazy removal gives the same results as removal
+        struct trie *obj   = trie_new(NULL, NULL);
+        struct trie *model = trie_new(NULL, NULL);
+        trie_set_lazy(obj, true, 0);
+        for (size_t i = 0; i < OPS; ++i) {
+                size_t size;
+                const uint8_t *key = random_key(&size);
+                void *old, *expected;
+                const uint32_t score = (uint32_t)rand() % 1000;
+                switch (rand() % 4) {
+                case 0:
+                        assert(trie_insert_scored(obj, key, size, (void *)i,
+                                                  score, &old) ==
+                               trie_insert_scored(model, key, size, (void *)i,
+                                                  score, &expected));
+                        assert(old == expected);
+                        break;
+                case 1:
+                        assert(trie_insert(obj, key, size, (void *)i, &old) ==
+                               trie_insert(model, key, size, (void *)i,
+                                           &expected));
+                        assert(old == expected);
+                        break;
+                default:
+                        if (trie_remove(obj, key, size, &old)) {
+                                assert(trie_remove(model, key, size,
+                                                   &expected));
+                                assert(old == expected);
+                        } else {
+                                assert(!trie_at(model, key, size, &expected));
+                        }
+                }
+                if (i % 10000 == 0)
+                        check(obj, model);
+        }
+        check(obj, model);
+        assert(trie_tombstones(obj) > 0);
+        printf("0. [DONE] Removing\n");
+
+        // 1. Bounded purges go on from their last place
+        size_t left = trie_tombstones(obj), steps = 0;
+        while (left) {
+                const size_t next = trie_purge(obj, 64);
+                assert(next <= left);
+                left = next;
+                assert(++steps < KEYS);
+        }
+        check(obj, model);
+        for (struct trie_node *i = trie_begin(obj); i;)
+                i = trie_next_delete(obj, i);
+        assert(trie_tombstones(obj) == trie_count_prefix(model, NULL, 0));
+        assert(trie_begin(obj) == NULL);
+        assert(trie_purge(obj, 0) == 0);
+        assert(trie_count_prefix(obj, NULL, 0) == 0);
+        trie_delete(&model);
+        printf("1. [DONE] Purge\n");
+
+        // 2. Amortized purges, batches and values of tombstones
+        model = trie_new(NULL, NULL);
+        trie_set_lazy(obj, true, 4);
+        for (size_t i = 0; i < OPS; ++i) {
+                size_t size;
+                const uint8_t *key = random_key(&size);
+                struct trie_write write = {key, size, (void *)i,
+                                           rand() % 2 == 0, false};
+                void *expected;
+                const bool done =
+                    write.remove
+                        ? trie_remove(model, key, size, &expected)
+                        : trie_insert(model, key, size, (void *)i, &expected);
+                if (write.remove && rand() % 2 == 0) {
+                        void *old;
+                        assert(trie_remove(obj, key, size, &old) == done);
+                        assert(!done || old == expected);
+                        continue;
+                }
+                assert(trie_write_batch(obj, &write, 1) == done);
+                assert(!done || write.data == expected);
+        }
+        check(obj, model);
+        trie_set_destructor(obj, destructor);
+        const size_t count = trie_count_prefix(obj, NULL, 0);
+        assert(trie_remove_prefix(obj, (const uint8_t *)"a", 1, NULL, NULL,
+                                  0) == trie_count_prefix(model,
+                                                          (const uint8_t *)"a",
+                                                          1));
+        assert(destroyed == count - trie_count_prefix(obj, NULL, 0));
+        trie_delete(&obj);
+        assert(destroyed == count);
+        trie_delete(&model);
+        printf("2. [DONE] Values\n");
+
+        // 3. A full purge leaves no tombstones: one which follows a pruned
+        // chain is checked too, set operations see no removed keys
+        obj                 = trie_new(NULL, NULL);
+        const char *keys[] = {"ab", "ac", "ad", "b"};
+        for (size_t i = 0; i < 4; ++i) {
+                void *old;
+                trie_insert(obj, (const uint8_t *)keys[i], strlen(keys[i]),
+                            (void *)i, &old);
+        }
+        trie_set_lazy(obj, true, 0);
+        for (size_t i = 1; i < 4; ++i) {
+                void *old;
+                assert(trie_remove(obj, (const uint8_t *)keys[i],
+                                   strlen(keys[i]), &old));
+        }
+        assert(trie_purge(obj, 0) == 0);
+        assert(trie_count_prefix(obj, NULL, 0) == 1);
+        trie_delete(&obj);
+
+        for (size_t op = 0; op < 3; ++op) {
+                struct trie *tries[2], *models[2];
+                for (size_t t = 0; t < 2; ++t) {
+                        tries[t]  = trie_new(NULL, NULL);
+                        models[t] = trie_new(NULL, NULL);
+                        trie_set_lazy(tries[t], true, 0);
+                        for (size_t i = 0; i < KEYS; ++i) {
+                                size_t size;
+                                const uint8_t *key = random_key(&size);
+                                void *old;
+                                if (rand() % 3) {
+                                        trie_insert(tries[t], key, size,
+                                                    (void *)i, &old);
+                                        trie_insert(models[t], key, size,
+                                                    (void *)i, &old);
+                                } else {
+                                        trie_remove(tries[t], key, size, &old);
+                                        trie_remove(models[t], key, size,
+                                                    &old);
+                                }
+                        }
+                }
+                switch (op) {
+                case 0:
+                        assert(trie_merge(tries[0], tries[1], NULL, NULL));
+                        assert(trie_merge(models[0], models[1], NULL, NULL));
+                        break;
+                case 1:
+                        assert(trie_intersect(tries[0], tries[1], NULL, NULL));
+                        assert(trie_intersect(models[0], models[1], NULL,
+                                              NULL));
+                        break;
+                default:
+                        assert(trie_subtract(tries[0], tries[1]));
+                        assert(trie_subtract(models[0], models[1]));
+                }
+                for (size_t t = 0; t < 2; ++t) {
+                        assert(trie_purge(tries[t], 0) == 0);
+                        check(tries[t], models[t]);
+                        trie_delete(&tries[t]);
+                        trie_delete(&models[t]);
+                }
+        }
+        printf("3. [DONE] Set operations\n");
+
+        // 4. The purge cursor survives removals of keys and subtrees
+        obj   = trie_new(NULL, NULL);
+        model = trie_new(NULL, NULL);
+        trie_set_lazy(obj, true, 3);
+        for (size_t i = 0; i < OPS; ++i) {
+                size_t size;
+                const uint8_t *key = random_key(&size);
+                void *old, *expected;
+                switch (rand() % 8) {
+                case 0:
+                case 1:
+                case 2:
+                        assert(trie_insert(obj, key, size, (void *)i, &old) ==
+                               trie_insert(model, key, size, (void *)i,
+                                           &expected));
+                        break;
+                case 3:
+                        trie_purge(obj, 5);
+                        break;
+                case 4:
+                        if (rand() % 10 == 0) {
+                                const size_t prefix = 1 + (size_t)rand() % 2;
+                                assert(trie_remove_prefix(obj, key, prefix,
+                                                          NULL, NULL, 0) ==
+                                       trie_remove_prefix(model, key, prefix,
+                                                          NULL, NULL, 0));
+                        }
+                        break;
+                default:
+                        assert(trie_remove(obj, key, size, &old) ==
+                               trie_remove(model, key, size, &expected));
+                }
+                if (i % 10000 == 0)
+                        check(obj, model);
+        }
+        check(obj, model);
+        assert(trie_purge(obj, 0) == 0);
+        check(obj, model);
+        trie_delete(&obj);
+        trie_delete(&model);
+        printf("4. [DONE] Cursor\n");
+        return 0;
+}
@@ -0,0 +1,115 @@
+/*
+ * load.c
+ * Copyright (C) 2016 DerShokus <lily.coder@gmail.com>
+ *
+ * Distributed under terms of the MIT license.
+ */
+
+#include <trie.h>
+#include <assert.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+static void write_file(const char *path, const char *content)
+{
+        FILE *file = fopen(path, "w");
+        assert(file);
+        fwrite(content, 1, strlen(content), file);
+        fclose(file);
+}
+
+static bool at(struct trie *obj, const char *key, size_t size, void **data)
+{
+        return trie_at(obj, (const uint8_t *)key, size, data);
+}
+
+int main(void)
+{
+        char path[] = "/tmp/trie_load_XXXXXX";
+        const int fd = mkstemp(path);
+        assert(fd >= 0);
+        close(fd);
+
+        void *data;
+        struct trie *obj;
+
+        // 1. Line numbers, the last line hasn't a delimiter
+        write_file(path, "alpha\nbeta\n\ngamma");
+        obj = trie_new(NULL, NULL);
+        size_t lines;
+        assert(trie_load_file(obj, path, '\n', TRIE_LOAD_LINE_NUMBERS,
+                              &lines));
+        assert(lines == 4);
+        assert(trie_count_prefix(obj, NULL, 0) == 3);
+        assert(at(obj, "alpha", 5, &data) && data == (void *)0);
+        assert(at(obj, "beta", 4, &data) && data == (void *)1);
+        assert(at(obj, "gamma", 5, &data) && data == (void *)3);
+        trie_delete(&obj);
+        printf("1. [DONE] Line numbers\n");
+
+        // 2. Terminated keys can be prefixes of each other
+        write_file(path, "ab,abc,a");
+        obj = trie_new(NULL, NULL);
+        // keys before the conflict stay
+        assert(!trie_load_file(obj, path, ',', 0, &lines));
+        assert(lines == 1);
+        assert(at(obj, "ab", 2, &data) && trie_count_prefix(obj, NULL, 0) == 1);
+        trie_delete(&obj);
+        obj = trie_new(NULL, NULL);
+        assert(trie_load_file(obj, path, ',',
+                              TRIE_LOAD_TERMINATED | TRIE_LOAD_LINE_NUMBERS,
+                              NULL));
+        assert(at(obj, "ab,", 3, &data) && data == (void *)0);
+        assert(at(obj, "abc,", 4, &data) && data == (void *)1);
+        assert(at(obj, "a,", 2, &data) && data == (void *)2);
+        trie_delete(&obj);
+        printf("2. [DONE] Terminated keys\n");
+
+        // 3. Parsed values
+        write_file(path, "one\t1\ntwo\t2\n\nthree\t33\n");
+        obj = trie_new(NULL, NULL);
+        assert(trie_load_file(obj, path, '\n', TRIE_LOAD_VALUES, NULL));
+        assert(at(obj, "one", 3, &data) && data == (void *)1);
+        assert(at(obj, "two", 3, &data) && data == (void *)2);
+        assert(at(obj, "three", 5, &data) && data == (void *)33);
+        trie_delete(&obj);
+        // terminated keys of values keep the delimiter, not the tab
+        write_file(path, "one\t1\non\t2");
+        obj = trie_new(NULL, NULL);
+        assert(trie_load_file(obj, path, '\n',
+                              TRIE_LOAD_TERMINATED | TRIE_LOAD_VALUES, NULL));
+        assert(at(obj, "one\n", 4, &data) && data == (void *)1);
+        assert(at(obj, "on\n", 3, &data) && data == (void *)2);
+        assert(!at(obj, "one\t", 4, &data));
+        trie_delete(&obj);
+        printf("3. [DONE] Values\n");
+
+        // 4. Errors
+        write_file(path, "one\t1\ntwo\n");
+        obj = trie_new(NULL, NULL);
+        assert(!trie_load_file(obj, path, '\n', TRIE_LOAD_VALUES, &lines));
+        assert(lines == 1);
+        assert(!trie_load_file(obj, "/nonexistent/file", '\n', 0, &lines));
+        assert(lines == 0);
+        write_file(path, "");
+        assert(trie_load_file(obj, path, '\n', 0, NULL));
+        // a value which overflows a pointer fails its line
+        char line[64];
+        snprintf(line, sizeof(line), "one\t%ju\ntwo\t%ju0\n",
+                 (uintmax_t)UINTPTR_MAX, (uintmax_t)UINTPTR_MAX);
+        write_file(path, line);
+        assert(!trie_load_file(obj, path, '\n', TRIE_LOAD_VALUES, &lines));
+        assert(lines == 1);
+        assert(at(obj, "one", 3, &data) && data == (void *)UINTPTR_MAX);
+        assert(!at(obj, "two", 3, &data));
+        // a device can't be mapped and looks empty
+        assert(!trie_load_file(obj, "/dev/null", '\n', 0, &lines));
+        assert(lines == 0);
+        trie_delete(&obj);
+        printf("4. [DONE] Errors\n");
+
+        unlink(path);
+        return 0;
+}
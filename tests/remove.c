@@ -208,6 +208,16 @@ int main(void)
         assert(ret);
         printf("8. [DONE] --------------\n");
 
-
+        // 9. The last sibling with a tail
+        trie_insert(obj, (uint8_t *)"ab", 2, (void *)0xA, &old);
+        trie_insert(obj, (uint8_t *)"cd", 2, (void *)0xB, &old);
+        assert(trie_remove(obj, (uint8_t *)"cd", 2, &old));
+        assert(old == (void *)0xB);
+        assert(!trie_at(obj, (uint8_t *)"cd", 2, &old));
+        assert(trie_at(obj, (uint8_t *)"ab", 2, &old));
+        assert(old == (void *)0xA);
+        printf("9. [DONE] The last sibling with a tail\n");
+
+        trie_delete(&obj);
         return 0;
 }
@@ -0,0 +1,160 @@
+/*
+ * remove_prefix.c
+ * Copyright (C) 2016 DerShokus <lily.coder@gmail.com>
+ *
+ * Distributed under terms of the MIT license.
+ */
+
+#include <trie.h>
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#define KEYS 2000
+
+struct word {
+        uint8_t key[8];
+        size_t size;
+        bool enabled;
+};
+
+static struct word words[KEYS];
+static size_t removed;
+static volatile size_t deferred;
+
+static bool has_prefix(const struct word *word, const uint8_t *prefix,
+                       size_t size)
+{
+        return word->size >= size && memcmp(word->key, prefix, size) == 0;
+}
+
+static void collect(void *ctx, void *data)
+{
+        assert(ctx == &removed);
+        struct word *word = &words[(size_t)data];
+        assert(word->enabled);
+        word->enabled = false;
+        ++removed;
+}
+
+static void count_deferred(void *ctx, void *data)
+{
+        (void)ctx;
+        (void)data;
+        __sync_fetch_and_add(&deferred, 1);
+}
+
+static void fill(struct trie *obj)
+{
+        for (size_t i = 0; i < KEYS; ++i) {
+                if (words[i].enabled)
+                        continue;
+                void *old;
+                bool ret = trie_insert(obj, words[i].key, words[i].size,
+                                       (void *)i, &old);
+                assert(ret);
+                words[i].enabled = true;
+        }
+}
+
+static void check(struct trie *obj)
+{
+        size_t enabled = 0;
+        for (size_t i = 0; i < KEYS; ++i) {
+                void *data;
+                const bool found =
+                    trie_at(obj, words[i].key, words[i].size, &data);
+                assert(found == words[i].enabled);
+                assert(!found || data == (void *)i);
+                enabled += words[i].enabled;
+        }
+        size_t iterated = 0;
+        for (struct trie_node *i = trie_begin(obj); i; i = trie_next(i))
+                ++iterated;
+        assert(iterated == enabled);
+        assert(trie_count_prefix(obj, NULL, 0) == enabled);
+}
+
+static void remove_prefix(struct trie *obj, const uint8_t *prefix,
+                          size_t size)
+{
+        size_t expected = 0;
+        for (size_t i = 0; i < KEYS; ++i)
+                expected += words[i].enabled && has_prefix(&words[i], prefix,
+                                                           size);
+        removed = 0;
+        assert(trie_remove_prefix(obj, prefix, size, collect, &removed, 0) ==
+               expected);
+        assert(removed == expected);
+        assert(trie_count_prefix(obj, prefix, size) == 0);
+        check(obj);
+}
+
+int main(void)
+{
+        srand(32);
+        struct trie *obj = trie_new(NULL, NULL);
+        trie_root_index(obj, 2);
+
+        // 0. Unique keys of a small alphabet with a terminator
+        for (size_t i = 0; i < KEYS;) {
+                struct word *word = &words[i];
+                word->size        = 1 + (size_t)rand() % 6;
+                for (size_t j = 0; j < word->size; ++j)
+                        word->key[j] = (uint8_t)('a' + rand() % 4);
+                word->key[word->size++] = '\0';
+
+                void *old;
+                if (trie_at(obj, word->key, word->size, &old))
+                        continue; // the same key
+                trie_insert(obj, word->key, word->size, (void *)i, &old);
+                word->enabled = true;
+                ++i;
+        }
+        check(obj);
+        printf("0. [DONE] Insertion\n");
+
+        // 1. Prefixes of every length, the indexed levels too
+        for (size_t n = 0; n < 200; ++n) {
+                uint8_t prefix[4];
+                const size_t size = 1 + (size_t)rand() % 4;
+                for (size_t j = 0; j < size; ++j)
+                        prefix[j] = (uint8_t)('a' + rand() % 4);
+                remove_prefix(obj, prefix, size);
+                if (n % 10 == 0)
+                        fill(obj);
+        }
+        printf("1. [DONE] Prefixes\n");
+
+        // 2. A whole key and a missing prefix
+        fill(obj);
+        remove_prefix(obj, words[0].key, words[0].size);
+        remove_prefix(obj, (const uint8_t *)"z", 1);
+        printf("2. [DONE] Keys\n");
+
+        // 3. Everything, then the trie works again
+        remove_prefix(obj, NULL, 0);
+        assert(trie_begin(obj) == NULL);
+        fill(obj);
+        check(obj);
+        printf("3. [DONE] Empty prefix\n");
+
+        // 4. Nodes are freed by a thread
+        size_t expected = 0;
+        for (size_t i = 0; i < KEYS; ++i) {
+                expected += has_prefix(&words[i], (const uint8_t *)"b", 1);
+                words[i].enabled &= !has_prefix(&words[i],
+                                                (const uint8_t *)"b", 1);
+        }
+        assert(trie_remove_prefix(obj, (const uint8_t *)"b", 1,
+                                  count_deferred, NULL,
+                                  TRIE_REMOVE_DEFERRED) == expected);
+        check(obj);
+        while (deferred != expected)
+                usleep(1000);
+        printf("4. [DONE] Deferred\n");
+
+        trie_delete(&obj);
+        return 0;
+}
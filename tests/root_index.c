@@ -0,0 +1,115 @@
+/*
+ * root_index.c
+ * Copyright (C) 2016 DerShokus <lily.coder@gmail.com>
+ *
+ * Distributed under terms of the MIT license.
+ */
+
+#include <trie.h>
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define KEYS 1000
+
+struct word {
+        uint8_t key[6];
+        size_t size;
+        bool enabled;
+};
+
+static struct word words[KEYS];
+
+static void check(struct trie *obj)
+{
+        size_t enabled = 0;
+        for (size_t i = 0; i < KEYS; ++i) {
+                void *data;
+                const bool found =
+                    trie_at(obj, words[i].key, words[i].size, &data);
+                assert(found == words[i].enabled);
+                if (found) {
+                        assert(data == (void *)i);
+                        ++enabled;
+                }
+        }
+        assert(trie_count_prefix(obj, NULL, 0) == enabled);
+
+        size_t iterated = 0;
+        for (struct trie_node *i = trie_begin(obj); i; i = trie_next(i))
+                ++iterated;
+        assert(iterated == enabled);
+}
+
+static void toggle(struct trie *obj, size_t i)
+{
+        void *old;
+        if (words[i].enabled) {
+                assert(trie_remove(obj, words[i].key, words[i].size, &old));
+                assert(old == (void *)i);
+        } else {
+                assert(trie_insert(obj, words[i].key, words[i].size,
+                                   (void *)i, &old));
+        }
+        words[i].enabled = !words[i].enabled;
+}
+
+int main(void)
+{
+        srand(30);
+
+        // unique keys, short ones touch both levels of the index
+        for (size_t i = 0; i < KEYS;) {
+                struct word *word = &words[i];
+                word->size        = 1 + (size_t)rand() % 4;
+                for (size_t j = 0; j < word->size; ++j)
+                        word->key[j] = (uint8_t)('a' + rand() % 8);
+                word->key[word->size++] = '\0';
+
+                bool unique = true;
+                for (size_t j = 0; j < i && unique; ++j) {
+                        unique = words[j].size != word->size ||
+                                 memcmp(words[j].key, word->key, word->size);
+                }
+                if (unique)
+                        ++i;
+        }
+
+        for (unsigned int depth = 0; depth <= 2; ++depth) {
+                struct trie *obj = trie_new(NULL, NULL);
+                assert(trie_root_index(obj, depth));
+                for (size_t i = 0; i < KEYS; ++i)
+                        words[i].enabled = false;
+
+                // 1. Random insertion and removing
+                for (size_t n = 0; n < 20 * KEYS; ++n) {
+                        toggle(obj, (size_t)rand() % KEYS);
+                        if (n % 500 == 0)
+                                check(obj);
+                }
+                check(obj);
+
+                // 2. The index is rebuilt over existing keys
+                for (unsigned int d = 0; d <= 2; ++d) {
+                        assert(trie_root_index(obj, d));
+                        check(obj);
+                }
+                assert(trie_root_index(obj, depth));
+
+                // 3. Remove everything through iteration
+                for (struct trie_node *i = trie_begin(obj); i;
+                     i                   = trie_next_delete(obj, i)) {
+                }
+                for (size_t i = 0; i < KEYS; ++i)
+                        words[i].enabled = false;
+                check(obj);
+                toggle(obj, 0);
+                check(obj);
+
+                trie_delete(&obj);
+                printf("%u. [DONE] Depth %u\n", depth, depth);
+        }
+        assert(!trie_root_index(NULL, 1));
+
+        return 0;
+}
@@ -0,0 +1,234 @@
+/*
+ * set.c
+ * Copyright (C) 2016 DerShokus <lily.coder@gmail.com>
+ *
+ * Distributed under terms of the MIT license.
+ */
+
+#include <trie.h>
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define KEYS 3000
+
+struct word {
+        uint8_t key[8];
+        size_t size;
+};
+
+static struct word words[KEYS];
+
+// expected values of every key (-1 is none)
+static long model[KEYS];
+static size_t resolved, destroyed;
+
+// values of src are KEYS + the key number
+static void *resolve(void *ctx, void *data, void *other)
+{
+        assert(ctx == &resolved);
+        assert((size_t)other == (size_t)data + KEYS);
+        ++resolved;
+        return other;
+}
+
+static void destroy(void *data)
+{
+        (void)data;
+        ++destroyed;
+}
+
+static void *other_allocator(size_t size)
+{
+        return malloc(size);
+}
+
+static void other_deallocator(void *ptr)
+{
+        free(ptr);
+}
+
+static struct trie *fill(struct trie *obj, const bool *keys, size_t base)
+{
+        for (size_t i = 0; i < KEYS; ++i) {
+                void *old;
+                if (keys[i])
+                        assert(trie_insert_scored(obj, words[i].key,
+                                                  words[i].size,
+                                                  (void *)(base + i),
+                                                  (uint32_t)(base + i), &old));
+        }
+        return obj;
+}
+
+static void check(struct trie *obj)
+{
+        size_t count = 0;
+        for (size_t i = 0; i < KEYS; ++i) {
+                void *data;
+                const bool found =
+                    trie_at(obj, words[i].key, words[i].size, &data);
+                assert(found == (model[i] != -1));
+                assert(!found || data == (void *)model[i]);
+                count += found;
+        }
+        size_t iterated = 0;
+        for (struct trie_node *i = trie_begin(obj); i; i = trie_next(i))
+                ++iterated;
+        assert(iterated == count);
+        assert(trie_count_prefix(obj, NULL, 0) == count);
+
+        // counts and max scores of subtrees
+        for (size_t n = 0; n < 100; ++n) {
+                const struct word *word = &words[(size_t)rand() % KEYS];
+                const size_t size       = 1 + (size_t)rand() % word->size;
+                size_t expected = 0, best = 0;
+                for (size_t i = 0; i < KEYS; ++i) {
+                        if (model[i] == -1 || words[i].size < size ||
+                            memcmp(words[i].key, word->key, size) != 0)
+                                continue;
+                        ++expected;
+                        if ((size_t)model[i] > best)
+                                best = (size_t)model[i];
+                }
+                assert(trie_count_prefix(obj, word->key, size) == expected);
+                struct trie_node *top;
+                uint32_t score;
+                if (expected == 0)
+                        continue;
+                assert(trie_topk(obj, word->key, size, 1, &top) == 1);
+                assert(trie_score(top, &score) && score == best);
+        }
+}
+
+int main(void)
+{
+        srand(36);
+        struct trie *words_trie = trie_new(NULL, NULL);
+        for (size_t i = 0; i < KEYS;) {
+                struct word *word = &words[i];
+                word->size        = 1 + (size_t)rand() % 6;
+                for (size_t j = 0; j < word->size; ++j)
+                        word->key[j] = (uint8_t)('a' + rand() % 4);
+                word->key[word->size++] = '\0';
+                void *old;
+                if (!trie_insert(words_trie, word->key, word->size, NULL, &old))
+                        continue;
+                if (trie_count_prefix(words_trie, NULL, 0) > i)
+                        ++i;
+        }
+        trie_delete(&words_trie);
+
+        static bool a[KEYS], b[KEYS];
+        for (size_t i = 0; i < KEYS; ++i) {
+                a[i] = rand() % 3 != 0;
+                b[i] = rand() % 3 != 0;
+        }
+
+        // 0. Merge: keys of both are resolved, src is empty
+        struct trie *dst = fill(trie_new(NULL, NULL), a, 0);
+        struct trie *src = fill(trie_new(NULL, NULL), b, KEYS);
+        trie_root_index(dst, 2);
+        size_t both = 0;
+        for (size_t i = 0; i < KEYS; ++i) {
+                both += a[i] && b[i];
+                model[i] = b[i] ? (long)(KEYS + i) : a[i] ? (long)i : -1;
+        }
+        assert(trie_merge(dst, src, resolve, &resolved));
+        assert(resolved == both);
+        assert(trie_begin(src) == NULL);
+        assert(trie_count_prefix(src, NULL, 0) == 0);
+        trie_delete(&src);
+        check(dst);
+        trie_delete(&dst);
+        printf("0. [DONE] Merge\n");
+
+        // 1. Intersection keeps values of dst, the rest is destroyed
+        dst = fill(trie_new(NULL, NULL), a, 0);
+        src = fill(trie_new(NULL, NULL), b, KEYS);
+        trie_set_destructor(dst, destroy);
+        size_t removed = 0;
+        for (size_t i = 0; i < KEYS; ++i) {
+                removed += a[i] && !b[i];
+                model[i] = a[i] && b[i] ? (long)i : -1;
+        }
+        assert(trie_intersect(dst, src, NULL, NULL));
+        assert(destroyed == removed);
+        check(dst);
+        trie_set_destructor(dst, NULL);
+        trie_delete(&dst);
+        printf("1. [DONE] Intersection\n");
+
+        // 2. Difference, src isn't changed
+        dst = fill(trie_new(NULL, NULL), a, 0);
+        assert(trie_subtract(dst, src));
+        for (size_t i = 0; i < KEYS; ++i)
+                model[i] = a[i] && !b[i] ? (long)i : -1;
+        check(dst);
+        for (size_t i = 0; i < KEYS; ++i)
+                model[i] = b[i] ? (long)(KEYS + i) : -1;
+        check(src);
+        assert(trie_subtract(dst, dst) == false);
+        trie_delete(&dst);
+        printf("2. [DONE] Difference\n");
+
+        // 3. Nodes of a compacted src or of another deallocator are copied
+        for (size_t n = 0; n < 2; ++n) {
+                dst = fill(trie_new(NULL, NULL), a, 0);
+                if (n == 0) {
+                        assert(trie_compact(src, 0));
+                } else {
+                        trie_delete(&src);
+                        src = fill(trie_new(other_allocator,
+                                            other_deallocator),
+                                   b, KEYS);
+                }
+                assert(trie_merge(dst, src, NULL, NULL));
+                assert(trie_begin(src) == NULL);
+                trie_delete(&src);
+                for (size_t i = 0; i < KEYS; ++i)
+                        model[i] = b[i] ? (long)(KEYS + i) : a[i] ? (long)i
+                                                                  : -1;
+                check(dst);
+                trie_delete(&dst);
+                src = fill(trie_new(NULL, NULL), b, KEYS);
+        }
+        printf("3. [DONE] Copies\n");
+
+        // 4. Keys which are prefixes of each other stay in src
+        dst = fill(trie_new(NULL, NULL), a, 0);
+        trie_delete(&src);
+        src = trie_new(NULL, NULL);
+        size_t kept = 0;
+        for (size_t i = 0; i < KEYS; ++i) {
+                model[i] = a[i] ? (long)i : -1;
+                if (!a[i] || words[i].key[0] == 'a')
+                        continue;
+                // a key of dst is a prefix
+                uint8_t key[9];
+                memcpy(key, words[i].key, words[i].size);
+                key[words[i].size] = 'x';
+                void *old;
+                assert(trie_insert(src, key, words[i].size + 1, NULL, &old));
+                ++kept;
+        }
+        // a prefix of keys of dst
+        void *old;
+        assert(trie_insert(src, (const uint8_t *)"a", 1, NULL, &old));
+        ++kept;
+        const uint8_t fresh[] = "zz";
+        assert(trie_insert(src, fresh, sizeof(fresh), (void *)7, &old));
+        assert(trie_merge(dst, src, NULL, NULL));
+        assert(trie_count_prefix(src, NULL, 0) == kept);
+        for (struct trie_node *i = trie_begin(src); i; i = trie_next(i))
+                --kept;
+        assert(kept == 0);
+        assert(trie_at(dst, fresh, sizeof(fresh), &old) && old == (void *)7);
+        assert(trie_remove(dst, fresh, sizeof(fresh), &old));
+        check(dst);
+        trie_delete(&src);
+        trie_delete(&dst);
+        printf("4. [DONE] Conflicts\n");
+
+        return 0;
+}
@@ -0,0 +1,186 @@
+/*
+ * shm.c
+ * Copyright (C) 2016 DerShokus <lily.coder@gmail.com>
+ *
+ * Distributed under terms of the MIT license.
+ */
+
+#define _GNU_SOURCE // memfd_create
+
+#include <trie.h>
+#include <trie_shm.h>
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#define KEYS 5000
+#define OPS 200000
+#define REGION (4u << 20)
+
+static size_t key_of(size_t id, uint8_t *key)
+{
+        return (size_t)sprintf((char *)key, "k%zu", id * 7919 % 100003) + 1;
+}
+
+// A value tells its key, so a reader can check it. The version changes.
+static uint64_t value_of(size_t id, size_t version)
+{
+        return (uint64_t)version << 32 | id;
+}
+
+// Read keys until the writer is done, values must belong to their keys.
+static void reader(struct trie_shm *obj, const volatile uint32_t *done)
+{
+        size_t reads = 0;
+        while (!*done || reads < OPS) {
+                uint8_t key[16];
+                const size_t id = (size_t)rand() % KEYS;
+                uint64_t value;
+                if (trie_shm_at(obj, key, key_of(id, key), &value) &&
+                    (value & 0xffffffff) != id)
+                        _exit(1);
+                ++reads;
+        }
+}
+
+int main(void)
+{
+        srand(40);
+
+        // 0. The same results as struct trie
+        const int fd = memfd_create("trie_shm", 0);
+        assert(fd >= 0 && ftruncate(fd, REGION) == 0);
+        void *region = mmap(NULL, REGION, PROT_READ | PROT_WRITE, MAP_SHARED,
+                            fd, 0);
+        assert(region != MAP_FAILED);
+        struct trie_shm *obj = trie_shm_create(region, REGION);
+        struct trie *model   = trie_new(NULL, NULL);
+        assert(obj);
+        const size_t empty = trie_shm_used(obj);
+        for (size_t i = 0; i < OPS; ++i) {
+                uint8_t key[16];
+                size_t size = key_of((size_t)rand() % KEYS, key);
+                // unterminated keys are prefixes of others
+                if (rand() % 10 == 0)
+                        --size;
+                uint64_t value, expected;
+                void *old;
+                switch (rand() % 3) {
+                case 0:
+                        assert(trie_shm_insert(obj, key, size, i, &value) ==
+                               trie_insert(model, key, size, (void *)i, &old));
+                        assert(value == (uint64_t)(uintptr_t)old);
+                        break;
+                case 1:
+                        assert(trie_shm_remove(obj, key, size, &value) ==
+                               trie_remove(model, key, size, &old));
+                        break;
+                default:
+                        if (trie_shm_at(obj, key, size, &value)) {
+                                assert(trie_at(model, key, size, &old));
+                                expected = (uint64_t)(uintptr_t)old;
+                                assert(value == expected);
+                        } else {
+                                assert(!trie_at(model, key, size, &old));
+                        }
+                }
+                assert(trie_shm_size(obj) == trie_count_prefix(model, NULL, 0));
+        }
+        printf("0. [DONE] Model\n");
+
+        // 1. Another mapping (another address) attaches, removed nodes
+        // go back to the region
+        void *mapping = mmap(NULL, REGION, PROT_READ | PROT_WRITE, MAP_SHARED,
+                             fd, 0);
+        assert(mapping != MAP_FAILED && mapping != region);
+        assert(trie_shm_attach(mapping, REGION / 2) == NULL);
+        struct trie_shm *other = trie_shm_attach(mapping, REGION);
+        assert(other);
+        for (struct trie_node *i = trie_begin(model); i;) {
+                uint8_t key[16];
+                void *data;
+                uint64_t value;
+                const size_t size = trie_key(i, key, sizeof(key));
+                trie_data(i, &data);
+                assert(trie_shm_at(other, key, size, &value));
+                assert(value == (uint64_t)(uintptr_t)data);
+                assert(trie_shm_remove(other, key, size, &value));
+                i = trie_next_delete(model, i);
+        }
+        assert(trie_shm_size(obj) == 0);
+        assert(trie_shm_used(obj) == empty);
+        trie_shm_detach(&other);
+        munmap(mapping, REGION);
+        trie_delete(&model);
+        printf("1. [DONE] Attach\n");
+
+        // 2. A full region fails insertions and keeps its keys
+        const size_t small = 4096;
+        uint64_t *little   = malloc(small);
+        struct trie_shm *full = trie_shm_create(little, small);
+        assert(full);
+        size_t count = 0;
+        for (size_t id = 0;; ++id) {
+                uint8_t key[16];
+                uint64_t old;
+                if (!trie_shm_insert(full, key, key_of(id, key), id, &old))
+                        break;
+                ++count;
+        }
+        assert(trie_shm_used(full) <= small);
+        assert(trie_shm_size(full) == count && count > 0);
+        for (size_t id = 0; id < count; ++id) {
+                uint8_t key[16];
+                uint64_t value;
+                assert(trie_shm_at(full, key, key_of(id, key), &value));
+                assert(value == id);
+        }
+        trie_shm_detach(&full);
+        free(little);
+        printf("2. [DONE] Full\n");
+
+        // 3. Processes read while one writes
+        volatile uint32_t *done = mmap(NULL, sizeof(*done),
+                                       PROT_READ | PROT_WRITE,
+                                       MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+        assert(done != MAP_FAILED);
+        pid_t pids[2];
+        for (size_t i = 0; i < 2; ++i) {
+                pids[i] = fork();
+                if (pids[i] == 0) {
+                        struct trie_shm *child =
+                            trie_shm_attach(region, REGION);
+                        if (child == NULL)
+                                _exit(1);
+                        reader(child, done);
+                        _exit(0);
+                }
+        }
+        for (size_t i = 0; i < OPS; ++i) {
+                uint8_t key[16];
+                const size_t id   = (size_t)rand() % KEYS;
+                const size_t size = key_of(id, key);
+                uint64_t old;
+                if (i % 3 == 0)
+                        trie_shm_remove(obj, key, size, &old);
+                else
+                        assert(trie_shm_insert(obj, key, size,
+                                               value_of(id, i), &old));
+        }
+        *done = 1;
+        for (size_t i = 0; i < 2; ++i) {
+                int status;
+                assert(waitpid(pids[i], &status, 0) == pids[i]);
+                assert(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+        }
+        trie_shm_detach(&obj);
+        munmap(region, REGION);
+        munmap((void *)done, sizeof(*done));
+        close(fd);
+        printf("3. [DONE] Processes\n");
+        return 0;
+}
@@ -0,0 +1,183 @@
+/*
+ * topk.c
+ * Copyright (C) 2016 DerShokus <lily.coder@gmail.com>
+ *
+ * Distributed under terms of the MIT license.
+ */
+
+#include <trie.h>
+#include <assert.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define KEYS 2000
+#define K 10
+
+struct word {
+        uint8_t key[8];
+        size_t size;
+        uint32_t score;
+        bool enabled;
+};
+
+static struct word words[KEYS];
+
+static bool has_prefix(const struct word *word, const uint8_t *prefix,
+                       size_t size)
+{
+        return word->size >= size && memcmp(word->key, prefix, size) == 0;
+}
+
+static int descending(const void *a, const void *b)
+{
+        const uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+        return x < y ? 1 : x > y ? -1 : 0;
+}
+
+// the best scores of enabled words with the prefix (brute force)
+static size_t expected(const uint8_t *prefix, size_t size, uint32_t *scores)
+{
+        static uint32_t all[KEYS];
+        size_t count = 0;
+        for (size_t i = 0; i < KEYS; ++i) {
+                if (words[i].enabled && has_prefix(&words[i], prefix, size))
+                        all[count++] = words[i].score;
+        }
+        qsort(all, count, sizeof(all[0]), descending);
+        count = count < K ? count : K;
+        memcpy(scores, all, count * sizeof(all[0]));
+        return count;
+}
+
+static void check(struct trie *obj, const uint8_t *prefix, size_t size)
+{
+        uint32_t scores[K];
+        const size_t count = expected(prefix, size, scores);
+
+        struct trie_node *out[K];
+        const size_t found = trie_topk(obj, prefix, size, K, out);
+        assert(found == count);
+        for (size_t i = 0; i < found; ++i) {
+                uint32_t score;
+                bool ret = trie_score(out[i], &score);
+                assert(ret);
+                assert(score == scores[i]);
+
+                uint8_t key[8];
+                const size_t key_size = trie_key(out[i], key, sizeof(key));
+                assert(key_size <= sizeof(key));
+                assert(key_size >= size && memcmp(key, prefix, size) == 0);
+
+                void *data;
+                ret = trie_data(out[i], &data);
+                assert(ret);
+                const struct word *word = &words[(size_t)data];
+                assert(word->enabled);
+                assert(word->size == key_size);
+                assert(memcmp(word->key, key, key_size) == 0);
+        }
+}
+
+static void check_all(struct trie *obj)
+{
+        check(obj, NULL, 0);
+        for (uint8_t a = 'a'; a <= 'd'; ++a) {
+                uint8_t prefix[2] = {a, 'a'};
+                check(obj, prefix, 1);
+                for (uint8_t b = 'a'; b <= 'd'; ++b) {
+                        prefix[1] = b;
+                        check(obj, prefix, 2);
+                }
+        }
+}
+
+int main(void)
+{
+        srand(26);
+        struct trie *obj = trie_new(NULL, NULL);
+
+        // 0. Unique keys of a small alphabet with a terminator
+        for (size_t i = 0; i < KEYS;) {
+                struct word *word = &words[i];
+                word->size        = 1 + (size_t)rand() % 6;
+                for (size_t j = 0; j < word->size; ++j)
+                        word->key[j] = (uint8_t)('a' + rand() % 4);
+                word->key[word->size++] = '\0';
+                word->score             = (uint32_t)rand() % 100000;
+                word->enabled           = true;
+
+                void *old;
+                if (trie_at(obj, word->key, word->size, &old))
+                        continue; // the same key
+                bool ret = trie_insert_scored(obj, word->key, word->size,
+                                              (void *)i, word->score, &old);
+                assert(ret);
+                assert(old == NULL);
+                ++i;
+        }
+        check_all(obj);
+        printf("0. [DONE] Insertion\n");
+
+        // 1. Change scores, a replaced value is returned
+        for (size_t i = 0; i < KEYS; i += 3) {
+                words[i].score = (uint32_t)rand() % 100000;
+                void *old      = NULL;
+                bool ret = trie_insert_scored(obj, words[i].key, words[i].size,
+                                              (void *)i, words[i].score, &old);
+                assert(ret);
+                assert(old == (void *)i);
+        }
+        check_all(obj);
+        printf("1. [DONE] Scores updated\n");
+
+        // 2. trie_insert keeps a score
+        for (size_t i = 1; i < KEYS; i += 5) {
+                void *old;
+                bool ret = trie_insert(obj, words[i].key, words[i].size,
+                                       (void *)i, &old);
+                assert(ret);
+        }
+        check_all(obj);
+        printf("2. [DONE] Scores kept\n");
+
+        // 3. Remove keys, the best ones first
+        for (size_t n = 0; n < KEYS / 2; ++n) {
+                struct trie_node *best;
+                assert(trie_topk(obj, NULL, 0, 1, &best) == 1);
+                void *data;
+                assert(trie_data(best, &data));
+                struct word *word = &words[(size_t)data];
+                word->enabled     = false;
+                assert(trie_remove(obj, word->key, word->size, &data));
+                if (n % 50 == 0)
+                        check_all(obj);
+        }
+        check_all(obj);
+        printf("3. [DONE] Removing\n");
+
+        // 4. Keys that are prefixes of each other
+        void *old;
+        struct word *word = words;
+        while (!word->enabled)
+                ++word;
+        assert(!trie_insert(obj, word->key, word->size - 1, NULL, &old));
+        assert(!trie_insert(obj, word->key, word->size + 1, NULL, &old));
+        assert(trie_at(obj, word->key, word->size, &old));
+        printf("4. [DONE] Prefixes\n");
+
+        // 5. k larger than the number of keys
+        static struct trie_node *all[KEYS];
+        size_t enabled = 0, under = 0;
+        const uint8_t prefix[] = {'a', 'b'};
+        for (size_t i = 0; i < KEYS; ++i) {
+                enabled += words[i].enabled;
+                under += words[i].enabled && has_prefix(&words[i], prefix, 2);
+        }
+        assert(trie_topk(obj, NULL, 0, SIZE_MAX, all) == enabled);
+        assert(trie_topk(obj, prefix, 2, SIZE_MAX, all) == under);
+        printf("5. [DONE] Any k\n");
+
+        trie_delete(&obj);
+        return 0;
+}
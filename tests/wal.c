@@ -0,0 +1,317 @@
+/*
+ * wal.c
+ * Copyright (C) 2016 DerShokus <lily.coder@gmail.com>
+ *
+ * Distributed under terms of the MIT license.
+ */
+
+#include <trie.h>
+#include <trie_wal.h>
+#include <assert.h>
+#include <dirent.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#define IDS 5000
+#define OPS 200000
+
+static char dir[] = "/tmp/trie_wal_XXXXXX";
+
+// the model: a value (op number) of every key id or -1
+static long model[IDS];
+
+static size_t key_of(size_t id, uint8_t *key)
+{
+        return (size_t)sprintf((char *)key, "k%zu", id) + 1;
+}
+
+// op i inserts a key or removes the key of op i - 3
+static size_t op_id(size_t i)
+{
+        return (i % 7 == 3 ? i - 3 : i) * 7919 % IDS;
+}
+
+static void op_apply(struct trie *obj, size_t i)
+{
+        uint8_t key[16];
+        const size_t size = key_of(op_id(i), key);
+        void *old;
+        if (i % 7 == 3)
+                trie_remove(obj, key, size, &old);
+        else
+                trie_insert(obj, key, size, (void *)i, &old);
+}
+
+static void model_apply(size_t i)
+{
+        model[op_id(i)] = i % 7 == 3 ? -1 : (long)i;
+}
+
+static bool same(struct trie *obj, size_t id)
+{
+        uint8_t key[16];
+        const size_t size = key_of(id, key);
+        void *data;
+        if (!trie_at(obj, key, size, &data))
+                return model[id] == -1;
+        return model[id] == (long)(uintptr_t)data;
+}
+
+static void check(struct trie *obj)
+{
+        size_t count = 0;
+        for (size_t id = 0; id < IDS; ++id) {
+                assert(same(obj, id));
+                count += model[id] != -1;
+        }
+        assert(trie_count_prefix(obj, NULL, 0) == count);
+}
+
+static size_t logs(void)
+{
+        size_t count = 0;
+        DIR *dirp    = opendir(dir);
+        for (struct dirent *i = readdir(dirp); i; i = readdir(dirp))
+                count += strncmp(i->d_name, "log.", 4) == 0;
+        closedir(dirp);
+        return count;
+}
+
+// An allocator which fails for large blocks when it's asked to.
+static bool fail_large;
+
+static void *allocator(size_t size)
+{
+        return fail_large && size > (1 << 16) ? NULL : malloc(size);
+}
+
+// The size of all logs.
+static size_t logs_size(void)
+{
+        size_t size = 0;
+        DIR *dirp   = opendir(dir);
+        for (struct dirent *i = readdir(dirp); i; i = readdir(dirp)) {
+                char path[512];
+                struct stat st;
+                snprintf(path, sizeof(path), "%s/%s", dir, i->d_name);
+                if (strncmp(i->d_name, "log.", 4) == 0 && stat(path, &st) == 0)
+                        size += (size_t)st.st_size;
+        }
+        closedir(dirp);
+        return size;
+}
+
+// Change a trie until the parent kills us, report synced ops to the pipe.
+static void writer(int fd)
+{
+        const struct trie_wal_config config = {16, 1000};
+        struct trie *obj = trie_recover(dir, &config, NULL, NULL);
+        assert(obj);
+        for (size_t i = 0; i < OPS; ++i) {
+                op_apply(obj, i);
+                if (i % 1000 == 999)
+                        assert(trie_checkpoint(obj));
+                if (i % 100 == 99) {
+                        assert(trie_wal_sync(obj));
+                        const size_t synced = i + 1;
+                        assert(write(fd, &synced, sizeof(synced)) ==
+                               sizeof(synced));
+                }
+        }
+        pause();
+}
+
+int main(void)
+{
+        assert(mkdtemp(dir));
+        for (size_t id = 0; id < IDS; ++id)
+                model[id] = -1;
+
+        // 0. Changes survive a restart
+        struct trie *obj = trie_recover(dir, NULL, NULL, NULL);
+        assert(obj);
+        assert(trie_begin(obj) == NULL);
+        for (size_t i = 0; i < 3000; ++i) {
+                op_apply(obj, i);
+                model_apply(i);
+        }
+        void *old;
+        assert(trie_insert_scored(obj, (const uint8_t *)"scored", 7,
+                                  (void *)7, 42, &old));
+        trie_delete(&obj);
+
+        obj = trie_recover(dir, NULL, NULL, NULL);
+        assert(obj);
+        uint32_t score;
+        struct trie_node *out;
+        assert(trie_topk(obj, (const uint8_t *)"s", 1, 1, &out) == 1);
+        assert(trie_score(out, &score) && score == 42);
+        assert(trie_remove(obj, (const uint8_t *)"scored", 7, &old));
+        assert(old == (void *)7);
+        check(obj);
+        printf("0. [DONE] Restart\n");
+
+        // 1. A checkpoint replaces logs, next changes go to a new log
+        assert(trie_checkpoint(obj));
+        for (size_t i = 3000; i < 4000; ++i) {
+                op_apply(obj, i);
+                model_apply(i);
+        }
+        assert(trie_checkpoint_wait(obj));
+        assert(logs() == 1);
+        // keys "k1..." and the next key by trie_next_delete
+        assert(trie_remove_prefix(obj, (const uint8_t *)"k1", 2, NULL, NULL,
+                                  0) > 0);
+        for (size_t id = 0; id < IDS; ++id) {
+                uint8_t key[16];
+                key_of(id, key);
+                if (key[1] == '1')
+                        model[id] = -1;
+        }
+        struct trie_node *first = trie_begin(obj);
+        assert(trie_data(first, &old));
+        model[op_id((size_t)old)] = -1;
+        trie_next_delete(obj, first);
+        trie_delete(&obj);
+
+        obj = trie_recover(dir, NULL, NULL, NULL);
+        assert(obj);
+        check(obj);
+        printf("1. [DONE] Checkpoint\n");
+
+        // 2. trie_clear is logged too
+        trie_clear(obj);
+        trie_delete(&obj);
+        obj = trie_recover(dir, NULL, NULL, NULL);
+        assert(obj);
+        assert(trie_begin(obj) == NULL);
+        trie_delete(&obj);
+        printf("2. [DONE] Clear\n");
+
+        // 3. A torn record ends a log
+        obj = trie_recover(dir, NULL, NULL, NULL);
+        assert(trie_insert(obj, (const uint8_t *)"a", 2, (void *)1, &old));
+        trie_delete(&obj);
+        DIR *dirp = opendir(dir);
+        for (struct dirent *i = readdir(dirp); i; i = readdir(dirp)) {
+                if (strncmp(i->d_name, "log.", 4) != 0)
+                        continue;
+                char path[512];
+                snprintf(path, sizeof(path), "%s/%s", dir, i->d_name);
+                FILE *file = fopen(path, "a");
+                fwrite("\x13\x00\x00\x00\x40", 1, 5, file);
+                fclose(file);
+        }
+        closedir(dirp);
+        obj = trie_recover(dir, NULL, NULL, NULL);
+        assert(obj);
+        void *data;
+        assert(trie_at(obj, (const uint8_t *)"a", 2, &data));
+        assert(data == (void *)1);
+        assert(trie_remove(obj, (const uint8_t *)"a", 2, &data));
+        trie_delete(&obj);
+        printf("3. [DONE] Torn record\n");
+
+        // 4. Kill a writer, synced changes are recovered
+        int fds[2];
+        assert(pipe(fds) == 0);
+        const pid_t pid = fork();
+        if (pid == 0) {
+                close(fds[0]);
+                writer(fds[1]);
+                _exit(0);
+        }
+        close(fds[1]);
+        size_t synced = 0;
+        while (synced < 20000)
+                assert(read(fds[0], &synced, sizeof(synced)) ==
+                       sizeof(synced));
+        kill(pid, SIGKILL);
+        waitpid(pid, NULL, 0);
+        close(fds[0]);
+
+        // the state is the one after some op which isn't before the synced
+        obj = trie_recover(dir, NULL, NULL, NULL);
+        assert(obj);
+        for (size_t id = 0; id < IDS; ++id)
+                model[id] = -1;
+        for (size_t i = 0; i < synced; ++i)
+                model_apply(i);
+        size_t diff = 0;
+        for (size_t id = 0; id < IDS; ++id)
+                diff += !same(obj, id);
+        for (size_t i = synced; diff != 0 && i < OPS; ++i) {
+                const size_t id = op_id(i);
+                diff -= !same(obj, id);
+                model_apply(i);
+                diff += !same(obj, id);
+        }
+        assert(diff == 0);
+        check(obj);
+        printf("4. [DONE] Kill\n");
+
+        // 5. Only stored keys are logged, once (a record is 33 bytes and
+        // a key)
+        trie_remove_prefix(obj, NULL, 0, NULL, NULL, 0);
+        assert(trie_wal_sync(obj));
+        size_t size = logs_size();
+        assert(trie_insert(obj, (const uint8_t *)"ab", 2, (void *)1, &old));
+        assert(!trie_insert(obj, (const uint8_t *)"abc", 3, (void *)2, &old));
+        struct trie_write write = {(const uint8_t *)"abc", 3, (void *)3, false,
+                                   false};
+        assert(trie_write_batch(obj, &write, 1) == 0);
+        assert(trie_wal_sync(obj));
+        assert(logs_size() == size + 33 + 2);
+        // a tombstone in the way is pruned and the insert is done again
+        trie_set_lazy(obj, true, 0);
+        assert(trie_remove(obj, (const uint8_t *)"ab", 2, &old));
+        assert(trie_insert(obj, (const uint8_t *)"abcd", 4, (void *)4, &old));
+        assert(trie_wal_sync(obj));
+        assert(logs_size() == size + 33 + 2 + 33 + 2 + 33 + 4);
+        trie_delete(&obj);
+        obj = trie_recover(dir, NULL, NULL, NULL);
+        assert(obj);
+        assert(trie_count_prefix(obj, NULL, 0) == 1);
+        assert(trie_at(obj, (const uint8_t *)"abcd", 4, &data));
+        assert(data == (void *)4);
+        printf("5. [DONE] Failed inserts\n");
+
+        // 6. An insert which can't be logged isn't applied
+        trie_remove_prefix(obj, NULL, 0, NULL, NULL, 0);
+        trie_delete(&obj);
+        obj = trie_recover(dir, NULL, allocator, free);
+        assert(obj);
+        static uint8_t large[1 << 17];
+        memset(large, 'l', sizeof(large));
+        fail_large = true;
+        assert(!trie_insert(obj, large, sizeof(large), (void *)6, &old));
+        assert(trie_count_prefix(obj, NULL, 0) == 0);
+        write = (struct trie_write){large, sizeof(large), (void *)6, false,
+                                    false};
+        assert(trie_write_batch(obj, &write, 1) == 0);
+        assert(!write.done && write.data == (void *)6);
+        assert(trie_count_prefix(obj, NULL, 0) == 0);
+        assert(!trie_wal_sync(obj));
+        fail_large = false;
+        trie_delete(&obj);
+        obj = trie_recover(dir, NULL, NULL, NULL);
+        assert(obj);
+        assert(trie_count_prefix(obj, NULL, 0) == 0);
+        printf("6. [DONE] Failed log\n");
+
+        trie_remove_prefix(obj, NULL, 0, NULL, NULL, 0);
+        trie_delete(&obj);
+        dirp = opendir(dir);
+        for (struct dirent *i = readdir(dirp); i; i = readdir(dirp)) {
+                char path[512];
+                snprintf(path, sizeof(path), "%s/%s", dir, i->d_name);
+                unlink(path);
+        }
+        closedir(dirp);
+        rmdir(dir);
+        return 0;
+}